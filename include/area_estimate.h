@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "cpu_renderer.h"
+
+// Options of a Monte Carlo estimate of the Mandelbrot set's area
+struct AreaEstimateSettings {
+    uint64_t samples = 100000000;  // rounded up to whole passes, at least two
+    int maxIterations = 100000;
+};
+
+// Running or final state of an estimate
+struct AreaEstimate {
+    double area = 0.0;
+    double confidence95 = 0.0;  // half width of the 95% confidence interval, 0 before two passes
+    int passes = 0;
+    uint64_t samples = 0;
+    double seconds = 0.0;
+    MembershipCounts counts;
+
+    double samplesPerSecond() const { return seconds > 0.0 ? samples / seconds : 0.0; }
+};
+
+// Estimate the area of the Mandelbrot set by stratified sampling on all
+// workers with the membership kernel. Each pass draws one jittered point
+// from every cell of a fixed grid over the upper half of the set's bounding
+// box (the set is symmetric about the real axis), so every pass is an
+// independent unbiased estimate and the confidence interval follows from
+// their spread. Points still bounded at the iteration limit count as inside,
+// which biases the estimate upwards by the boundary the limit cannot resolve.
+// progress is called from the calling thread about once a second.
+AreaEstimate estimateMandelbrotArea(const CpuRenderSettings& cpuSettings, const AreaEstimateSettings& settings,
+                                    const std::function<void(const AreaEstimate&)>& progress);
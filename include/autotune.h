@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "cpu_renderer.h"
+
+// Per-host tuning of the CPU engine. The tuner times short renders of a few
+// representative views over a grid of tile sizes, thread counts and kernel
+// variants, then the narrowest wide reference format worth sharing between
+// the chosen threads, and stores the result in a config file named after
+// the host, which is applied at startup before command-line overrides.
+
+// Location of this host's tuning file
+std::string tunedConfigPath();
+
+// Apply the stored tuning to settings; false if there is none
+bool loadTunedSettings(CpuRenderSettings& settings);
+
+bool saveTunedSettings(const CpuRenderSettings& settings);
+
+// Benchmark the grid and return base with the best parameters filled in
+CpuRenderSettings autotuneCpuSettings(const CpuRenderSettings& base);
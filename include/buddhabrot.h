@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cpu_renderer.h"
+
+// Orbit density options. A Buddhabrot uses one iteration limit; a Nebulabrot
+// gives the red, green and blue channels their own.
+struct BuddhabrotSettings {
+    int iterationLimits[3] = {2000, 2000, 2000};
+    int minIterations = 20;          // shorter orbits only add a haze over the whole disc
+    bool importanceSampling = true;  // sample cells near the boundary more often
+
+    static BuddhabrotSettings nebulabrot() {
+        BuddhabrotSettings settings;
+        settings.iterationLimits[0] = 5000;
+        settings.iterationLimits[1] = 500;
+        settings.iterationLimits[2] = 50;
+        return settings;
+    }
+
+    int channelCount() const {
+        bool single = iterationLimits[0] == iterationLimits[1] && iterationLimits[1] == iterationLimits[2];
+        return single ? 1 : 3;
+    }
+};
+
+// Exposure of the exponential tone map shared by buddhabrot_fragment.glsl
+// and toneMapBuddhabrot()
+const float kBuddhabrotExposure = 2.0f;
+
+// Progressive Buddhabrot of z^2 + c. Worker threads sample c values and plot
+// the orbits that escape into a density buffer of their own, merging it into
+// the shared total a few times per second, so the hot loop never
+// touches shared memory or atomics. With NUMA placement the workers are
+// pinned like the tile engine's and fault in their buffers themselves.
+//
+// c is drawn from the upper half of the sampling disc and each orbit is also
+// plotted mirrored, since conj(c) has the conjugate orbit. With importance
+// sampling, c is first drawn from a grid cell with probability proportional
+// to the orbit length the cell's samples showed in a pre-pass, which favours
+// the boundary; orbits are weighted by the inverse probability so the
+// density stays unbiased.
+class BuddhabrotRenderer {
+public:
+    BuddhabrotRenderer(const CpuRenderSettings& cpuSettings, const BuddhabrotSettings& settings);
+    ~BuddhabrotRenderer();
+
+    BuddhabrotRenderer(const BuddhabrotRenderer&) = delete;
+    BuddhabrotRenderer& operator=(const BuddhabrotRenderer&) = delete;
+
+    // Discard the accumulated density and (re)start sampling for the view's
+    // window of the plane (offset, zoom, width and height are used)
+    void start(const CpuView& view);
+    void stop();
+
+    // Bumped by every merge, so callers can tell when resolve() has news
+    uint64_t mergeCount() const { return merges.load(std::memory_order_acquire); }
+    // Samples merged into the total so far
+    uint64_t sampleCount() const { return mergedSamples.load(std::memory_order_acquire); }
+    double samplesPerSecond() const;
+
+    // Merged density as three floats per pixel, rows bottom-up, together
+    // with per-channel scales that map a high percentile of the density to 1
+    void resolve(std::vector<float>& density, float scale[3]);
+
+    int workerCount() const { return static_cast<int>(workers.size()); }
+    int pinnedWorkers() const { return pinnedCount.load(); }
+
+private:
+    struct Worker {
+        std::thread thread;
+        int cpu = -1;
+    };
+
+    void buildImportanceMap();
+    void workerLoop(int index);
+
+    BuddhabrotSettings config;
+    std::vector<Worker> workers;
+    bool placeByNode = false;
+    std::atomic<int> pinnedCount{0};
+
+    // Sampling distribution over grid cells, as a cumulative weight table
+    std::vector<double> cellCumulative;
+    std::vector<float> cellWeight;  // orbit weight of each cell's samples
+
+    // Shared state, guarded by stateMutex. A new generation starts with
+    // every start() or stop(); workers drop their buffers when it changes.
+    mutable std::mutex stateMutex;
+    std::condition_variable stateWake;
+    CpuView currentView;
+    std::atomic<uint64_t> generation{0};
+    bool running = false;
+    bool stopping = false;
+    std::vector<double> total;
+    std::chrono::steady_clock::time_point startTime;
+
+    std::atomic<uint64_t> merges{0};
+    std::atomic<uint64_t> mergedSamples{0};
+};
+
+// Map resolved density to 8-bit RGB with the display tone map
+void toneMapBuddhabrot(const std::vector<float>& density, const float scale[3], int width, int height,
+                       std::vector<uint8_t>& rgb);
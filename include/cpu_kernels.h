@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "double_double.h"
+#include "fixed_point.h"
+#include "formula.h"
+
+// Iteration value stored for pixels that never escaped
+const float kInteriorIteration = -1.0f;
+
+// Iteration value a perturbation kernel without rebasing stores for pixels
+// whose delta lost its precision against the reference orbit
+const float kGlitchIteration = -2.0f;
+
+// Inner-loop implementations of the CPU engine. The SIMD variants are
+// compiled with per-function target attributes and only used when the
+// running CPU supports them.
+enum class KernelVariant {
+    Scalar,
+    Avx2,    // 4 pixels per vector
+    Avx512,  // 8 pixels per vector
+};
+
+const char* kernelVariantName(KernelVariant variant);
+bool parseKernelVariant(const std::string& name, KernelVariant& variant);
+bool kernelVariantSupported(KernelVariant variant);
+
+// Widest variant the running CPU supports
+KernelVariant bestKernelVariant();
+
+// True if c lies in the main cardioid or the period-2 bulb
+inline bool inMainCardioidOrBulb(double cx, double cy) {
+    double xq = cx - 0.25;
+    double q = xq * xq + cy * cy;
+    if (q * (q + xq) <= 0.25 * cy * cy) return true;
+    return (cx + 1.0) * (cx + 1.0) + cy * cy <= 0.0625;
+}
+
+// Cardioid/bulb test that only accepts points clearly inside, for coordinates
+// carrying more precision than the double test can resolve
+inline bool safelyInMainCardioidOrBulb(double cx, double cy) {
+    const double margin = 1e-12;
+    double xq = cx - 0.25;
+    double q = xq * xq + cy * cy;
+    if (q * (q + xq) <= 0.25 * cy * cy - margin) return true;
+    return (cx + 1.0) * (cx + 1.0) + cy * cy <= 0.0625 - margin;
+}
+
+// Arithmetic used for pixel iteration
+enum class CpuPrecision {
+    Auto,          // pick the cheapest type that resolves the view's pixel spacing
+    Double,        // about 1e-13 relative pixel spacing
+    DoubleDouble,  // about 1e-29, no reference orbit needed
+    Fixed128,      // multi-limb fixed point: about 1e-33
+    Fixed192,      // about 1e-52
+    Fixed256,      // about 1e-71
+    Perturbation,  // double deltas against a fixed-point reference orbit (Mandelbrot only)
+};
+
+const char* cpuPrecisionName(CpuPrecision precision);
+bool parseCpuPrecision(const std::string& name, CpuPrecision& precision);
+
+// Options compiled into a kernel rather than tested per iteration
+enum KernelFeature : unsigned {
+    kKernelCardioidCheck = 1u << 0,   // resolve main cardioid and period-2 bulb points without iterating
+    kKernelSmoothColoring = 1u << 1,  // continuous iteration count instead of whole iterations
+    kKernelJulia = 1u << 2,           // z0 = pixel and c = the view's Julia parameter
+    kKernelInteriorCheck = 1u << 3,   // stop bounded orbits whose derivative has shrunk (not fixed point)
+};
+const unsigned kKernelFeatureCombinations = 16;
+
+// View in the form the kernels consume. Pixel (x, y) maps to
+// c = (offsetX + (x + 0.5 - width / 2) * scaleX, offsetY - (y + 0.5 - height / 2) * scaleY),
+// the same convention as fragment.glsl.
+struct KernelView {
+    DoubleDouble offsetX;
+    DoubleDouble offsetY;
+    FixedPoint<4> fixedOffsetX;  // full-precision offset for the fixed-point kernels
+    FixedPoint<4> fixedOffsetY;
+    DoubleDouble juliaX;  // c of Julia kernels
+    DoubleDouble juliaY;
+    double scaleX = 0.0;
+    double scaleY = 0.0;
+    int width = 0;
+    int height = 0;
+    int maxIterations = 100;
+
+    // Perturbation kernels: the reference orbit z_0, z_1, ... as (re, im)
+    // pairs, in double or (for orbits over the memory budget) float, and the
+    // reference point's position relative to the offset
+    const double* referenceOrbit = nullptr;
+    const float* compactReferenceOrbit = nullptr;
+    int referenceLength = 0;
+    double referenceX = 0.0;
+    double referenceY = 0.0;
+    bool rebasing = true;       // restart deltas at the orbit's start rather than flag glitches
+    bool glitchedOnly = false;  // only redo pixels holding kGlitchIteration
+
+    // Interior check: |dz_n/dz_1|^2 below which an orbit has fallen into an
+    // attracting cycle, and where to add up the pixels it stops (optional)
+    double interiorLimit = 0.0;
+    std::atomic<int64_t>* interiorCaught = nullptr;
+};
+
+// Iterate the pixels [x0, x1) x [y0, y1) and store their iteration values
+// (kInteriorIteration for points that never escape) into image, a
+// width-wide row-major buffer
+using BlockKernel = void (*)(const KernelView& view, int x0, int y0, int x1, int y1, float* image);
+
+// Kernel specialised for the given precision (not Auto), variant, formula
+// and KernelFeature set. Every combination is instantiated at compile time;
+// variants without a vector form of the precision fall back to the best
+// scalar build. Perturbation kernels exist for the non-Julia Mandelbrot
+// formula only; other combinations return nullptr.
+BlockKernel selectBlockKernel(CpuPrecision precision, KernelVariant variant, Formula formula, unsigned features);
+
+// Tallies of a membership test, by how each point was decided
+struct MembershipCounts {
+    uint64_t points = 0;
+    uint64_t cardioid = 0;   // inside the main cardioid or period-2 bulb
+    uint64_t periodic = 0;   // orbit found to repeat
+    uint64_t escaped = 0;
+    uint64_t undecided = 0;  // still bounded at the iteration limit
+};
+
+// Classify the points (cx[i], cy[i]) as inside or outside the Mandelbrot set
+// in double precision, adding the outcomes to counts. Orbits are checked for
+// periodicity, so interior points rarely run to the iteration limit.
+using MembershipKernel = void (*)(const double* cx, const double* cy, int count, int maxIterations,
+                                  MembershipCounts& counts);
+
+MembershipKernel selectMembershipKernel(KernelVariant variant);
+
+// Radius, in pixels, of a disk around pixel position (x, y) of the view that
+// lies outside the Mandelbrot or Multibrot set of the given power: the
+// escape-time distance estimate, reduced by the Koebe quarter theorem to a
+// guaranteed lower bound. Iterates in double; 0 if the point has not
+// escaped after maxIterations.
+double exteriorDistance(const KernelView& view, int power, double x, double y, int maxIterations);
+
+// Iterate a single point in fixed point, appending every z (as re, im
+// doubles) to orbit. Serves as a reference orbit source that avoids a
+// general arbitrary-precision library at moderate depths. Returns the
+// smooth iteration count or kInteriorIteration.
+template <int Limbs>
+float fixedPointOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, int maxIterations,
+                      std::vector<double>& orbit);
+
+// Resumable form of fixedPointOrbit for orbits computed in chunks: continues
+// from z = (zx, zy), appending points until orbit holds `until` of them or z
+// escapes, and leaves the next z in (zx, zy). Returns true once z has escaped.
+template <int Limbs>
+bool extendFixedPointOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, FixedPoint<Limbs>& zx,
+                           FixedPoint<Limbs>& zy, int until, std::vector<double>& orbit);
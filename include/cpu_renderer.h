@@ -0,0 +1,286 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_kernels.h"
+#include "memory_placement.h"
+#include "reference_orbit.h"
+
+// Largest supported tile edge, in pixels
+const int kMaxTileSize = 4096;
+
+// CPU engine configuration
+struct CpuRenderSettings {
+    int threadCount = 0;     // 0 = one worker per hardware thread
+    int tileSize = 64;       // square tiles, in pixels
+    bool numaAware = true;   // pin workers and place each node's tiles in local memory
+    bool hugePages = true;   // back the iteration buffer with huge pages when possible
+    KernelVariant kernel = bestKernelVariant();
+    CpuPrecision precision = CpuPrecision::Auto;
+    bool cardioidCheck = true;   // skip iterating main cardioid and bulb points (Mandelbrot only)
+    bool smoothColoring = true;  // continuous iteration counts rather than whole iterations
+    bool rebasing = true;        // perturbation: rebase deltas rather than add references for glitches
+    bool costScheduling = true;  // dispatch tiles most expensive first, by a low-resolution estimate
+    bool tileBudgets = true;     // per-tile iteration caps, raised only while a tile's edge is unresolved
+    double interiorThreshold = 1e-3;  // |dz/dz1| below which a bounded orbit is interior; 0 = off
+    bool distanceFill = true;    // interpolate areas a distance estimate proves exterior (Mandelbrot, Multibrot)
+    size_t orbitMemoryBudget = kDefaultOrbitMemory;  // reference orbit bytes kept in memory
+    int referenceTeamLimbs = kDefaultTeamLimbs;  // share reference steps from this many limbs; 0 = never
+};
+
+// View to render, in the same coordinate convention as fragment.glsl
+struct CpuView {
+    double offsetX = 0.0;
+    double offsetY = 0.0;
+    double offsetXLo = 0.0;  // low-order parts of the offset, used by the double-double kernel
+    double offsetYLo = 0.0;
+    std::string offsetXDigits;  // full decimal offset, if known, for the fixed-point kernels
+    std::string offsetYDigits;
+    double zoom = 1.0;
+    int width = 0;
+    int height = 0;
+    int maxIterations = 100;
+    Formula formula = Formula::Mandelbrot;
+    bool julia = false;  // render the Julia set of c = (juliaX, juliaY) instead
+    double juliaX = 0.0;
+    double juliaY = 0.0;
+};
+
+// Timings and placement details of the last render
+struct CpuRenderStats {
+    double allocateSeconds = 0.0;
+    double firstTouchSeconds = 0.0;
+    double renderSeconds = 0.0;
+    int workerCount = 0;
+    int nodeCount = 0;
+    int pinnedWorkers = 0;
+    std::string pageMode = "none";
+    CpuPrecision precision = CpuPrecision::Double;
+    int referenceOrbits = 0;        // perturbation only
+    double referenceSeconds = 0.0;
+    std::string referenceStorage = "double";  // as OrbitStore::storageName()
+    int glitchedPixels = 0;         // left unrepaired when the reference limit was reached
+    double estimateSeconds = 0.0;   // cost pre-pass, when cost scheduling is on
+    double tailSeconds = 0.0;       // first worker out of work to the last one finishing, over all passes
+    int workItems = 0;              // tiles and subtiles dispatched per pass
+    int reducedItems = 0;           // work items finished below the full iteration cap
+    int64_t derivativeInterior = 0;  // pixels the interior check stopped before the cap
+    int64_t filledPixels = 0;        // interpolated inside exterior disks rather than iterated
+    int64_t distanceEstimates = 0;
+};
+
+// Rectangle [x0, x1) x [y0, y1) of the iteration buffer
+struct TileRect {
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+};
+
+// Lock-free multi-producer single-consumer queue of finished tiles. Workers
+// push a tile as soon as its pixels are written; the consumer drains
+// everything pushed so far in one atomic exchange. Each tile has a
+// preallocated node, so pushing never allocates. A tile pushed again before
+// it is drained (a later glitch pass) is queued once, and the consumer reads
+// its pixels after draining, so it sees the latest values. Each node also
+// counts its pushes; drain reads the count after clearing the queued flag,
+// so a push that raced with the clear and found the flag still set has its
+// pixels seen all the same.
+class TileQueue {
+public:
+    TileQueue() {}
+    TileQueue(const TileQueue&) = delete;
+    TileQueue& operator=(const TileQueue&) = delete;
+
+    // Size for a render of tileCount tiles and drop anything queued; only
+    // while no render is pushing
+    void reset(int tileCount);
+    void push(int tileIndex, const TileRect& rect);
+    // Append the tiles pushed since the last drain, oldest first
+    void drain(std::vector<TileRect>& tiles);
+
+private:
+    struct Node {
+        TileRect rect;
+        Node* next = nullptr;
+        std::atomic<bool> queued{false};
+        std::atomic<uint32_t> pushes{0};  // every push, queued or not
+    };
+    std::unique_ptr<Node[]> nodes;
+    int nodeCount = 0;
+    std::atomic<Node*> head{nullptr};
+    std::vector<Node*> drained;
+};
+
+// Optional hooks of a render that is displayed while it progresses
+struct RenderProgress {
+    TileQueue* completedTiles = nullptr;        // receives every tile as it is finished
+    const std::atomic<bool>* cancel = nullptr;  // abandons the render when set
+};
+
+// Multithreaded tile renderer producing a smooth iteration count per pixel.
+// Rows are stored bottom-up so the buffer lines up with gl_FragCoord.
+//
+// With NUMA placement enabled the image is split into horizontal bands, one
+// per memory node, sized by the number of workers on that node. Workers are
+// pinned to CPUs of their node, fault in their band's pages themselves and
+// render tiles from their own band first, stealing from other bands only
+// once theirs is exhausted.
+//
+// With cost scheduling each render starts with a pass at 1/8 resolution
+// whose iteration counts estimate what every tile will cost. Each band then
+// hands out its tiles most expensive first, and tiles predicted to take a
+// large share of the frame are split into quadrants, so the last tiles to
+// start are cheap ones and the workers finish close together. Without it
+// tiles go in row order.
+//
+// With tile budgets each work item is first iterated along its edge, from a
+// low cap that is raised until every edge pixel escapes or the view's cap is
+// reached, and its inside is then iterated to that cap only. The cost
+// pre-pass seeds the starting cap: above the slowest escape it saw in the
+// item, or the full cap straight away where it saw bounded points. The escape time
+// follows the Green's function of the set, which is harmonic outside it, so
+// in an area free of the set the slowest escapes lie on the edge: pixels
+// still bounded inside a resolved edge are interior or too small to matter.
+//
+// With distance filling each work item first has the exterior distance
+// estimated at its centre. When the disk that estimate guarantees free of
+// the set covers the item, only its corners are iterated and the smooth
+// count is interpolated between them; otherwise the item is split into
+// quadrants that try again, down to kMinFillSize, while the disk still
+// covers a fair part of them. Only double-precision Mandelbrot and
+// Multibrot views qualify: the estimate needs a holomorphic map in c and
+// coordinates as exact as the kernels'.
+//
+// Perturbation renders compute one reference orbit at the view centre, in
+// as many limbs as the view needs; wide ones share their squarings with
+// the workers, which have nothing else to do until the orbit is done. With
+// rebasing the reference serves every pixel; without, pixels flagged as glitched are
+// redone in further passes against a reference at the centre of the largest
+// remaining glitch, up to kMaxReferences references.
+class CpuRenderer {
+public:
+    static const int kMaxReferences = 64;
+
+    explicit CpuRenderer(const CpuRenderSettings& settings = CpuRenderSettings());
+    ~CpuRenderer();
+
+    CpuRenderer(const CpuRenderer&) = delete;
+    CpuRenderer& operator=(const CpuRenderer&) = delete;
+
+    // Returns false on failure (with a message on cerr) or when cancelled
+    bool render(const CpuView& view, const RenderProgress& progress = RenderProgress());
+    // Number of tiles a render of this size is split into, and so the
+    // indices a TileQueue receives
+    int tileCount(int width, int height) const;
+
+    const float* iterations() const { return static_cast<const float*>(buffer.data()); }
+    int width() const { return bufferWidth; }
+    int height() const { return bufferHeight; }
+    const CpuRenderSettings& settings() const { return config; }
+    const CpuRenderStats& stats() const { return lastStats; }
+
+private:
+    struct Worker {
+        std::thread thread;
+        int node = 0;
+        int cpu = -1;
+    };
+
+    // A tile or, for expensive tiles, part of one
+    struct WorkItem {
+        TileRect rect;
+        int tile = 0;  // index of the whole tile
+        double cost = 0.0;
+        int budget = 0;  // starting iteration cap with tile budgets
+    };
+
+    struct Band {
+        int firstTileRow = 0;
+        int endTileRow = 0;
+        std::vector<WorkItem> items;  // in dispatch order
+        std::atomic<int> nextItem{0};
+    };
+
+    bool ensureBuffer(int width, int height);
+    void runOnWorkers(const std::function<void(int)>& job);
+    void workerLoop(int index);
+    TileRect tileRect(int tile) const;
+    void planTiles(const KernelView& view, BlockKernel kernel);
+    bool nextItem(int node, const WorkItem*& item);
+    void renderItem(const KernelView& view, BlockKernel kernel, const WorkItem& item);
+    void renderPart(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget);
+    void renderByDistance(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget);
+    bool fillFromCorners(const KernelView& view, BlockKernel kernel, const TileRect& rect);
+    void renderWithBudget(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget);
+    void renderTiles(const KernelView& view, BlockKernel kernel);
+    void renderPerturbed(KernelView& view, BlockKernel kernel, int referenceLimbs, const ReferenceCoordinate& centreX,
+                         const ReferenceCoordinate& centreY);
+    bool findGlitchCentre(int& x, int& y);
+    bool cancelled() const { return progress.cancel && progress.cancel->load(std::memory_order_relaxed); }
+
+    CpuRenderSettings config;
+    NumaTopology topology;
+    bool placeByNode = false;
+
+    std::vector<Worker> workers;
+    std::vector<Band> bands;
+    int tilesX = 0;
+    bool planned = false;           // bands hold this render's work items
+    bool cardioidResolved = false;  // the kernel skips main cardioid and bulb points
+    bool distanceFilling = false;   // this render fills exterior disks
+    int fillPower = 2;              // power of the formula distance estimates iterate
+    std::vector<float> costImage;   // pre-pass iteration values
+    std::vector<int> partsPerTile;
+    std::unique_ptr<std::atomic<int>[]> partsLeft;  // work items of each tile still to finish
+    std::atomic<int> reducedItems{0};
+    std::atomic<int64_t> interiorCaught{0};
+    std::atomic<int64_t> filledPixels{0};
+    std::atomic<int64_t> distanceEstimates{0};
+
+    LargeBuffer buffer;
+    int bufferWidth = 0;
+    int bufferHeight = 0;
+    CpuRenderStats lastStats;
+    OrbitStore reference;
+    RenderProgress progress;  // of the render in flight
+
+    // Worker pool hand-off
+    std::mutex poolMutex;
+    std::condition_variable poolWake;
+    std::condition_variable poolDone;
+    std::function<void(int)> currentJob;
+    uint64_t jobGeneration = 0;
+    int pendingWorkers = 0;
+    std::atomic<int> pinnedCount{0};
+    bool stopping = false;
+};
+
+// Fraction bits needed to keep a view's neighbouring pixels distinct
+double requiredPrecisionBits(const CpuView& view);
+
+// Resolve Auto to the precision a view needs. Mandelbrot views beyond
+// double-double use perturbation, other formulas fixed point.
+CpuPrecision selectCpuPrecision(const CpuView& view, CpuPrecision requested);
+
+// Iteration cap after zoom-based scaling, mirroring fragment.glsl
+int adaptiveIterationCount(int maxIterations, double zoom);
+
+// Map iteration values to 8-bit RGB with the shader's palette blend
+void colorizeIterations(const float* iterations, int width, int height, int maxIterations,
+                        const float color[3], const float colorBg[3], std::vector<uint8_t>& rgb);
+
+// The same for one tile, into an RGBA image of the buffer's size
+void colorizeTile(const float* iterations, int width, const TileRect& rect, int maxIterations,
+                  const float color[3], const float colorBg[3], uint8_t* rgba);
+
+// Write an RGB image (rows bottom-up, as produced above) to a binary PPM file
+bool writePpm(const std::string& path, const std::vector<uint8_t>& rgb, int width, int height);
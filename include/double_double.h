@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+// Unevaluated sum of two doubles (hi + lo, |lo| <= ulp(hi) / 2), giving
+// about 106 bits of mantissa. Products use the FMA two-product, so they are
+// only fast on CPUs with hardware FMA.
+struct DoubleDouble {
+    double hi = 0.0;
+    double lo = 0.0;
+
+    DoubleDouble() = default;
+    DoubleDouble(double value) : hi(value), lo(0.0) {}
+    DoubleDouble(double high, double low) : hi(high), lo(low) {}
+};
+
+// Error-free transformations
+inline DoubleDouble quickTwoSum(double a, double b) {
+    double s = a + b;
+    return DoubleDouble(s, b - (s - a));
+}
+
+inline DoubleDouble twoSum(double a, double b) {
+    double s = a + b;
+    double bb = s - a;
+    return DoubleDouble(s, (a - (s - bb)) + (b - bb));
+}
+
+inline DoubleDouble twoProduct(double a, double b) {
+    double p = a * b;
+    return DoubleDouble(p, std::fma(a, b, -p));
+}
+
+inline DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b) {
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    DoubleDouble t = twoSum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = quickTwoSum(s.hi, s.lo);
+    s.lo += t.lo;
+    return quickTwoSum(s.hi, s.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a) {
+    return DoubleDouble(-a.hi, -a.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b) {
+    return a + (-b);
+}
+
+inline DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b) {
+    DoubleDouble p = twoProduct(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+// Cheaper addition used by the iteration kernels: the error is bounded by
+// the operand magnitudes rather than the result, which is harmless while
+// |z| stays below the escape radius
+inline DoubleDouble sloppyAdd(const DoubleDouble& a, const DoubleDouble& b) {
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    return quickTwoSum(s.hi, s.lo + a.lo + b.lo);
+}
+
+inline DoubleDouble square(const DoubleDouble& a) {
+    DoubleDouble p = twoProduct(a.hi, a.hi);
+    p.lo += 2.0 * a.hi * a.lo;
+    return quickTwoSum(p.hi, p.lo);
+}
+
+inline DoubleDouble operator/(const DoubleDouble& a, double b) {
+    double q1 = a.hi / b;
+    DoubleDouble p = twoProduct(q1, b);
+    DoubleDouble r = twoSum(a.hi, -p.hi);
+    r.lo += a.lo - p.lo;
+    double q2 = (r.hi + r.lo) / b;
+    return quickTwoSum(q1, q2);
+}
+
+// Parse a decimal number ("-0.74364388703715870475219150611477", "1.5e-28")
+// keeping all the digits double-double can hold. Returns false on malformed input.
+inline bool parseDoubleDouble(const std::string& text, DoubleDouble& value) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
+    }
+
+    DoubleDouble result;
+    int exponent = 0;
+    bool seenDigit = false;
+    bool seenPoint = false;
+    for (; pos < text.size(); pos++) {
+        char ch = text[pos];
+        if (ch >= '0' && ch <= '9') {
+            result = result * DoubleDouble(10.0) + DoubleDouble(ch - '0');
+            if (seenPoint) exponent--;
+            seenDigit = true;
+        } else if (ch == '.' && !seenPoint) {
+            seenPoint = true;
+        } else {
+            break;
+        }
+    }
+    if (!seenDigit) return false;
+
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        const char* start = text.c_str() + pos + 1;
+        char* end = nullptr;
+        long power = std::strtol(start, &end, 10);
+        if (end == start || power < -400 || power > 400) return false;
+        exponent += static_cast<int>(power);
+        pos = end - text.c_str();
+    }
+    if (pos != text.size()) return false;
+
+    for (; exponent > 0; exponent--) result = result * DoubleDouble(10.0);
+    for (; exponent < 0; exponent++) result = result / 10.0;
+
+    value = negative ? -result : result;
+    return true;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#if !defined(__SIZEOF_INT128__) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Signed fixed-point number of Limbs 64-bit words in two's complement, with
+// 8 integer bits (range [-128, 128)) and 64 * Limbs - 8 fraction bits:
+// 120 bits (~1e-36) for 128-bit, 184 bits (~1e-55) for 192-bit and 248 bits
+// (~1e-74) for 256-bit numbers; reference orbits use wider ones as well.
+// Everything is built on the 64x64 -> 128-bit integer multiply; the CPU
+// kernels compile the iteration loop for BMI2/ADX on processors that have
+// them, which turns it into mulx chains.
+template <int Limbs>
+struct FixedPoint {
+    static_assert(Limbs >= 2, "FixedPoint needs at least two limbs");
+
+    static constexpr int kIntegerBits = 8;
+    static constexpr int kFractionBits = 64 * Limbs - kIntegerBits;
+
+    uint64_t limb[Limbs] = {};  // least significant first
+
+    bool isNegative() const { return (limb[Limbs - 1] >> 63) != 0; }
+
+    // Integer part, rounded towards minus infinity
+    int integerPart() const { return static_cast<int>(static_cast<int64_t>(limb[Limbs - 1]) >> (64 - kIntegerBits)); }
+
+    static FixedPoint fromDouble(double value);
+    double toDouble() const;
+
+    // Parse a decimal number, keeping every digit the format can hold
+    static bool parse(const std::string& text, FixedPoint& value);
+
+    // Decimal form with as many fraction digits as the format resolves and
+    // trailing zeros dropped; parse() reads it back to within one unit in
+    // the last place
+    std::string toString() const;
+};
+
+namespace fixed_point_detail {
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
+// Full 64x64 -> 128-bit product
+inline void multiplyWide(uint64_t a, uint64_t b, uint64_t& low, uint64_t& high) {
+#if defined(__SIZEOF_INT128__)
+    uint128 product = static_cast<uint128>(a) * b;
+    low = static_cast<uint64_t>(product);
+    high = static_cast<uint64_t>(product >> 64);
+#else
+    low = _umul128(a, b, &high);
+#endif
+}
+
+template <int Limbs>
+inline void negateInPlace(uint64_t (&limb)[Limbs]) {
+    uint64_t carry = 1;
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t inverted = ~limb[i];
+        limb[i] = inverted + carry;
+        carry = limb[i] < inverted ? 1 : 0;
+    }
+}
+
+// Divide a non-negative value by a small integer in place
+template <int Limbs>
+inline void divideSmall(uint64_t (&limb)[Limbs], uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (int i = Limbs - 1; i >= 0; i--) {
+        // Two 32-bit halves keep the partial dividend within 64 bits
+        uint64_t high = (remainder << 32) | (limb[i] >> 32);
+        uint64_t highQuotient = high / divisor;
+        remainder = high % divisor;
+        uint64_t low = (remainder << 32) | (limb[i] & 0xFFFFFFFFu);
+        uint64_t lowQuotient = low / divisor;
+        remainder = low % divisor;
+        limb[i] = (highQuotient << 32) | lowQuotient;
+    }
+}
+
+template <int Limbs>
+inline void multiplySmall(uint64_t (&limb)[Limbs], uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t low, high;
+        multiplyWide(limb[i], factor, low, high);
+        low += carry;
+        carry = high + (low < carry ? 1 : 0);
+        limb[i] = low;
+    }
+}
+
+} // namespace fixed_point_detail
+
+template <int Limbs>
+inline FixedPoint<Limbs> operator+(const FixedPoint<Limbs>& a, const FixedPoint<Limbs>& b) {
+    FixedPoint<Limbs> result;
+    uint64_t carry = 0;
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t sum = a.limb[i] + carry;
+        uint64_t carryOut = sum < carry ? 1 : 0;
+        result.limb[i] = sum + b.limb[i];
+        carry = carryOut + (result.limb[i] < sum ? 1 : 0);
+    }
+    return result;
+}
+
+template <int Limbs>
+inline FixedPoint<Limbs> operator-(const FixedPoint<Limbs>& a) {
+    FixedPoint<Limbs> result = a;
+    fixed_point_detail::negateInPlace(result.limb);
+    return result;
+}
+
+template <int Limbs>
+inline FixedPoint<Limbs> operator-(const FixedPoint<Limbs>& a, const FixedPoint<Limbs>& b) {
+    FixedPoint<Limbs> result;
+    uint64_t borrow = 0;
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t difference = a.limb[i] - borrow;
+        uint64_t borrowOut = a.limb[i] < borrow ? 1 : 0;
+        result.limb[i] = difference - b.limb[i];
+        borrow = borrowOut + (difference < b.limb[i] ? 1 : 0);
+    }
+    return result;
+}
+
+// Multiply by two (exact unless it overflows the integer bits)
+template <int Limbs>
+inline FixedPoint<Limbs> twice(const FixedPoint<Limbs>& a) {
+    FixedPoint<Limbs> result;
+    for (int i = Limbs - 1; i > 0; i--) {
+        result.limb[i] = (a.limb[i] << 1) | (a.limb[i - 1] >> 63);
+    }
+    result.limb[0] = a.limb[0] << 1;
+    return result;
+}
+
+// Product truncated to the fixed-point format. Magnitudes are multiplied
+// into a full 2 * Limbs product whose middle words form the result.
+template <int Limbs>
+inline FixedPoint<Limbs> operator*(const FixedPoint<Limbs>& a, const FixedPoint<Limbs>& b) {
+    using namespace fixed_point_detail;
+
+    bool negative = a.isNegative() != b.isNegative();
+    uint64_t x[Limbs];
+    uint64_t y[Limbs];
+    for (int i = 0; i < Limbs; i++) {
+        x[i] = a.limb[i];
+        y[i] = b.limb[i];
+    }
+    if (a.isNegative()) negateInPlace(x);
+    if (b.isNegative()) negateInPlace(y);
+
+    uint64_t product[2 * Limbs] = {};
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < Limbs; j++) {
+            uint64_t low, high;
+            multiplyWide(x[i], y[j], low, high);
+            low += carry;
+            high += low < carry ? 1 : 0;
+            uint64_t sum = product[i + j] + low;
+            high += sum < low ? 1 : 0;
+            product[i + j] = sum;
+            carry = high;
+        }
+        product[i + Limbs] = carry;
+    }
+
+    // Drop kFractionBits low bits: shift right by (Limbs - 1) words plus 56 bits
+    FixedPoint<Limbs> result;
+    const int shift = 64 - FixedPoint<Limbs>::kIntegerBits;
+    for (int i = 0; i < Limbs; i++) {
+        uint64_t low = product[Limbs - 1 + i] >> shift;
+        uint64_t high = product[Limbs + i] << (64 - shift);
+        result.limb[i] = low | high;
+    }
+    if (negative) negateInPlace(result.limb);
+    return result;
+}
+
+template <int Limbs>
+inline FixedPoint<Limbs> square(const FixedPoint<Limbs>& a) {
+    return a * a;
+}
+
+// Drop the low limbs of a wider number; both formats share the integer bits,
+// so this truncates the fraction towards minus infinity
+template <int Narrow, int Wide>
+inline FixedPoint<Narrow> narrowFixedPoint(const FixedPoint<Wide>& value) {
+    static_assert(Narrow <= Wide, "narrowFixedPoint cannot widen");
+    FixedPoint<Narrow> result;
+    for (int i = 0; i < Narrow; i++) result.limb[i] = value.limb[Wide - Narrow + i];
+    return result;
+}
+
+// Append zero low limbs; exact
+template <int Wide, int Narrow>
+inline FixedPoint<Wide> widenFixedPoint(const FixedPoint<Narrow>& value) {
+    static_assert(Narrow <= Wide, "widenFixedPoint cannot narrow");
+    FixedPoint<Wide> result;
+    for (int i = 0; i < Narrow; i++) result.limb[Wide - Narrow + i] = value.limb[i];
+    return result;
+}
+
+template <int Limbs>
+FixedPoint<Limbs> FixedPoint<Limbs>::fromDouble(double value) {
+    FixedPoint result;
+    if (value == 0.0 || !std::isfinite(value)) return result;
+
+    int exponent;
+    double mantissa = std::frexp(std::fabs(value), &exponent);
+    uint64_t bits = static_cast<uint64_t>(std::ldexp(mantissa, 53));
+
+    // value = bits * 2^(exponent - 53), stored scaled by 2^kFractionBits
+    int shift = exponent - 53 + kFractionBits;
+    if (shift >= 0) {
+        int word = shift / 64;
+        int bit = shift % 64;
+        if (word < Limbs) result.limb[word] = bits << bit;
+        if (bit != 0 && word + 1 < Limbs) result.limb[word + 1] = bits >> (64 - bit);
+    } else if (shift > -64) {
+        result.limb[0] = bits >> -shift;
+    }
+    if (value < 0.0) fixed_point_detail::negateInPlace(result.limb);
+    return result;
+}
+
+template <int Limbs>
+double FixedPoint<Limbs>::toDouble() const {
+    // Weights of the limbs; scaling by a power of two is exact, so this is
+    // the same as ldexp without a library call per limb
+    static const struct Weights {
+        double weight[Limbs];
+        Weights() {
+            for (int i = 0; i < Limbs; i++) weight[i] = std::ldexp(1.0, 64 * i - kFractionBits);
+        }
+    } weights;
+
+    FixedPoint magnitude = isNegative() ? -*this : *this;
+    double value = 0.0;
+    for (int i = Limbs - 1; i >= 0; i--) {
+        value += static_cast<double>(magnitude.limb[i]) * weights.weight[i];
+    }
+    return isNegative() ? -value : value;
+}
+
+template <int Limbs>
+bool FixedPoint<Limbs>::parse(const std::string& text, FixedPoint& value) {
+    using namespace fixed_point_detail;
+
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
+    }
+
+    size_t integerStart = pos;
+    while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+    std::string integerDigits = text.substr(integerStart, pos - integerStart);
+    std::string fractionDigits;
+    if (pos < text.size() && text[pos] == '.') {
+        size_t fractionStart = ++pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+        fractionDigits = text.substr(fractionStart, pos - fractionStart);
+    }
+    if (integerDigits.empty() && fractionDigits.empty()) return false;
+
+    long exponent = 0;
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        const char* start = text.c_str() + pos + 1;
+        char* end = nullptr;
+        exponent = std::strtol(start, &end, 10);
+        if (end == start || exponent < -400 || exponent > 400) return false;
+        pos = end - text.c_str();
+    }
+    if (pos != text.size()) return false;
+
+    // Fraction by Horner's scheme from the last digit: f = (d + f) / 10
+    FixedPoint result;
+    const uint64_t unit = uint64_t(1) << (64 - kIntegerBits);
+    for (size_t i = fractionDigits.size(); i-- > 0;) {
+        result.limb[Limbs - 1] += static_cast<uint64_t>(fractionDigits[i] - '0') * unit;
+        divideSmall(result.limb, 10);
+    }
+    int integerValue = 0;
+    for (char digit : integerDigits) {
+        integerValue = integerValue * 10 + (digit - '0');
+        if (integerValue >= (1 << (kIntegerBits - 1))) return false;
+    }
+    result.limb[Limbs - 1] += static_cast<uint64_t>(integerValue) * unit;
+
+    for (; exponent < 0; exponent++) divideSmall(result.limb, 10);
+    for (; exponent > 0; exponent--) {
+        if (result.integerPart() >= (1 << (kIntegerBits - 1)) / 10) return false;
+        multiplySmall(result.limb, 10);
+    }
+
+    value = negative ? -result : result;
+    return true;
+}
+
+template <int Limbs>
+std::string FixedPoint<Limbs>::toString() const {
+    using namespace fixed_point_detail;
+
+    FixedPoint magnitude = isNegative() ? -*this : *this;
+    std::string text = isNegative() ? "-" : "";
+    text += std::to_string(magnitude.integerPart());
+    text += '.';
+
+    // Fraction digits by repeated multiplication: each one surfaces in the integer bits.
+    // One more digit than the fraction bits resolve, so the round trip is exact.
+    const int shift = 64 - kIntegerBits;
+    const uint64_t fractionMask = (uint64_t(1) << shift) - 1;
+    const int digits = kFractionBits * 30103 / 100000 + 2;
+    magnitude.limb[Limbs - 1] &= fractionMask;
+    for (int i = 0; i < digits; i++) {
+        multiplySmall(magnitude.limb, 10);
+        text += static_cast<char>('0' + (magnitude.limb[Limbs - 1] >> shift));
+        magnitude.limb[Limbs - 1] &= fractionMask;
+    }
+    while (text.back() == '0') text.pop_back();
+    if (text.back() == '.') text += '0';
+    return text;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+// Iterated maps z -> g(z)^power + c, where g optionally conjugates z
+// (Tricorn) or takes the absolute value of both components (Burning Ship).
+// Each description is instantiated as a CPU kernel (cpu_kernels.cpp) and
+// turned into a GLSL step function for fragment.glsl, so a new member of
+// the family only needs an entry here.
+enum class Formula {
+    Mandelbrot,
+    Multibrot3,
+    Multibrot4,
+    Tricorn,
+    BurningShip,
+};
+const int kFormulaCount = 5;
+
+struct FormulaDescription {
+    const char* name;
+    int power;
+    bool conjugate;  // iterate conj(z)
+    bool absolute;   // iterate |Re z| + i |Im z|
+};
+
+inline constexpr FormulaDescription kFormulaDescriptions[kFormulaCount] = {
+    {"mandelbrot", 2, false, false},
+    {"multibrot3", 3, false, false},
+    {"multibrot4", 4, false, false},
+    {"tricorn", 2, true, false},
+    {"burningship", 2, false, true},
+};
+
+constexpr const FormulaDescription& describeFormula(Formula formula) {
+    return kFormulaDescriptions[static_cast<int>(formula)];
+}
+
+const char* formulaName(Formula formula);
+bool parseFormula(const std::string& name, Formula& formula);
+
+// GLSL function vec2 formulaStep(vec2 z, vec2 c) performing one iteration
+std::string formulaGlsl(Formula formula);
+
+// Replace the default formulaStep() between the "// @formula" markers of a
+// fragment shader source. Sources without the markers are left unchanged.
+void insertFormulaGlsl(std::string& source, Formula formula);
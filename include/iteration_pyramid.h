@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu_renderer.h"
+#include "double_double.h"
+
+// Iteration value of a pyramid cell nothing has been rendered into
+const float kUnknownIteration = -3.0f;
+
+// Cache of rendered iteration values at every scale, for showing views
+// that are not rendered yet.
+//
+// Level 0 has the finest cells; each level above has cells twice as large,
+// all aligned to one anchor point so a cell covers exactly four cells of the
+// level below. Rendered pixels are resampled into the level whose cell size
+// is nearest to the pixel spacing, and every level above it is rebuilt from
+// the level below by averaging 2x2 blocks, so a region seen once in detail
+// is available at every coarser scale without iterating it again. Levels are
+// sparse maps of square tiles of cells.
+//
+// Zooming past either end of the levels shifts them: the levels that fall
+// off are dropped and the anchor's cell size halves or doubles. Offsets are
+// taken relative to the anchor in double-double, so the pyramid serves views
+// down to the double-double kernels' depth.
+class IterationPyramid {
+public:
+    static const int kLevels = 24;
+    static const int kTileShift = 6;
+    static const int kTileCells = 1 << kTileShift;  // cells along a tile edge
+    static const size_t kMaxTiles = 4096;  // 64 MB of cells
+
+    // Whether the pyramid can hold pixels of this view
+    static bool accepts(const CpuView& view);
+
+    // Add the pixels of rect from a render of view (a width-wide buffer with
+    // rows bottom-up). A view of another formula or Julia set starts over.
+    void insert(const CpuView& view, const float* iterations, const TileRect& rect);
+
+    // Write the best cached value for every pixel of view into iterations,
+    // falling back to a few coarser levels where the nearest one has none.
+    // Pixels nothing covers are left alone. Returns the number of pixels
+    // written.
+    size_t sample(const CpuView& view, float* iterations) const;
+
+    // Changes whenever cells are added or dropped
+    uint64_t revision() const { return changes; }
+
+private:
+    using Tile = std::vector<float>;
+    using Level = std::unordered_map<uint64_t, Tile>;
+
+    // Position of a view relative to the anchor, in the complex plane
+    struct Placement {
+        double centreX = 0.0;
+        double centreY = 0.0;
+        double spacing = 0.0;  // pixel size
+    };
+
+    bool sameFractal(const CpuView& view) const;
+    Placement place(const CpuView& view) const;
+    void reset(const CpuView& view);
+    void shift(int levelsUp);
+    void evict(int keepFrom);
+    Tile* findTile(int level, int64_t tileX, int64_t tileY, bool create);
+    void rebuildAbove(int level, int64_t i0, int64_t j0, int64_t i1, int64_t j1);
+
+    std::vector<Level> levels = std::vector<Level>(kLevels);
+    size_t tileCount = 0;
+    uint64_t changes = 0;
+    bool empty = true;
+    DoubleDouble anchorX;
+    DoubleDouble anchorY;
+    double baseSpacing = 0.0;  // cell size of level 0
+    Formula formula = Formula::Mandelbrot;
+    bool julia = false;
+    double juliaX = 0.0;
+    double juliaY = 0.0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// NUMA topology of the machine: the CPUs belonging to each memory node.
+// On systems without NUMA information this is a single node holding every CPU.
+struct NumaTopology {
+    std::vector<std::vector<int>> nodeCpus;
+
+    static NumaTopology detect();
+
+    int nodeCount() const { return static_cast<int>(nodeCpus.size()); }
+
+    // (node, cpu) pairs taking CPUs from each node in turn, so any number of
+    // workers assigned from the front spreads evenly across nodes
+    std::vector<std::pair<int, int>> interleavedCpus() const;
+};
+
+// Pin the calling thread to a single CPU. Returns false if unsupported or refused.
+bool pinCurrentThreadToCpu(int cpu);
+
+// Page-aligned buffer for large renders. When huge pages are requested the
+// buffer is backed by MAP_HUGETLB pages if the system has a reserved pool,
+// otherwise by transparent huge pages via madvise. Pages are left untouched
+// so that the first write decides which NUMA node they live on.
+class LargeBuffer {
+public:
+    LargeBuffer() = default;
+    ~LargeBuffer();
+
+    LargeBuffer(const LargeBuffer&) = delete;
+    LargeBuffer& operator=(const LargeBuffer&) = delete;
+
+    bool allocate(size_t bytes, bool useHugePages);
+    void release();
+
+    void* data() const { return ptr; }
+    size_t size() const { return bytes; }
+
+    // "hugetlb", "thp" or "none", for reporting
+    const std::string& pageMode() const { return mode; }
+
+private:
+    void* ptr = nullptr;
+    size_t bytes = 0;
+    size_t mappedBytes = 0;
+    void* mappedPtr = nullptr;
+    std::string mode = "none";
+};
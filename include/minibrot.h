@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+
+// Limits of a minibrot search
+struct MinibrotSearch {
+    int maxPeriod = 100000;   // longest orbit tried for the period
+    int maxNewtonSteps = 64;
+};
+
+// Nucleus of a minibrot: the centre of its main cardioid, whose critical
+// orbit is exactly periodic
+struct Minibrot {
+    int period = 0;
+    std::string realDigits;  // full decimal nucleus, as accepted by --view
+    std::string imagDigits;
+    double real = 0.0;       // the same as double-double
+    double realLo = 0.0;
+    double imag = 0.0;
+    double imagLo = 0.0;
+    double size = 0.0;       // scale of the copy relative to the whole set
+    double angle = 0.0;      // its rotation, in radians
+    int newtonSteps = 0;
+};
+
+// A view zoom (half height) of this many sizes shows the whole copy in any rotation
+const double kMinibrotFraming = 2.25;
+
+// Find the minibrot nearest to a point of the z^2 + c Mandelbrot set.
+//
+// The period comes from the ball method: the orbit of the centre is iterated
+// with its derivative dz/dc, and the first n at which the disc of the given
+// radius around the centre maps onto a region containing 0 (|z_n| <
+// radius * |dz_n|, to first order) is the lowest period of a nucleus in the
+// disc. If the orbit escapes or no such n exists within the limit, the atom
+// domain period is used instead: the n at which |z_n| was smallest.
+//
+// The nucleus is then solved with Newton's method on z_p(c) = 0 in fixed
+// point, taking the derivative in double precision since only the step's
+// leading digits matter. Each step roughly doubles the correct digits, so it
+// converges to the format's resolution in a handful of steps. The format is
+// the narrowest reference format of at least 4 limbs that resolves the
+// radius; a copy too small for it to resolve is searched again in the next
+// wider one. The widest is 16 limbs: since the steps are doubles, nuclei
+// deeper than about 1e-300 do not converge. The size estimate follows the
+// renormalisation argument: near the nucleus the set is a copy of the whole
+// one scaled by 1 / (beta * lambda^2), where lambda is the product of the
+// multipliers 2 z_k and beta the sum of their partial product inverses.
+//
+// The nucleus makes the ideal reference orbit for perturbation rendering:
+// it is exactly periodic, so it never escapes and needs only p iterations.
+//
+// Returns false (with a message on cerr) if Newton's method does not converge.
+bool findMinibrot(const std::string& realDigits, const std::string& imagDigits, double radius,
+                  const MinibrotSearch& search, Minibrot& result);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fixed_point.h"
+
+// Widest reference format: 3576 fraction bits, enough for points resolved
+// to about 1e-1070. Past 4 limbs the formats are 8, 16, 32 and this many.
+const int kMaxReferenceLimbs = 56;
+using ReferenceCoordinate = FixedPoint<kMaxReferenceLimbs>;
+
+// High-precision orbit of one point, which perturbation kernels iterate
+// pixel deltas against. The GPU renderer's orbits are short and kept like
+// this; the CPU renderer's go to an OrbitStore (below).
+struct ReferenceOrbit {
+    ReferenceCoordinate cx;  // the reference point
+    ReferenceCoordinate cy;
+    std::vector<double> z;  // z_0 = 0, z_1, ... as (re, im) pairs, up to the escaping one
+    double seconds = 0.0;   // time taken to compute it
+
+    int length() const { return static_cast<int>(z.size() / 2); }
+};
+
+// Reference orbit bytes the CPU renderer keeps in memory by default
+const size_t kDefaultOrbitMemory = size_t(1) << 30;
+
+// Points of a CPU reference orbit, which can run to a billion iterations.
+// Orbits that fit the memory budget are kept as double pairs, 16 bytes per
+// point. Past it they are rounded to float pairs, half the size but less
+// accurate over long rebased orbits, and if those still do not fit they go
+// to an unlinked temporary file mapped into memory, which the OS pages in
+// as the kernels stream through it.
+class OrbitStore {
+public:
+    explicit OrbitStore(size_t memoryBudget = kDefaultOrbitMemory);
+    ~OrbitStore();
+
+    OrbitStore(const OrbitStore&) = delete;
+    OrbitStore& operator=(const OrbitStore&) = delete;
+
+    // Discard the points and prepare for an orbit of up to maxPoints
+    void reset(int maxPoints);
+    // Append count points given as (re, im) pairs
+    void append(const double* points, int count);
+
+    int length() const { return count; }
+    // The points as pairs; exactly one of these is non-null once points exist
+    const double* doublePoints() const { return compact ? nullptr : full.data(); }
+    const float* floatPoints() const { return !compact ? nullptr : mapping ? mapping : rounded.data(); }
+    // "double", "float" or "mapped float"
+    const char* storageName() const;
+
+private:
+    void compactPoints();
+    bool mapFile(size_t bytes);
+    void unmap();
+
+    size_t budget;
+    int capacity = 0;
+    int count = 0;
+    bool compact = false;
+    std::vector<double> full;
+    std::vector<float> rounded;
+    float* mapping = nullptr;
+    size_t mappedBytes = 0;
+};
+
+// Narrowest wide format whose steps are shared between threads by default
+const int kDefaultTeamLimbs = 16;
+
+// Threads a wide reference orbit shares its steps with. Each step squares
+// x, y and x + y, which are independent, so up to three threads take one
+// square each; with more, every square's rows are split between them too.
+// run starts job(0) ... job(threads - 1) concurrently and returns once all
+// have returned; left empty, threads are started for the orbit. Helpers
+// spin between steps, so threads must not exceed the hardware threads.
+// Formats narrower than minLimbs, or minLimbs 0, compute on the calling
+// thread.
+struct ReferenceTeam {
+    int threads = 1;
+    int minLimbs = kDefaultTeamLimbs;
+    std::function<void(const std::function<void(int)>&)> run;
+};
+
+// Fixed-point limbs (2, 3, 4, 8, 16, 32 or kMaxReferenceLimbs) that resolve
+// a point to the given number of fraction bits, or the widest format
+int referenceLimbs(double requiredBits);
+
+// Compute the orbit of (cx, cy) for up to maxIterations iterations into
+// orbit, with the arithmetic narrowed to the given number of limbs. Returns
+// the seconds taken.
+double computeReferenceOrbit(const ReferenceCoordinate& cx, const ReferenceCoordinate& cy, int limbs,
+                             int maxIterations, OrbitStore& orbit, const ReferenceTeam& team = ReferenceTeam());
+
+
+// Computes reference orbits on a background thread, publishing each in
+// chunks of kChunkIterations as they complete, so a renderer can start on
+// the early iterations while the rest is still being computed. Starting a
+// new orbit abandons the one in progress at its next chunk boundary.
+class ReferenceOrbitWorker {
+public:
+    static const int kChunkIterations = 1024;
+
+    ReferenceOrbitWorker();
+    ~ReferenceOrbitWorker();
+
+    ReferenceOrbitWorker(const ReferenceOrbitWorker&) = delete;
+    ReferenceOrbitWorker& operator=(const ReferenceOrbitWorker&) = delete;
+
+    void start(const ReferenceCoordinate& cx, const ReferenceCoordinate& cy, int limbs, int maxIterations);
+
+    // Bring orbit up to date with the current one: after a start() it is
+    // replaced, otherwise it gets the points published since the last call.
+    // Meant for a single consumer. Returns true once the orbit is complete,
+    // when orbit.seconds is set too.
+    bool collect(ReferenceOrbit& orbit);
+
+private:
+    void workerLoop();
+    template <int Limbs>
+    void compute(uint64_t job);
+
+    std::thread thread;
+    std::mutex stateMutex;
+    std::condition_variable stateWake;
+    uint64_t generation = 0;  // bumped by every start()
+    uint64_t collected = 0;   // generation the consumer's orbit belongs to
+    bool stopping = false;
+    int jobLimbs = 2;
+    int jobIterations = 0;
+    ReferenceOrbit published;  // the current orbit so far
+    bool complete = true;
+};
@@ -0,0 +1,17 @@
+#version 410 core
+
+in vec2 uv;
+out vec4 FragColor;
+
+uniform sampler2D density;  // orbit density per channel, one texel per window pixel
+uniform vec2 origin;        // window position of the drawn region's lower-left corner
+uniform vec3 scale;         // maps a high percentile of each channel's density to 1
+uniform float exposure;
+
+void main() {
+    vec3 value = texelFetch(density, ivec2(gl_FragCoord.xy - origin), 0).rgb * scale;
+
+    // Exponential tone map with display gamma, as toneMapBuddhabrot() on the CPU
+    vec3 exposed = 1.0 - exp(-exposure * value);
+    FragColor = vec4(pow(exposed, vec3(1.0 / 2.2)), 1.0);
+}
@@ -4,16 +4,32 @@ in vec2 uv;
 out vec4 FragColor;
 
 uniform vec2 resolution;
+uniform vec2 origin;  // window position of the drawn region's lower-left corner
 uniform int maxIterations;
 uniform vec3 color;
 uniform vec3 colorBg;
 uniform bool adaptiveIterations;
+uniform float interiorThreshold;  // |dz/dz1| below which a bounded orbit is interior; 0 = off
 
 // Always use single precision in shader (macOS doesn't support double in GLSL)
 // But we can use high precision qualifiers and better calculation techniques
 uniform float zoom;
 uniform vec2 offset;
 
+// Julia mode iterates z0 = pixel with a fixed c instead of z0 = 0, c = pixel
+uniform bool juliaMode;
+uniform vec2 juliaC;
+
+#ifdef USE_PERTURBATION
+// Deep views iterate each pixel's offset (delta) from a reference orbit that
+// the application computes in high precision on the CPU
+uniform samplerBuffer referenceOrbit;  // Z_0 = 0, Z_1, ... as (re, im)
+uniform int referenceLength;
+uniform bool referenceComplete;        // false while the orbit is still being computed
+uniform vec2 referenceOffset;          // reference point relative to offset
+uniform int deltaExponent;             // zoom and referenceOffset are in units of 2^deltaExponent
+#endif
+
 #ifdef USE_DOUBLE_PRECISION
 // When double precision is requested, we use high precision floats
 // and implement better numerical techniques
@@ -26,10 +42,32 @@ vec3 getColor(float t, vec3 color, vec3 colorBg) {
     return mix(colorBg, color, t);
 }
 
-// Mandelbrot calculation function with precision qualifiers
-vec4 mandelbrot(PRECISION_QUALIFIER vec2 c, int maxIter, vec3 color, vec3 colorBg) {
-    PRECISION_QUALIFIER vec2 z = vec2(0.0);
+// One iteration z -> f(z) + c. The application replaces the block between
+// the markers with code generated for the selected formula (see formula.cpp).
+// @formula-begin
+vec2 formulaStep(PRECISION_QUALIFIER vec2 z, PRECISION_QUALIFIER vec2 c) {
+    // z = z^2 + c with explicit precision
+    PRECISION_QUALIFIER float zx2 = z.x * z.x;
+    PRECISION_QUALIFIER float zy2 = z.y * z.y;
+    PRECISION_QUALIFIER float zxy = z.x * z.y;
+    return vec2(zx2 - zy2, 2.0 * zxy) + c;
+}
+
+// |f'(z)|^2 from |z|^2, the factor one step scales |dz|^2 by
+float formulaDerivative(float r2) {
+    return 4.0 * r2;
+}
+// @formula-end
+
+// Escape-time calculation of the formula from z0, with precision qualifiers.
+// |dz/dz1|^2 is tracked from the first step on (z0 = 0 has no derivative);
+// an orbit along which it falls below the threshold is attracted to a cycle
+// and is drawn as interior without running to the cap.
+vec4 escapeTime(PRECISION_QUALIFIER vec2 z0, PRECISION_QUALIFIER vec2 c, int maxIter, vec3 color, vec3 colorBg) {
+    PRECISION_QUALIFIER vec2 z = z0;
     int iter = 0;
+    float derivative = 1.0;
+    float interiorLimit = interiorThreshold * interiorThreshold;
     
     for (int i = 0; i < maxIter; i++) {
         PRECISION_QUALIFIER float z_squared = dot(z, z);
@@ -37,23 +75,100 @@ vec4 mandelbrot(PRECISION_QUALIFIER vec2 c, int maxIter, vec3 color, vec3 colorB
             float t = float(iter) / float(maxIterations);
             return vec4(getColor(t, color, colorBg), 1.0);
         }
+        if (i > 0) {
+            derivative *= formulaDerivative(z_squared);
+            if (derivative < interiorLimit) break;
+        }
         
-        // z = z^2 + c with explicit precision
-        PRECISION_QUALIFIER float zx2 = z.x * z.x;
-        PRECISION_QUALIFIER float zy2 = z.y * z.y;
-        PRECISION_QUALIFIER float zxy = z.x * z.y;
-        
-        z = vec2(zx2 - zy2, 2.0 * zxy) + c;
+        z = formulaStep(z, c);
         iter = i;
     }
     
     return vec4(0.0, 0.0, 0.0, 1.0);
 }
 
+#ifdef USE_PERTURBATION
+// Scaled deltas are brought back towards units of 1 in steps of this many
+// bits once they grow past 2^kRescaleBits
+const int kRescaleBits = 32;
+
+// Escape time of the pixel at dc from the reference point, iterating
+// delta -> (2Z + delta) delta + dc. Like the CPU kernel, the delta is rebased
+// onto the start of the orbit when |Z + delta| < |delta| or the reference
+// ends, so one reference serves the whole view without glitches. Pixels that
+// outlast a reference still being computed are discarded, leaving what the
+// application drew underneath.
+//
+// dc comes in units of 2^deltaExponent, and delta is kept in units of
+// 2^scale, starting there; in those units the step is
+// 2Z delta + 2^scale delta^2 + dc. As delta grows, scale moves up to 0 and
+// dc's digits below delta's drop out. A Z too small for a float is 0, so z
+// is delta alone there, and the step back to Z_1 takes z^2 + dc in the
+// larger of the two terms' units.
+vec4 perturbedEscapeTime(vec2 dc, int maxIter, vec3 color, vec3 colorBg) {
+    vec2 delta = vec2(0.0);
+    int scale = deltaExponent;
+    vec2 dcScaled = dc;
+    int m = 0;
+    int iter = 0;
+    float derivative = 1.0;
+    float interiorLimit = interiorThreshold * interiorThreshold;
+
+    for (int i = 0; i < maxIter; i++) {
+        vec2 trueDelta = scale == 0 ? delta : ldexp(delta, ivec2(scale));
+        vec2 z = texelFetch(referenceOrbit, m).xy + trueDelta;
+        float z_squared = dot(z, z);
+        if (z_squared > 4.0) {
+            float t = float(iter) / float(maxIterations);
+            return vec4(getColor(t, color, colorBg), 1.0);
+        }
+        if (i > 0) {
+            derivative *= 4.0 * z_squared;
+            if (derivative < interiorLimit) break;
+        }
+
+        vec2 square = vec2(delta.x * delta.x - delta.y * delta.y, 2.0 * delta.x * delta.y);
+        if (scale != 0 && m > 0 && z == trueDelta) {
+            int stepScale = max(2 * scale, deltaExponent);
+            delta = ldexp(square, ivec2(2 * scale - stepScale)) + ldexp(dc, ivec2(deltaExponent - stepScale));
+            scale = stepScale;
+            dcScaled = ldexp(dc, ivec2(deltaExponent - scale));
+            m = 1;
+        } else {
+            if (z_squared < dot(trueDelta, trueDelta) || m == referenceLength - 1) {
+                if (m == referenceLength - 1 && !referenceComplete) discard;
+                delta = z;
+                scale = 0;
+                dcScaled = ldexp(dc, ivec2(deltaExponent));
+                m = 0;
+            }
+            vec2 twoZ = 2.0 * texelFetch(referenceOrbit, m).xy;
+            if (scale == 0) {
+                twoZ += delta;
+                delta = vec2(twoZ.x * delta.x - twoZ.y * delta.y, twoZ.x * delta.y + twoZ.y * delta.x) + dcScaled;
+            } else {
+                delta = vec2(twoZ.x * delta.x - twoZ.y * delta.y, twoZ.x * delta.y + twoZ.y * delta.x) +
+                        ldexp(square, ivec2(scale)) + dcScaled;
+            }
+            m++;
+        }
+        if (scale != 0 && max(abs(delta.x), abs(delta.y)) > exp2(float(kRescaleBits))) {
+            int shift = min(kRescaleBits, -scale);
+            delta = ldexp(delta, ivec2(-shift));
+            scale += shift;
+            dcScaled = ldexp(dc, ivec2(deltaExponent - scale));
+        }
+        iter = i;
+    }
+
+    return vec4(0.0, 0.0, 0.0, 1.0);
+}
+#endif
+
 void main() {
     // Calculate relative coordinates from screen center
     // This approach maintains precision at high zoom levels
-    PRECISION_QUALIFIER vec2 screenPos = gl_FragCoord.xy;
+    PRECISION_QUALIFIER vec2 screenPos = gl_FragCoord.xy - origin;
     PRECISION_QUALIFIER vec2 screenCenter = resolution * 0.5;
     
     // Calculate offset from center in screen pixels
@@ -70,11 +185,24 @@ void main() {
     int adaptiveMaxIter = maxIterations;
     if (adaptiveIterations) {
         // Increase iterations as we zoom in (logarithmic scaling)
-        PRECISION_QUALIFIER float zoomFactor = 1.0 / zoom;
-        adaptiveMaxIter = int(float(maxIterations) * (1.0 + log2(max(zoomFactor, 1.0)) * 0.1));
+        PRECISION_QUALIFIER float zoomLog2 = log2(zoom);
+#ifdef USE_PERTURBATION
+        zoomLog2 += float(deltaExponent);
+#endif
+        adaptiveMaxIter = int(float(maxIterations) * (1.0 + max(-zoomLog2, 0.0) * 0.1));
         adaptiveMaxIter = min(adaptiveMaxIter, 2000); // Cap at reasonable maximum
     }
     
-    // Calculate Mandelbrot iterations
-    FragColor = mandelbrot(c, adaptiveMaxIter, color, colorBg);
+    // Calculate Mandelbrot or Julia iterations
+#ifdef USE_PERTURBATION
+    PRECISION_QUALIFIER float pixelScale = zoom * 2.0 / resolution.y;
+    FragColor = perturbedEscapeTime(vec2(pixelOffset.x, -pixelOffset.y) * pixelScale - referenceOffset,
+                                    adaptiveMaxIter, color, colorBg);
+#else
+    if (juliaMode) {
+        FragColor = escapeTime(c, juliaC, adaptiveMaxIter, color, colorBg);
+    } else {
+        FragColor = escapeTime(vec2(0.0), c, adaptiveMaxIter, color, colorBg);
+    }
+#endif
 }
\ No newline at end of file
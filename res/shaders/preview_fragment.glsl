@@ -0,0 +1,11 @@
+#version 410 core
+
+in vec2 uv;
+out vec4 FragColor;
+
+uniform sampler2D image;
+uniform vec2 textureScale;  // part of the texture holding the current rendering
+
+void main() {
+    FragColor = texture(image, (uv * 0.5 + 0.5) * textureScale);
+}
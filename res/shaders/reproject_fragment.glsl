@@ -0,0 +1,20 @@
+#version 410 core
+
+in vec2 uv;
+out vec4 FragColor;
+
+uniform sampler2D image;
+uniform vec2 resolution;  // of the image, the same as the target's
+uniform float scale;      // image pixels per target pixel
+uniform vec2 shift;       // target centre from the image centre, in image pixels
+
+// Draw an earlier frame onto a view that has since been panned and zoomed;
+// parts it does not cover are black
+void main() {
+    vec2 source = (uv * 0.5 * resolution * scale + shift) / resolution + 0.5;
+    if (any(lessThan(source, vec2(0.0))) || any(greaterThan(source, vec2(1.0)))) {
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    } else {
+        FragColor = texture(image, source);
+    }
+}
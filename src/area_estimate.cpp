@@ -0,0 +1,158 @@
+#include "area_estimate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Upper half of the bounding box: the set spans [-2, 0.471] x [-1.123, 1.123]
+const double kBoxLeft = -2.0;
+const double kBoxRight = 0.5;
+const double kBoxTop = 1.25;
+const int kStrataColumns = 1024;
+const int kStrataRows = 512;
+const int kStrataPerPass = kStrataColumns * kStrataRows;
+const int kRowsPerBand = 32;  // unit of work, so even a two-pass run spreads over all workers
+const int kBandsPerPass = kStrataRows / kRowsPerBand;
+
+const double kProgressSeconds = 1.0;
+
+// Two-sided 95% quantiles of Student's t for 1 to 30 degrees of freedom;
+// beyond that the normal quantile is close enough
+const double kStudentQuantile95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+const double kNormalQuantile95 = 1.960;
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void addCounts(MembershipCounts& total, const MembershipCounts& counts) {
+    total.points += counts.points;
+    total.cardioid += counts.cardioid;
+    total.periodic += counts.periodic;
+    total.escaped += counts.escaped;
+    total.undecided += counts.undecided;
+}
+
+// Mean and interval over the finished passes' area estimates
+void summarise(const vector<double>& passAreas, AreaEstimate& estimate) {
+    estimate.passes = static_cast<int>(passAreas.size());
+    estimate.samples = static_cast<uint64_t>(estimate.passes) * kStrataPerPass;
+    estimate.area = 0.0;
+    estimate.confidence95 = 0.0;
+    if (passAreas.empty()) return;
+
+    double sum = 0.0;
+    for (double area : passAreas) sum += area;
+    estimate.area = sum / passAreas.size();
+    if (passAreas.size() < 2) return;
+
+    double squares = 0.0;
+    for (double area : passAreas) squares += (area - estimate.area) * (area - estimate.area);
+    size_t degrees = passAreas.size() - 1;
+    double variance = squares / degrees;
+    double quantile = degrees <= 30 ? kStudentQuantile95[degrees - 1] : kNormalQuantile95;
+    estimate.confidence95 = quantile * sqrt(variance / passAreas.size());
+}
+
+} // namespace
+
+AreaEstimate estimateMandelbrotArea(const CpuRenderSettings& cpuSettings, const AreaEstimateSettings& settings,
+                                    const function<void(const AreaEstimate&)>& progress) {
+    KernelVariant variant = kernelVariantSupported(cpuSettings.kernel) ? cpuSettings.kernel : bestKernelVariant();
+    MembershipKernel kernel = selectMembershipKernel(variant);
+    int passCount = static_cast<int>(max<uint64_t>(2, (settings.samples + kStrataPerPass - 1) / kStrataPerPass));
+
+    NumaTopology topology = NumaTopology::detect();
+    int workerCount = cpuSettings.threadCount > 0 ? cpuSettings.threadCount
+                                                  : max(1u, thread::hardware_concurrency());
+    int bandCount = passCount * kBandsPerPass;
+    workerCount = min(workerCount, bandCount);
+    bool pin = cpuSettings.numaAware && topology.nodeCount() > 1;
+    vector<pair<int, int>> slots = topology.interleavedCpus();
+
+    mutex resultMutex;
+    condition_variable resultWake;
+    vector<double> passAreas;
+    vector<uint64_t> passInside(passCount, 0);
+    vector<int> passBandsDone(passCount, 0);
+    MembershipCounts counts;
+    int finishedWorkers = 0;
+    int nextBand = 0;
+
+    const double cellWidth = (kBoxRight - kBoxLeft) / kStrataColumns;
+    const double cellHeight = kBoxTop / kStrataRows;
+    const double cellArea = 2.0 * cellWidth * cellHeight;  // counting the mirrored half
+
+    auto worker = [&](int index) {
+        if (pin) pinCurrentThreadToCpu(slots[index % slots.size()].second);
+        vector<double> cx(kStrataColumns), cy(kStrataColumns);
+        while (true) {
+            int band;
+            {
+                lock_guard<mutex> lock(resultMutex);
+                if (nextBand >= bandCount) break;
+                band = nextBand++;
+            }
+            int pass = band / kBandsPerPass;
+            int firstRow = (band % kBandsPerPass) * kRowsPerBand;
+
+            // One jittered point per stratum; seeding by band keeps runs reproducible
+            mt19937_64 random(0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(band));
+            uniform_real_distribution<double> unit(0.0, 1.0);
+            MembershipCounts bandCounts;
+            for (int row = firstRow; row < firstRow + kRowsPerBand; row++) {
+                for (int column = 0; column < kStrataColumns; column++) {
+                    cx[column] = kBoxLeft + (column + unit(random)) * cellWidth;
+                    cy[column] = (row + unit(random)) * cellHeight;
+                }
+                kernel(cx.data(), cy.data(), kStrataColumns, settings.maxIterations, bandCounts);
+            }
+
+            lock_guard<mutex> lock(resultMutex);
+            addCounts(counts, bandCounts);
+            passInside[pass] += bandCounts.cardioid + bandCounts.periodic + bandCounts.undecided;
+            if (++passBandsDone[pass] == kBandsPerPass) passAreas.push_back(passInside[pass] * cellArea);
+        }
+        lock_guard<mutex> lock(resultMutex);
+        finishedWorkers++;
+        resultWake.notify_all();
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int i = 0; i < workerCount; i++) threads.emplace_back(worker, i);
+
+    AreaEstimate estimate;
+    {
+        unique_lock<mutex> lock(resultMutex);
+        while (finishedWorkers < workerCount) {
+            resultWake.wait_for(lock, chrono::duration<double>(kProgressSeconds));
+            if (finishedWorkers == workerCount || !progress) continue;
+            summarise(passAreas, estimate);
+            estimate.counts = counts;
+            estimate.seconds = secondsSince(start);
+            lock.unlock();
+            progress(estimate);
+            lock.lock();
+        }
+    }
+    for (auto& t : threads) t.join();
+
+    summarise(passAreas, estimate);
+    estimate.counts = counts;
+    estimate.seconds = secondsSince(start);
+    return estimate;
+}
@@ -0,0 +1,219 @@
+#include "autotune.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "reference_orbit.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const int kTuneWidth = 512;
+const int kTuneHeight = 384;
+const int kTuneRepeats = 2;
+const double kTuneReferenceSeconds = 0.02;
+const int kReferenceTiers[] = {8, 16, 32, kMaxReferenceLimbs};
+
+CpuView tuneView(double offsetX, double offsetY, double zoom, int maxIterations) {
+    CpuView view;
+    view.offsetX = offsetX;
+    view.offsetY = offsetY;
+    view.zoom = zoom;
+    view.width = kTuneWidth;
+    view.height = kTuneHeight;
+    view.maxIterations = maxIterations;
+    return view;
+}
+
+// Views covering cheap exterior, mixed boundary and deep-iteration regions
+const CpuView kTuneViews[] = {
+    tuneView(-0.5, 0.0, 1.5, 256),
+    tuneView(-0.745, 0.1, 0.01, 1000),
+    tuneView(0.2821, 0.01, 0.002, 1000),
+};
+
+string hostName() {
+#ifdef _WIN32
+    const char* computer = getenv("COMPUTERNAME");
+    if (computer) return computer;
+#else
+    char name[256] = {0};
+    if (gethostname(name, sizeof(name) - 1) == 0 && name[0] != '\0') return name;
+#endif
+    return "localhost";
+}
+
+string configDirectory() {
+#ifdef _WIN32
+    const char* appData = getenv("APPDATA");
+    if (appData) return string(appData) + "/mandelbrotset";
+#else
+    const char* xdg = getenv("XDG_CONFIG_HOME");
+    if (xdg && xdg[0] != '\0') return string(xdg) + "/mandelbrotset";
+    const char* home = getenv("HOME");
+    if (home) return string(home) + "/.config/mandelbrotset";
+#endif
+    return ".";
+}
+
+// Best-of-N seconds to render all tuning views with the given settings
+double benchmarkSettings(const CpuRenderSettings& settings) {
+    CpuRenderer renderer(settings);
+    double total = 0.0;
+    for (const CpuView& view : kTuneViews) {
+        double best = numeric_limits<double>::max();
+        for (int repeat = 0; repeat < kTuneRepeats; repeat++) {
+            if (!renderer.render(view)) return numeric_limits<double>::max();
+            best = min(best, renderer.stats().renderSeconds);
+        }
+        total += best;
+    }
+    return total;
+}
+
+// Best-of-N seconds for a reference orbit of c = i, which never escapes
+double benchmarkReference(int limbs, int iterations, const ReferenceTeam& team) {
+    ReferenceCoordinate cx, cy = ReferenceCoordinate::fromDouble(1.0);
+    OrbitStore orbit;
+    double best = numeric_limits<double>::max();
+    for (int repeat = 0; repeat < kTuneRepeats; repeat++) {
+        best = min(best, computeReferenceOrbit(cx, cy, limbs, iterations, orbit, team));
+    }
+    return best;
+}
+
+// Narrowest reference format whose steps are faster shared between the
+// given number of threads than on one, or 0 if none is
+int tuneReferenceTeam(int threads) {
+    ReferenceTeam solo, shared;
+    solo.minLimbs = 0;
+    shared.threads = threads;
+    shared.minLimbs = kReferenceTiers[0];
+    for (int limbs : kReferenceTiers) {
+        // Scale the orbit to about kTuneReferenceSeconds from a short probe
+        const int probe = 256;
+        double probeSeconds = max(benchmarkReference(limbs, probe, solo), 1e-6);
+        int iterations = max(probe, static_cast<int>(probe * kTuneReferenceSeconds / probeSeconds));
+        double soloSeconds = benchmarkReference(limbs, iterations, solo);
+        double sharedSeconds = benchmarkReference(limbs, iterations, shared);
+        cout << "  reference " << setw(2) << limbs << " limbs  1 thread " << soloSeconds * 1e9 / iterations
+             << " ns, " << threads << " threads " << sharedSeconds * 1e9 / iterations << " ns per iteration" << endl;
+        if (sharedSeconds < soloSeconds) return limbs;
+    }
+    return 0;
+}
+
+} // namespace
+
+string tunedConfigPath() {
+    return configDirectory() + "/tune-" + hostName() + ".cfg";
+}
+
+bool loadTunedSettings(CpuRenderSettings& settings) {
+    ifstream file(tunedConfigPath());
+    if (!file.is_open()) return false;
+
+    string line;
+    while (getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        size_t equals = line.find('=');
+        if (equals == string::npos) continue;
+        string key = line.substr(0, equals);
+        string value = line.substr(equals + 1);
+
+        if (key == "threads") {
+            settings.threadCount = max(0, atoi(value.c_str()));
+        } else if (key == "tile_size") {
+            settings.tileSize = clamp(atoi(value.c_str()), 8, kMaxTileSize);
+        } else if (key == "kernel") {
+            KernelVariant variant;
+            // A file copied from another machine may name a kernel this CPU lacks
+            if (parseKernelVariant(value, variant) && kernelVariantSupported(variant)) {
+                settings.kernel = variant;
+            }
+        } else if (key == "reference_team_limbs") {
+            settings.referenceTeamLimbs = max(0, atoi(value.c_str()));
+        }
+    }
+    return true;
+}
+
+bool saveTunedSettings(const CpuRenderSettings& settings) {
+    string path = tunedConfigPath();
+    error_code error;
+    filesystem::create_directories(filesystem::path(path).parent_path(), error);
+
+    ofstream file(path);
+    if (!file.is_open()) {
+        cerr << "Failed to write tuning file: " << path << endl;
+        return false;
+    }
+    file << "# CPU engine tuning for " << hostName() << ", written by --tune\n";
+    file << "threads=" << settings.threadCount << "\n";
+    file << "tile_size=" << settings.tileSize << "\n";
+    file << "kernel=" << kernelVariantName(settings.kernel) << "\n";
+    file << "reference_team_limbs=" << settings.referenceTeamLimbs << "\n";
+    return static_cast<bool>(file);
+}
+
+CpuRenderSettings autotuneCpuSettings(const CpuRenderSettings& base) {
+    int hardwareThreads = max(1u, thread::hardware_concurrency());
+    vector<int> threadCounts;
+    for (int count = 1; count < hardwareThreads; count *= 2) threadCounts.push_back(count);
+    threadCounts.push_back(hardwareThreads);
+
+    vector<KernelVariant> kernels;
+    for (KernelVariant variant : {KernelVariant::Scalar, KernelVariant::Avx2, KernelVariant::Avx512}) {
+        if (kernelVariantSupported(variant)) kernels.push_back(variant);
+    }
+    const int tileSizes[] = {16, 32, 64, 128, 256};
+
+    CpuRenderSettings best = base;
+    double bestSeconds = numeric_limits<double>::max();
+    cout << fixed << setprecision(2);
+    for (KernelVariant kernel : kernels) {
+        for (int threads : threadCounts) {
+            for (int tileSize : tileSizes) {
+                CpuRenderSettings candidate = base;
+                candidate.kernel = kernel;
+                candidate.threadCount = threads;
+                candidate.tileSize = tileSize;
+
+                double seconds = benchmarkSettings(candidate);
+                cout << "  " << setw(7) << kernelVariantName(kernel) << "  threads " << setw(3) << threads
+                     << "  tile " << setw(3) << tileSize << "  " << seconds * 1000.0 << " ms" << endl;
+                if (seconds < bestSeconds) {
+                    bestSeconds = seconds;
+                    best = candidate;
+                }
+            }
+        }
+    }
+
+    cout << "Best: " << kernelVariantName(best.kernel) << ", " << best.threadCount << " threads, tile "
+         << best.tileSize << " (" << bestSeconds * 1000.0 << " ms)" << endl;
+
+    // Wide reference orbits share their steps with the render workers
+    int workers = best.threadCount > 0 ? best.threadCount : hardwareThreads;
+    if (workers > 1) {
+        best.referenceTeamLimbs = tuneReferenceTeam(workers);
+        if (best.referenceTeamLimbs > 0) {
+            cout << "Reference steps shared from " << best.referenceTeamLimbs << " limbs" << endl;
+        } else {
+            cout << "Reference steps kept on one thread" << endl;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,305 @@
+#include "buddhabrot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+namespace {
+
+// Every orbit that escapes starts from |c| <= 2; c is drawn from the upper
+// half [-2, 2] x [0, 2] of the enclosing square
+const double kSampleRadius = 2.0;
+const int kGridWidth = 256;
+const int kGridHeight = 128;
+const int kPrepassSamples = 3;      // per cell edge
+const double kMinimumShare = 0.05;  // floor of a cell's weight, relative to the mean
+
+const int kSamplesPerBatch = 64;
+const double kFirstMergeSeconds = 0.025;  // doubles with every merge up to the maximum
+const double kMaxMergeSeconds = 0.2;
+const double kDisplayPercentile = 0.995;
+const int kPercentileSamples = 65536;
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int maxIterationLimit(const BuddhabrotSettings& settings) {
+    return max(settings.iterationLimits[0], max(settings.iterationLimits[1], settings.iterationLimits[2]));
+}
+
+// Iterations until z^2 + c escapes, or -1 if it stays bounded for limit iterations
+int escapeIteration(double cx, double cy, int limit) {
+    if (inMainCardioidOrBulb(cx, cy)) return -1;
+    double zx = 0.0, zy = 0.0;
+    for (int i = 0; i < limit; i++) {
+        double zx2 = zx * zx;
+        double zy2 = zy * zy;
+        if (zx2 + zy2 > 4.0) return i;
+        zy = 2.0 * zx * zy + cy;
+        zx = zx2 - zy2 + cx;
+    }
+    return -1;
+}
+
+} // namespace
+
+BuddhabrotRenderer::BuddhabrotRenderer(const CpuRenderSettings& cpuSettings, const BuddhabrotSettings& settings)
+    : config(settings) {
+    NumaTopology topology = NumaTopology::detect();
+    int workerCount = cpuSettings.threadCount > 0 ? cpuSettings.threadCount
+                                                  : max(1u, thread::hardware_concurrency());
+    placeByNode = cpuSettings.numaAware && topology.nodeCount() > 1;
+    vector<pair<int, int>> slots = topology.interleavedCpus();
+    workers.resize(workerCount);
+    for (int i = 0; i < workerCount; i++) {
+        workers[i].cpu = slots[i % slots.size()].second;
+    }
+
+    buildImportanceMap();
+
+    for (int i = 0; i < workerCount; i++) {
+        workers[i].thread = thread(&BuddhabrotRenderer::workerLoop, this, i);
+    }
+}
+
+BuddhabrotRenderer::~BuddhabrotRenderer() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+        generation++;
+    }
+    stateWake.notify_all();
+    for (auto& worker : workers) {
+        if (worker.thread.joinable()) worker.thread.join();
+    }
+}
+
+void BuddhabrotRenderer::buildImportanceMap() {
+    const int cellCount = kGridWidth * kGridHeight;
+    const double cellWidth = 2.0 * kSampleRadius / kGridWidth;
+    const double cellHeight = kSampleRadius / kGridHeight;
+    const int limit = maxIterationLimit(config);
+
+    // Expected number of plotted points per sample, estimated on a small grid
+    // of samples in each cell; the pre-pass runs on as many threads as workers
+    vector<double> weight(cellCount, 1.0);
+    if (config.importanceSampling) {
+        auto estimateRows = [&](int first) {
+            for (int row = first; row < kGridHeight; row += static_cast<int>(workers.size())) {
+                for (int column = 0; column < kGridWidth; column++) {
+                    double plotted = 0.0;
+                    for (int sy = 0; sy < kPrepassSamples; sy++) {
+                        for (int sx = 0; sx < kPrepassSamples; sx++) {
+                            double cx = -kSampleRadius + (column + (sx + 0.5) / kPrepassSamples) * cellWidth;
+                            double cy = (row + (sy + 0.5) / kPrepassSamples) * cellHeight;
+                            int n = escapeIteration(cx, cy, limit);
+                            if (n >= config.minIterations) plotted += n;
+                        }
+                    }
+                    weight[row * kGridWidth + column] = plotted / (kPrepassSamples * kPrepassSamples);
+                }
+            }
+        };
+        vector<thread> threads;
+        for (size_t i = 0; i < workers.size(); i++) threads.emplace_back(estimateRows, static_cast<int>(i));
+        for (auto& t : threads) t.join();
+
+        // A floor keeps every cell reachable: thin filaments the pre-pass
+        // missed must still be sampled for the estimate to stay unbiased
+        double mean = 0.0;
+        for (double w : weight) mean += w;
+        mean /= cellCount;
+        double floor = max(kMinimumShare * mean, 1e-3);
+        for (double& w : weight) w = max(w, floor);
+    }
+
+    // Orbits from a cell are weighted by (1 / cellCount) / p(cell), the
+    // density of uniform sampling over that of importance sampling
+    cellCumulative.resize(cellCount);
+    cellWeight.resize(cellCount);
+    double sum = 0.0;
+    for (int i = 0; i < cellCount; i++) {
+        sum += weight[i];
+        cellCumulative[i] = sum;
+    }
+    for (int i = 0; i < cellCount; i++) {
+        cellWeight[i] = static_cast<float>(sum / (cellCount * weight[i]));
+    }
+}
+
+void BuddhabrotRenderer::start(const CpuView& view) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        currentView = view;
+        total.assign(static_cast<size_t>(view.width) * view.height * config.channelCount(), 0.0);
+        running = true;
+        generation++;
+        startTime = chrono::steady_clock::now();
+        mergedSamples.store(0, memory_order_release);
+        merges.fetch_add(1, memory_order_acq_rel);
+    }
+    stateWake.notify_all();
+}
+
+void BuddhabrotRenderer::stop() {
+    lock_guard<mutex> lock(stateMutex);
+    running = false;
+    generation++;
+}
+
+double BuddhabrotRenderer::samplesPerSecond() const {
+    lock_guard<mutex> lock(stateMutex);
+    double seconds = secondsSince(startTime);
+    return seconds > 0.0 ? mergedSamples.load(memory_order_acquire) / seconds : 0.0;
+}
+
+void BuddhabrotRenderer::workerLoop(int index) {
+    if (placeByNode && pinCurrentThreadToCpu(workers[index].cpu)) {
+        pinnedCount++;
+    }
+
+    const int channels = config.channelCount();
+    const int limit = maxIterationLimit(config);
+    const double cellWidth = 2.0 * kSampleRadius / kGridWidth;
+    const double cellHeight = kSampleRadius / kGridHeight;
+    const double weightSum = cellCumulative.back();
+
+    vector<float> local;
+    vector<double> orbitX(limit), orbitY(limit);
+    mt19937_64 random(0x9E3779B97F4A7C15ull * (index + 1));
+    uniform_real_distribution<double> unit(0.0, 1.0);
+
+    unique_lock<mutex> lock(stateMutex);
+    while (true) {
+        stateWake.wait(lock, [&] { return stopping || running; });
+        if (stopping) return;
+        uint64_t seenGeneration = generation.load();
+        CpuView view = currentView;
+        lock.unlock();
+
+        // Allocated and cleared by this worker, so the pages land on its node
+        size_t pixelCount = static_cast<size_t>(view.width) * view.height;
+        local.assign(pixelCount * channels, 0.0f);
+
+        double aspectRatio = static_cast<double>(view.width) / static_cast<double>(view.height);
+        double inverseScaleX = view.width / (view.zoom * aspectRatio * 2.0);
+        double inverseScaleY = view.height / (view.zoom * 2.0);
+        double halfWidth = 0.5 * view.width;
+        double halfHeight = 0.5 * view.height;
+        auto plot = [&](double x, double y, unsigned channelMask, float weight) {
+            double px = floor((x - view.offsetX) * inverseScaleX + halfWidth);
+            // Row 0 is offsetY + zoom, as in CpuView and fragment.glsl
+            double py = floor((view.offsetY - y) * inverseScaleY + halfHeight);
+            if (px < 0.0 || py < 0.0 || px >= view.width || py >= view.height) return;
+            float* pixel = &local[(static_cast<size_t>(py) * view.width + static_cast<size_t>(px)) * channels];
+            for (int channel = 0; channel < channels; channel++) {
+                if (channelMask & (1u << channel)) pixel[channel] += weight;
+            }
+        };
+
+        auto lastMerge = chrono::steady_clock::now();
+        int mergesDone = 0;
+        uint64_t pendingSamples = 0;
+        while (generation.load(memory_order_relaxed) == seenGeneration) {
+            for (int s = 0; s < kSamplesPerBatch; s++) {
+                int cell = static_cast<int>(upper_bound(cellCumulative.begin(), cellCumulative.end(),
+                                                        unit(random) * weightSum) - cellCumulative.begin());
+                cell = min(cell, kGridWidth * kGridHeight - 1);
+                double cx = -kSampleRadius + (cell % kGridWidth + unit(random)) * cellWidth;
+                double cy = (cell / kGridWidth + unit(random)) * cellHeight;
+                if (inMainCardioidOrBulb(cx, cy)) continue;
+
+                // Record the orbit until it escapes; bounded orbits are not plotted
+                double zx = 0.0, zy = 0.0;
+                int escapedAt = -1;
+                for (int i = 0; i < limit; i++) {
+                    double zx2 = zx * zx;
+                    double zy2 = zy * zy;
+                    if (zx2 + zy2 > 4.0) {
+                        escapedAt = i;
+                        break;
+                    }
+                    zy = 2.0 * zx * zy + cy;
+                    zx = zx2 - zy2 + cx;
+                    orbitX[i] = zx;
+                    orbitY[i] = zy;
+                }
+                if (escapedAt < config.minIterations) continue;
+
+                unsigned channelMask = 0;
+                for (int channel = 0; channel < channels; channel++) {
+                    if (escapedAt < config.iterationLimits[channel]) channelMask |= 1u << channel;
+                }
+                float weight = cellWeight[cell];
+                for (int i = 0; i < escapedAt; i++) {
+                    plot(orbitX[i], orbitY[i], channelMask, weight);
+                    plot(orbitX[i], -orbitY[i], channelMask, weight);
+                }
+            }
+            pendingSamples += kSamplesPerBatch;
+
+            double interval = min(kMaxMergeSeconds, kFirstMergeSeconds * (1 << min(mergesDone, 8)));
+            if (secondsSince(lastMerge) < interval) continue;
+
+            lock.lock();
+            if (generation.load() == seenGeneration) {
+                for (size_t i = 0; i < local.size(); i++) total[i] += local[i];
+                mergedSamples.fetch_add(pendingSamples, memory_order_acq_rel);
+                merges.fetch_add(1, memory_order_acq_rel);
+            }
+            lock.unlock();
+            fill(local.begin(), local.end(), 0.0f);
+            pendingSamples = 0;
+            lastMerge = chrono::steady_clock::now();
+            mergesDone++;
+        }
+        lock.lock();
+    }
+}
+
+void BuddhabrotRenderer::resolve(vector<float>& density, float scale[3]) {
+    const int channels = config.channelCount();
+    {
+        lock_guard<mutex> lock(stateMutex);
+        size_t pixelCount = static_cast<size_t>(currentView.width) * currentView.height;
+        density.resize(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; i++) {
+            for (int channel = 0; channel < 3; channel++) {
+                density[i * 3 + channel] = static_cast<float>(total[i * channels + min(channel, channels - 1)]);
+            }
+        }
+    }
+
+    // A percentile of the lit pixels rather than the maximum, which a few
+    // pixels on attracting orbits would otherwise set
+    size_t pixelCount = density.size() / 3;
+    size_t stride = max<size_t>(1, pixelCount / kPercentileSamples);
+    vector<float> values;
+    for (int channel = 0; channel < 3; channel++) {
+        values.clear();
+        for (size_t i = 0; i < pixelCount; i += stride) {
+            float value = density[i * 3 + channel];
+            if (value > 0.0f) values.push_back(value);
+        }
+        scale[channel] = 1.0f;
+        if (values.empty()) continue;
+        auto nth = values.begin() + static_cast<size_t>(kDisplayPercentile * (values.size() - 1));
+        nth_element(values.begin(), nth, values.end());
+        scale[channel] = 1.0f / *nth;
+    }
+}
+
+void toneMapBuddhabrot(const vector<float>& density, const float scale[3], int width, int height,
+                       vector<uint8_t>& rgb) {
+    size_t count = static_cast<size_t>(width) * static_cast<size_t>(height) * 3;
+    rgb.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        // Same curve as buddhabrot_fragment.glsl
+        float exposed = 1.0f - exp(-kBuddhabrotExposure * density[i] * scale[i % 3]);
+        float value = pow(exposed, 1.0f / 2.2f);
+        rgb[i] = static_cast<uint8_t>(clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
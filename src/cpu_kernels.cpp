@@ -0,0 +1,1377 @@
+#include "cpu_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MANDEL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// The iteration loop is written once, as iteratePoints<Lanes, F, Features>.
+// Lanes supplies the arithmetic: a scalar type (double, double-double, fixed
+// point) and how many points one value carries (1, or 4/8 SIMD lanes). The
+// formula F (see formula.h) and Features are compile-time constants, so
+// every branch on them folds away and the only test left in the inner loop
+// is the escape check. Each combination is wrapped in a BlockKernel and
+// looked up in a table.
+
+namespace {
+
+// Iteration value of a point that escaped at the given iteration with |z|^2 > 4
+template <int Power, unsigned Features>
+inline float escapeValue(int iteration, double modulusSquared) {
+    if constexpr ((Features & kKernelSmoothColoring) != 0) {
+        // Continuous count: subtract log_d(log2 |z|), which grows by one per iteration
+        double logModulus = 0.5 * log2(modulusSquared);
+        return static_cast<float>(iteration + 1 - log2(logModulus) / log2(static_cast<double>(Power)));
+    } else {
+        return static_cast<float>(iteration);
+    }
+}
+
+// Scalar lane types: one point per value
+
+struct DoubleLanes {
+    using Real = double;
+    using Value = double;
+    static constexpr int kLanes = 1;
+    using Leading = DoubleLanes;
+    static Value leading(Value a) { return a; }
+
+    static Value zero() { return 0.0; }
+    static Value broadcast(Real value) { return value; }
+    static Value gather(const Real* values, const int* index) { return values[index[0]]; }
+    static Value add(Value a, Value b) { return a + b; }
+    static Value sub(Value a, Value b) { return a - b; }
+    static Value mul(Value a, Value b) { return a * b; }
+    static Value square(Value a) { return a * a; }
+    static Value twice(Value a) { return a + a; }
+    static Value mulAdd(Value a, Value b, Value c) { return a * b + c; }
+    static Value negate(Value a) { return -a; }
+    static Value absolute(Value a) { return fabs(a); }
+
+    static int escaped(Value, Value, Value zx2, Value zy2, double* modulus) {
+        modulus[0] = zx2 + zy2;
+        return modulus[0] > 4.0 ? 1 : 0;
+    }
+    static int lessThan(Value a, Value b) { return a < b ? 1 : 0; }
+};
+
+struct DoubleDoubleLanes {
+    using Real = DoubleDouble;
+    using Value = DoubleDouble;
+    static constexpr int kLanes = 1;
+    using Leading = DoubleLanes;
+    static double leading(const Value& a) { return a.hi; }
+
+    static Value zero() { return DoubleDouble(); }
+    static Value broadcast(const Real& value) { return value; }
+    static Value gather(const Real* values, const int* index) { return values[index[0]]; }
+    static Value add(const Value& a, const Value& b) { return sloppyAdd(a, b); }
+    static Value sub(const Value& a, const Value& b) { return sloppyAdd(a, -b); }
+    static Value mul(const Value& a, const Value& b) { return a * b; }
+    static Value square(const Value& a) { return ::square(a); }
+    static Value twice(const Value& a) { return DoubleDouble(a.hi + a.hi, a.lo + a.lo); }
+    static Value mulAdd(const Value& a, const Value& b, const Value& c) { return sloppyAdd(a * b, c); }
+    static Value negate(const Value& a) { return -a; }
+    static Value absolute(const Value& a) { return a.hi < 0.0 ? -a : a; }
+
+    static int escaped(const Value&, const Value&, const Value& zx2, const Value& zy2, double* modulus) {
+        modulus[0] = zx2.hi + zy2.hi;
+        return modulus[0] > 4.0 ? 1 : 0;
+    }
+};
+
+template <int Limbs>
+struct FixedPointLanes {
+    using Real = FixedPoint<Limbs>;
+    using Value = FixedPoint<Limbs>;
+    static constexpr int kLanes = 1;
+
+    static Value zero() { return Value(); }
+    static Value broadcast(const Real& value) { return value; }
+    static Value gather(const Real* values, const int* index) { return values[index[0]]; }
+    static Value add(const Value& a, const Value& b) { return a + b; }
+    static Value sub(const Value& a, const Value& b) { return a - b; }
+    static Value mul(const Value& a, const Value& b) { return a * b; }
+    static Value square(const Value& a) { return ::square(a); }
+    static Value twice(const Value& a) { return ::twice(a); }
+    static Value mulAdd(const Value& a, const Value& b, const Value& c) { return a * b + c; }
+    static Value negate(const Value& a) { return -a; }
+    static Value absolute(const Value& a) { return a.isNegative() ? -a : a; }
+
+    static int escaped(const Value& zx, const Value& zy, const Value& zx2, const Value& zy2, double* modulus) {
+        // Higher powers can leave |z| large enough for the squares to overflow the
+        // 8 integer bits; such points have escaped whatever the squares say
+        int xPart = zx.integerPart();
+        int yPart = zy.integerPart();
+        if (xPart < -8 || xPart >= 8 || yPart < -8 || yPart >= 8) {
+            double x = zx.toDouble();
+            double y = zy.toDouble();
+            modulus[0] = x * x + y * y;
+            return 1;
+        }
+        Value r2 = zx2 + zy2;
+        if (r2.integerPart() < 4) return 0;
+        modulus[0] = r2.toDouble();
+        return modulus[0] > 4.0 ? 1 : 0;
+    }
+};
+
+#ifdef MANDEL_X86_SIMD
+
+// The generic templates pass vector values between these helpers before
+// flatten inlines them into target-specific code; everything here has
+// internal linkage, so the ABI note GCC emits for that is moot
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+#define MANDEL_AVX2 __attribute__((target("avx2,fma")))
+#define MANDEL_AVX512 __attribute__((target("avx512f")))
+
+struct Avx2Lanes {
+    using Real = double;
+    using Value = __m256d;
+    static constexpr int kLanes = 4;
+    using Leading = Avx2Lanes;
+    MANDEL_AVX2 static Value leading(Value a) { return a; }
+
+    MANDEL_AVX2 static Value zero() { return _mm256_setzero_pd(); }
+    MANDEL_AVX2 static Value broadcast(Real value) { return _mm256_set1_pd(value); }
+    MANDEL_AVX2 static Value gather(const Real* values, const int* index) {
+        return _mm256_set_pd(values[index[3]], values[index[2]], values[index[1]], values[index[0]]);
+    }
+    MANDEL_AVX2 static Value add(Value a, Value b) { return _mm256_add_pd(a, b); }
+    MANDEL_AVX2 static Value sub(Value a, Value b) { return _mm256_sub_pd(a, b); }
+    MANDEL_AVX2 static Value mul(Value a, Value b) { return _mm256_mul_pd(a, b); }
+    MANDEL_AVX2 static Value square(Value a) { return _mm256_mul_pd(a, a); }
+    MANDEL_AVX2 static Value twice(Value a) { return _mm256_add_pd(a, a); }
+    MANDEL_AVX2 static Value mulAdd(Value a, Value b, Value c) { return _mm256_fmadd_pd(a, b, c); }
+    MANDEL_AVX2 static Value negate(Value a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+    MANDEL_AVX2 static Value absolute(Value a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+
+    MANDEL_AVX2 static int escaped(Value, Value, Value zx2, Value zy2, double* modulus) {
+        __m256d r2 = _mm256_add_pd(zx2, zy2);
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(r2, _mm256_set1_pd(4.0), _CMP_GT_OQ));
+        if (mask) _mm256_storeu_pd(modulus, r2);
+        return mask;
+    }
+    MANDEL_AVX2 static int lessThan(Value a, Value b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)); }
+
+    MANDEL_AVX2 static Value load(const Real* values) { return _mm256_loadu_pd(values); }
+    // Lanes of a where mask has their bit set, of b elsewhere
+    MANDEL_AVX2 static Value select(int mask, Value a, Value b) {
+        return _mm256_blendv_pd(b, a, _mm256_castsi256_pd(laneMask(mask)));
+    }
+
+    // Per-lane integers (reference offsets, iteration counts), 64 bits each
+    using Index = __m256i;
+    MANDEL_AVX2 static Index broadcastIndex(int64_t value) { return _mm256_set1_epi64x(value); }
+    MANDEL_AVX2 static Index addIndex(Index a, Index b) { return _mm256_add_epi64(a, b); }
+    MANDEL_AVX2 static Index selectIndex(int mask, Index a, Index b) { return _mm256_blendv_epi8(b, a, laneMask(mask)); }
+    MANDEL_AVX2 static int equalIndex(Index a, Index b) {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b)));
+    }
+    MANDEL_AVX2 static void storeIndex(int64_t* values, Index index) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), index);
+    }
+    MANDEL_AVX2 static Value gatherAt(const double* values, Index offset) {
+        return _mm256_i64gather_pd(values, offset, 8);
+    }
+    MANDEL_AVX2 static Value gatherAt(const float* values, Index offset) {
+        return _mm256_cvtps_pd(_mm256_i64gather_ps(values, offset, 4));
+    }
+
+    // All ones in the lanes whose bit is set
+    MANDEL_AVX2 static __m256i laneMask(int mask) {
+        const __m256i bits = _mm256_set_epi64x(8, 4, 2, 1);
+        return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(mask), bits), bits);
+    }
+};
+
+struct Avx512Lanes {
+    using Real = double;
+    using Value = __m512d;
+    static constexpr int kLanes = 8;
+    using Leading = Avx512Lanes;
+    MANDEL_AVX512 static Value leading(Value a) { return a; }
+
+    MANDEL_AVX512 static Value zero() { return _mm512_setzero_pd(); }
+    MANDEL_AVX512 static Value broadcast(Real value) { return _mm512_set1_pd(value); }
+    MANDEL_AVX512 static Value gather(const Real* values, const int* index) {
+        return _mm512_set_pd(values[index[7]], values[index[6]], values[index[5]], values[index[4]],
+                             values[index[3]], values[index[2]], values[index[1]], values[index[0]]);
+    }
+    MANDEL_AVX512 static Value add(Value a, Value b) { return _mm512_add_pd(a, b); }
+    MANDEL_AVX512 static Value sub(Value a, Value b) { return _mm512_sub_pd(a, b); }
+    MANDEL_AVX512 static Value mul(Value a, Value b) { return _mm512_mul_pd(a, b); }
+    MANDEL_AVX512 static Value square(Value a) { return _mm512_mul_pd(a, a); }
+    MANDEL_AVX512 static Value twice(Value a) { return _mm512_add_pd(a, a); }
+    MANDEL_AVX512 static Value mulAdd(Value a, Value b, Value c) { return _mm512_fmadd_pd(a, b, c); }
+    // AVX-512F has no floating-point bitwise ops, so the sign bit is handled as integers
+    MANDEL_AVX512 static Value negate(Value a) {
+        return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(INT64_MIN)));
+    }
+    MANDEL_AVX512 static Value absolute(Value a) {
+        return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(INT64_MAX)));
+    }
+
+    MANDEL_AVX512 static int escaped(Value, Value, Value zx2, Value zy2, double* modulus) {
+        __m512d r2 = _mm512_add_pd(zx2, zy2);
+        int mask = _mm512_cmp_pd_mask(r2, _mm512_set1_pd(4.0), _CMP_GT_OQ);
+        if (mask) _mm512_storeu_pd(modulus, r2);
+        return mask;
+    }
+    MANDEL_AVX512 static int lessThan(Value a, Value b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+
+    MANDEL_AVX512 static Value load(const Real* values) { return _mm512_loadu_pd(values); }
+    MANDEL_AVX512 static Value select(int mask, Value a, Value b) {
+        return _mm512_mask_blend_pd(static_cast<__mmask8>(mask), b, a);
+    }
+
+    using Index = __m512i;
+    MANDEL_AVX512 static Index broadcastIndex(int64_t value) { return _mm512_set1_epi64(value); }
+    MANDEL_AVX512 static Index addIndex(Index a, Index b) { return _mm512_add_epi64(a, b); }
+    MANDEL_AVX512 static Index selectIndex(int mask, Index a, Index b) {
+        return _mm512_mask_blend_epi64(static_cast<__mmask8>(mask), b, a);
+    }
+    MANDEL_AVX512 static int equalIndex(Index a, Index b) { return _mm512_cmpeq_epi64_mask(a, b); }
+    MANDEL_AVX512 static void storeIndex(int64_t* values, Index index) { _mm512_storeu_si512(values, index); }
+    // Masked forms throughout, as GCC 12 flags the plain ones' unset source operand
+    MANDEL_AVX512 static Value gatherAt(const double* values, Index offset) {
+        return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xFF, offset, values, 8);
+    }
+    MANDEL_AVX512 static Value gatherAt(const float* values, Index offset) {
+        __m256 points = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xFF, offset, values, 4);
+        return _mm512_mask_cvtps_pd(_mm512_setzero_pd(), 0xFF, points);
+    }
+};
+
+// Double-double arithmetic on 4 and 8 lanes, mirroring double_double.h
+
+struct DoubleDouble4 {
+    __m256d hi;
+    __m256d lo;
+};
+
+MANDEL_AVX2 inline DoubleDouble4 quickTwoSum4(__m256d a, __m256d b) {
+    __m256d s = _mm256_add_pd(a, b);
+    return {s, _mm256_sub_pd(b, _mm256_sub_pd(s, a))};
+}
+
+MANDEL_AVX2 inline DoubleDouble4 sloppyAdd4(const DoubleDouble4& a, const DoubleDouble4& b) {
+    __m256d s = _mm256_add_pd(a.hi, b.hi);
+    __m256d bb = _mm256_sub_pd(s, a.hi);
+    __m256d e = _mm256_add_pd(_mm256_sub_pd(a.hi, _mm256_sub_pd(s, bb)), _mm256_sub_pd(b.hi, bb));
+    return quickTwoSum4(s, _mm256_add_pd(e, _mm256_add_pd(a.lo, b.lo)));
+}
+
+MANDEL_AVX2 inline DoubleDouble4 multiply4(const DoubleDouble4& a, const DoubleDouble4& b) {
+    __m256d p = _mm256_mul_pd(a.hi, b.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, b.hi, p);
+    e = _mm256_fmadd_pd(a.hi, b.lo, _mm256_fmadd_pd(a.lo, b.hi, e));
+    return quickTwoSum4(p, e);
+}
+
+MANDEL_AVX2 inline DoubleDouble4 square4(const DoubleDouble4& a) {
+    __m256d p = _mm256_mul_pd(a.hi, a.hi);
+    __m256d e = _mm256_fmsub_pd(a.hi, a.hi, p);
+    e = _mm256_fmadd_pd(_mm256_add_pd(a.hi, a.hi), a.lo, e);
+    return quickTwoSum4(p, e);
+}
+
+struct Avx2DoubleDoubleLanes {
+    using Real = DoubleDouble;
+    using Value = DoubleDouble4;
+    static constexpr int kLanes = 4;
+    using Leading = Avx2Lanes;
+    MANDEL_AVX2 static __m256d leading(const Value& a) { return a.hi; }
+
+    MANDEL_AVX2 static Value zero() { return {_mm256_setzero_pd(), _mm256_setzero_pd()}; }
+    MANDEL_AVX2 static Value broadcast(const Real& value) {
+        return {_mm256_set1_pd(value.hi), _mm256_set1_pd(value.lo)};
+    }
+    MANDEL_AVX2 static Value gather(const Real* values, const int* index) {
+        return {_mm256_set_pd(values[index[3]].hi, values[index[2]].hi, values[index[1]].hi, values[index[0]].hi),
+                _mm256_set_pd(values[index[3]].lo, values[index[2]].lo, values[index[1]].lo, values[index[0]].lo)};
+    }
+    MANDEL_AVX2 static Value add(const Value& a, const Value& b) { return sloppyAdd4(a, b); }
+    MANDEL_AVX2 static Value sub(const Value& a, const Value& b) {
+        const __m256d negativeZero = _mm256_set1_pd(-0.0);
+        return sloppyAdd4(a, {_mm256_xor_pd(b.hi, negativeZero), _mm256_xor_pd(b.lo, negativeZero)});
+    }
+    MANDEL_AVX2 static Value mul(const Value& a, const Value& b) { return multiply4(a, b); }
+    MANDEL_AVX2 static Value square(const Value& a) { return square4(a); }
+    MANDEL_AVX2 static Value twice(const Value& a) {
+        return {_mm256_add_pd(a.hi, a.hi), _mm256_add_pd(a.lo, a.lo)};
+    }
+    MANDEL_AVX2 static Value mulAdd(const Value& a, const Value& b, const Value& c) {
+        return sloppyAdd4(multiply4(a, b), c);
+    }
+    MANDEL_AVX2 static Value negate(const Value& a) {
+        const __m256d negativeZero = _mm256_set1_pd(-0.0);
+        return {_mm256_xor_pd(a.hi, negativeZero), _mm256_xor_pd(a.lo, negativeZero)};
+    }
+    MANDEL_AVX2 static Value absolute(const Value& a) {
+        // The sign of a double-double is the sign of its high part
+        __m256d sign = _mm256_and_pd(a.hi, _mm256_set1_pd(-0.0));
+        return {_mm256_xor_pd(a.hi, sign), _mm256_xor_pd(a.lo, sign)};
+    }
+
+    MANDEL_AVX2 static int escaped(const Value&, const Value&, const Value& zx2, const Value& zy2, double* modulus) {
+        __m256d r2 = _mm256_add_pd(zx2.hi, zy2.hi);
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(r2, _mm256_set1_pd(4.0), _CMP_GT_OQ));
+        if (mask) _mm256_storeu_pd(modulus, r2);
+        return mask;
+    }
+};
+
+struct DoubleDouble8 {
+    __m512d hi;
+    __m512d lo;
+};
+
+MANDEL_AVX512 inline DoubleDouble8 quickTwoSum8(__m512d a, __m512d b) {
+    __m512d s = _mm512_add_pd(a, b);
+    return {s, _mm512_sub_pd(b, _mm512_sub_pd(s, a))};
+}
+
+MANDEL_AVX512 inline DoubleDouble8 sloppyAdd8(const DoubleDouble8& a, const DoubleDouble8& b) {
+    __m512d s = _mm512_add_pd(a.hi, b.hi);
+    __m512d bb = _mm512_sub_pd(s, a.hi);
+    __m512d e = _mm512_add_pd(_mm512_sub_pd(a.hi, _mm512_sub_pd(s, bb)), _mm512_sub_pd(b.hi, bb));
+    return quickTwoSum8(s, _mm512_add_pd(e, _mm512_add_pd(a.lo, b.lo)));
+}
+
+MANDEL_AVX512 inline DoubleDouble8 multiply8(const DoubleDouble8& a, const DoubleDouble8& b) {
+    __m512d p = _mm512_mul_pd(a.hi, b.hi);
+    __m512d e = _mm512_fmsub_pd(a.hi, b.hi, p);
+    e = _mm512_fmadd_pd(a.hi, b.lo, _mm512_fmadd_pd(a.lo, b.hi, e));
+    return quickTwoSum8(p, e);
+}
+
+MANDEL_AVX512 inline DoubleDouble8 square8(const DoubleDouble8& a) {
+    __m512d p = _mm512_mul_pd(a.hi, a.hi);
+    __m512d e = _mm512_fmsub_pd(a.hi, a.hi, p);
+    e = _mm512_fmadd_pd(_mm512_add_pd(a.hi, a.hi), a.lo, e);
+    return quickTwoSum8(p, e);
+}
+
+struct Avx512DoubleDoubleLanes {
+    using Real = DoubleDouble;
+    using Value = DoubleDouble8;
+    static constexpr int kLanes = 8;
+    using Leading = Avx512Lanes;
+    MANDEL_AVX512 static __m512d leading(const Value& a) { return a.hi; }
+
+    MANDEL_AVX512 static Value zero() { return {_mm512_setzero_pd(), _mm512_setzero_pd()}; }
+    MANDEL_AVX512 static Value broadcast(const Real& value) {
+        return {_mm512_set1_pd(value.hi), _mm512_set1_pd(value.lo)};
+    }
+    MANDEL_AVX512 static Value gather(const Real* values, const int* index) {
+        double hi[8];
+        double lo[8];
+        for (int lane = 0; lane < 8; lane++) {
+            hi[lane] = values[index[lane]].hi;
+            lo[lane] = values[index[lane]].lo;
+        }
+        return {_mm512_loadu_pd(hi), _mm512_loadu_pd(lo)};
+    }
+    MANDEL_AVX512 static Value add(const Value& a, const Value& b) { return sloppyAdd8(a, b); }
+    MANDEL_AVX512 static Value sub(const Value& a, const Value& b) {
+        return sloppyAdd8(a, {_mm512_sub_pd(_mm512_setzero_pd(), b.hi), _mm512_sub_pd(_mm512_setzero_pd(), b.lo)});
+    }
+    MANDEL_AVX512 static Value mul(const Value& a, const Value& b) { return multiply8(a, b); }
+    MANDEL_AVX512 static Value square(const Value& a) { return square8(a); }
+    MANDEL_AVX512 static Value twice(const Value& a) {
+        return {_mm512_add_pd(a.hi, a.hi), _mm512_add_pd(a.lo, a.lo)};
+    }
+    MANDEL_AVX512 static Value mulAdd(const Value& a, const Value& b, const Value& c) {
+        return sloppyAdd8(multiply8(a, b), c);
+    }
+    MANDEL_AVX512 static Value negate(const Value& a) {
+        return {Avx512Lanes::negate(a.hi), Avx512Lanes::negate(a.lo)};
+    }
+    MANDEL_AVX512 static Value absolute(const Value& a) {
+        // The sign of a double-double is the sign of its high part
+        __m512i sign = _mm512_and_si512(_mm512_castpd_si512(a.hi), _mm512_set1_epi64(INT64_MIN));
+        return {_mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a.hi), sign)),
+                _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a.lo), sign))};
+    }
+
+    MANDEL_AVX512 static int escaped(const Value&, const Value&, const Value& zx2, const Value& zy2,
+                                     double* modulus) {
+        __m512d r2 = _mm512_add_pd(zx2.hi, zy2.hi);
+        int mask = _mm512_cmp_pd_mask(r2, _mm512_set1_pd(4.0), _CMP_GT_OQ);
+        if (mask) _mm512_storeu_pd(modulus, r2);
+        return mask;
+    }
+};
+
+#endif
+
+// w = z^Power, reusing the squared components the escape test computed
+template <class Lanes, int Power>
+inline void complexPower(const typename Lanes::Value& zx, const typename Lanes::Value& zy,
+                         const typename Lanes::Value& zx2, const typename Lanes::Value& zy2,
+                         typename Lanes::Value& wx, typename Lanes::Value& wy) {
+    using Value = typename Lanes::Value;
+    if constexpr (Power == 2) {
+        wx = Lanes::sub(zx2, zy2);
+        wy = Lanes::twice(Lanes::mul(zx, zy));
+    } else if constexpr (Power % 2 == 0) {
+        Value hx, hy;
+        complexPower<Lanes, Power / 2>(zx, zy, zx2, zy2, hx, hy);
+        wx = Lanes::sub(Lanes::square(hx), Lanes::square(hy));
+        wy = Lanes::twice(Lanes::mul(hx, hy));
+    } else {
+        Value hx, hy;
+        complexPower<Lanes, Power - 1>(zx, zy, zx2, zy2, hx, hy);
+        wx = Lanes::sub(Lanes::mul(hx, zx), Lanes::mul(hy, zy));
+        wy = Lanes::add(Lanes::mul(hx, zy), Lanes::mul(hy, zx));
+    }
+}
+
+// The interior check carries the derivative in double precision, which is
+// plenty for a quantity only compared against a threshold. Lane types whose
+// values have a leading double name its lane type as Leading; fixed point
+// has none and goes without the check.
+template <class Lanes, class = void>
+struct LeadingLanes {
+    using Type = Lanes;
+};
+
+template <class Lanes>
+struct LeadingLanes<Lanes, void_t<typename Lanes::Leading>> {
+    using Type = typename Lanes::Leading;
+};
+
+template <class Lanes, class = void>
+constexpr bool kHasInteriorCheck = false;
+
+template <class Lanes>
+constexpr bool kHasInteriorCheck<Lanes, void_t<typename Lanes::Leading>> = true;
+
+// Factor |g'(z)|^2 = Power^2 |z|^(2 Power - 2) by which one step scales
+// |dz|^2. Conjugation and absolute values only reflect z, so the factor is
+// the same for every formula of a power.
+template <class Lanes, int Power>
+inline typename Lanes::Value derivativeFactor(const typename Lanes::Value& modulusSquared) {
+    typename Lanes::Value factor = Lanes::broadcast(static_cast<double>(Power * Power));
+    for (int i = 1; i < Power; i++) factor = Lanes::mul(factor, modulusSquared);
+    return factor;
+}
+
+// Iterate formula F for the listed points of a row sharing one imaginary
+// part, Lanes::kLanes points at a time. The points are c for the Mandelbrot
+// set and z0 for Julia sets, whose c is (juliaX, juliaY).
+//
+// With the interior check |dz_n/dz_1|^2 is carried along as well: once an
+// orbit is drawn into an attracting cycle every pass round the cycle scales
+// it by |multiplier|^2 < 1, so it falls below interiorLimit long before the
+// cap. Returns the number of points it stopped.
+template <class Lanes, Formula F, unsigned Features>
+inline int iteratePoints(const typename Lanes::Real* cx, const typename Lanes::Real& cy,
+                         const typename Lanes::Real& juliaX, const typename Lanes::Real& juliaY,
+                         const int* points, int count, int maxIterations, double interiorLimit, float* out) {
+    using Value = typename Lanes::Value;
+    constexpr int kLanes = Lanes::kLanes;
+    constexpr int kAllDone = (1 << kLanes) - 1;
+    constexpr bool kJulia = (Features & kKernelJulia) != 0;
+    constexpr bool kInteriorCheck = (Features & kKernelInteriorCheck) != 0 && kHasInteriorCheck<Lanes>;
+    constexpr FormulaDescription kFormula = describeFormula(F);
+    constexpr int Power = kFormula.power;
+    using Leading = typename LeadingLanes<Lanes>::Type;
+    const Value ci = Lanes::broadcast(kJulia ? juliaY : cy);
+    int caught = 0;
+
+    for (int base = 0; base < count; base += kLanes) {
+        int lanes = min(kLanes, count - base);
+        int index[kLanes];
+        for (int lane = 0; lane < kLanes; lane++) {
+            // Pad a short final group by repeating its last point
+            index[lane] = points[base + min(lane, lanes - 1)];
+            out[index[lane]] = kInteriorIteration;
+        }
+
+        const Value pixel = Lanes::gather(cx, index);
+        const Value cr = kJulia ? Lanes::broadcast(juliaX) : pixel;
+        Value zx = kJulia ? pixel : Lanes::zero();
+        Value zy = kJulia ? Lanes::broadcast(cy) : Lanes::zero();
+        int doneMask = 0;
+        [[maybe_unused]] typename Leading::Value derivative{};
+        if constexpr (kInteriorCheck) derivative = Leading::broadcast(1.0);
+        for (int i = 0; i < maxIterations; i++) {
+            Value zx2 = Lanes::square(zx);
+            Value zy2 = Lanes::square(zy);
+            double modulus[kLanes];
+            int escaped = Lanes::escaped(zx, zy, zx2, zy2, modulus) & ~doneMask;
+            if (escaped) {
+                for (int lane = 0; lane < kLanes; lane++) {
+                    if (escaped & (1 << lane)) out[index[lane]] = escapeValue<Power, Features>(i, modulus[lane]);
+                }
+                doneMask |= escaped;
+                if (doneMask == kAllDone) break;
+            }
+            // The first step from z0 = 0 has derivative 0, so start at z1
+            if constexpr (kInteriorCheck) {
+                if (i > 0) {
+                    auto modulusSquared = Leading::add(Lanes::leading(zx2), Lanes::leading(zy2));
+                    derivative = Leading::mul(derivative, derivativeFactor<Leading, Power>(modulusSquared));
+                    int interior = Leading::lessThan(derivative, Leading::broadcast(interiorLimit)) & ~doneMask;
+                    if (interior) {
+                        // out already holds kInteriorIteration; padding lanes repeat a real point
+                        caught += __builtin_popcount(interior & ((1 << lanes) - 1));
+                        doneMask |= interior;
+                        if (doneMask == kAllDone) break;
+                    }
+                }
+            }
+            // z -> g(z), which leaves the squared components as they are
+            if constexpr (kFormula.absolute) {
+                zx = Lanes::absolute(zx);
+                zy = Lanes::absolute(zy);
+            }
+            if constexpr (kFormula.conjugate) zy = Lanes::negate(zy);
+
+            if constexpr (Power == 2) {
+                zy = Lanes::mulAdd(Lanes::twice(zx), zy, ci);
+                zx = Lanes::add(Lanes::sub(zx2, zy2), cr);
+            } else {
+                Value wx, wy;
+                complexPower<Lanes, Power>(zx, zy, zx2, zy2, wx, wy);
+                zx = Lanes::add(wx, cr);
+                zy = Lanes::add(wy, ci);
+            }
+        }
+    }
+    return caught;
+}
+
+// Pixel coordinate in each scalar type: the view offset plus the pixel's
+// distance from it, which a double holds exactly enough. Kept out of line so
+// FMA contraction in the vector builds cannot round coordinates differently
+// from the scalar build.
+__attribute__((noinline))
+void pixelCoordinate(const DoubleDouble& offset, const FixedPoint<4>&, double pixel, double scale, double& c) {
+    c = offset.hi + pixel * scale;
+}
+
+__attribute__((noinline))
+void pixelCoordinate(const DoubleDouble& offset, const FixedPoint<4>&, double pixel, double scale,
+                     DoubleDouble& c) {
+    c = offset + DoubleDouble(pixel * scale);
+}
+
+template <int Limbs>
+__attribute__((noinline))
+void pixelCoordinate(const DoubleDouble&, const FixedPoint<4>& fixedOffset, double pixel, double scale,
+                     FixedPoint<Limbs>& c) {
+    c = narrowFixedPoint<Limbs>(fixedOffset) + FixedPoint<Limbs>::fromDouble(pixel * scale);
+}
+
+// Julia parameter in each scalar type
+inline void convertParameter(const DoubleDouble& value, double& out) {
+    out = value.hi;
+}
+
+inline void convertParameter(const DoubleDouble& value, DoubleDouble& out) {
+    out = value;
+}
+
+template <int Limbs>
+inline void convertParameter(const DoubleDouble& value, FixedPoint<Limbs>& out) {
+    out = FixedPoint<Limbs>::fromDouble(value.hi) + FixedPoint<Limbs>::fromDouble(value.lo);
+}
+
+// Main cardioid and bulb test; the exact double test cannot resolve
+// coordinates that carry more precision, so those only accept clear hits
+inline bool insideMainComponents(double cx, double cy) {
+    return inMainCardioidOrBulb(cx, cy);
+}
+
+inline bool insideMainComponents(const DoubleDouble& cx, const DoubleDouble& cy) {
+    return safelyInMainCardioidOrBulb(cx.hi, cy.hi);
+}
+
+template <int Limbs>
+inline bool insideMainComponents(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy) {
+    return safelyInMainCardioidOrBulb(cx.toDouble(), cy.toDouble());
+}
+
+template <class Lanes, Formula F, unsigned Features>
+inline void iterateBlock(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    using Real = typename Lanes::Real;
+    // The cardioid and bulb only describe the Mandelbrot set itself
+    constexpr bool kCardioidCheck =
+        F == Formula::Mandelbrot && (Features & kKernelCardioidCheck) != 0 && (Features & kKernelJulia) == 0;
+
+    Real juliaX, juliaY;
+    convertParameter(view.juliaX, juliaX);
+    convertParameter(view.juliaY, juliaY);
+
+    thread_local vector<Real> cx;
+    thread_local vector<int> points;
+    int count = x1 - x0;
+    cx.resize(count);
+    for (int x = x0; x < x1; x++) {
+        pixelCoordinate(view.offsetX, view.fixedOffsetX, x + 0.5 - view.width * 0.5, view.scaleX, cx[x - x0]);
+    }
+
+    int caught = 0;
+    for (int y = y0; y < y1; y++) {
+        Real cy;
+        pixelCoordinate(view.offsetY, view.fixedOffsetY, view.height * 0.5 - (y + 0.5), view.scaleY, cy);
+        float* row = image + static_cast<size_t>(y) * view.width + x0;
+
+        // Resolve the cardioid and bulb up front so vector lanes only carry escaping candidates
+        points.clear();
+        for (int i = 0; i < count; i++) {
+            if constexpr (kCardioidCheck) {
+                if (insideMainComponents(cx[i], cy)) {
+                    row[i] = kInteriorIteration;
+                    continue;
+                }
+            }
+            points.push_back(i);
+        }
+        if (points.empty()) continue;
+        caught += iteratePoints<Lanes, F, Features>(cx.data(), cy, juliaX, juliaY, points.data(),
+                                                    static_cast<int>(points.size()), view.maxIterations,
+                                                    view.interiorLimit, row);
+    }
+    if (caught && view.interiorCaught) view.interiorCaught->fetch_add(caught, memory_order_relaxed);
+}
+
+// Instruction set a kernel is compiled for
+enum class KernelTarget {
+    Generic,
+    Avx2,
+    Avx512,
+    Bmi2,  // scalar fixed point with mulx limb products
+};
+
+template <class Lanes, Formula F, unsigned Features>
+void blockKernelGeneric(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    iterateBlock<Lanes, F, Features>(view, x0, y0, x1, y1, image);
+}
+
+#ifdef MANDEL_X86_SIMD
+// flatten pulls the shared template code into these functions, so all of it
+// is compiled for their target rather than called out of line
+template <class Lanes, Formula F, unsigned Features>
+__attribute__((target("avx2,fma"), flatten))
+void blockKernelAvx2(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    iterateBlock<Lanes, F, Features>(view, x0, y0, x1, y1, image);
+}
+
+template <class Lanes, Formula F, unsigned Features>
+__attribute__((target("avx512f"), flatten))
+void blockKernelAvx512(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    iterateBlock<Lanes, F, Features>(view, x0, y0, x1, y1, image);
+}
+
+// (Hand-written _addcarryx dual carry chains measured slower with GCC, which
+// serialises the two chains through the flags, so the portable limb loops
+// are kept and only compiled for BMI2/ADX.)
+template <class Lanes, Formula F, unsigned Features>
+__attribute__((target("bmi2,adx"), flatten))
+void blockKernelBmi2(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    iterateBlock<Lanes, F, Features>(view, x0, y0, x1, y1, image);
+}
+#endif
+
+template <KernelTarget Target, class Lanes, Formula F, unsigned Features>
+BlockKernel blockKernel() {
+#ifdef MANDEL_X86_SIMD
+    if constexpr (Target == KernelTarget::Avx2) return &blockKernelAvx2<Lanes, F, Features>;
+    if constexpr (Target == KernelTarget::Avx512) return &blockKernelAvx512<Lanes, F, Features>;
+    if constexpr (Target == KernelTarget::Bmi2) return &blockKernelBmi2<Lanes, F, Features>;
+#endif
+    return &blockKernelGeneric<Lanes, F, Features>;
+}
+
+// Every formula and feature combination of one lane type
+struct KernelSet {
+    BlockKernel kernels[kFormulaCount][kKernelFeatureCombinations];
+};
+
+template <KernelTarget Target, class Lanes, Formula F, unsigned... Features>
+void fillFeatures(BlockKernel* slots, integer_sequence<unsigned, Features...>) {
+    // Lane types without the interior check share the kernels without it
+    ((slots[Features] = blockKernel<Target, Lanes, F,
+                                    kHasInteriorCheck<Lanes> ? Features : Features & ~kKernelInteriorCheck>()),
+     ...);
+}
+
+template <KernelTarget Target, class Lanes, int... Formulas>
+KernelSet makeKernelSet(integer_sequence<int, Formulas...>) {
+    KernelSet set;
+    (fillFeatures<Target, Lanes, static_cast<Formula>(Formulas)>(
+         set.kernels[Formulas], make_integer_sequence<unsigned, kKernelFeatureCombinations>()), ...);
+    return set;
+}
+
+template <KernelTarget Target, class Lanes>
+const KernelSet& kernelSet() {
+    static const KernelSet set = makeKernelSet<Target, Lanes>(make_integer_sequence<int, kFormulaCount>());
+    return set;
+}
+
+#ifdef MANDEL_X86_SIMD
+bool hasBmi2Adx() {
+    static const bool supported = __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+    return supported;
+}
+#endif
+
+template <int Limbs>
+const KernelSet& fixedPointKernelSet() {
+#ifdef MANDEL_X86_SIMD
+    if (hasBmi2Adx()) return kernelSet<KernelTarget::Bmi2, FixedPointLanes<Limbs>>();
+#endif
+    return kernelSet<KernelTarget::Generic, FixedPointLanes<Limbs>>();
+}
+
+// |z|^2 below this fraction of |Z|^2 means the delta has cancelled the
+// reference's leading digits (Pauldelbrot's glitch criterion)
+const double kGlitchTolerance = 1e-6;
+// Reference points fetched ahead of the one in use, which matters once the
+// orbit outgrows the caches or lives in a mapped file
+const int kOrbitPrefetchPoints = 32;
+
+// Perturbation: with z = Z + delta and c = C + dc, where Z is the reference
+// orbit of C, delta_{n+1} = (2 Z_n + delta_n) delta_n + dc, which doubles
+// carry at any depth since only the reference needs the view's precision.
+// Rebasing restarts the delta at the orbit's start (delta = z against
+// Z_0 = 0) whenever |z| < |delta| or the reference ends: the delta would
+// otherwise lose its digits as z passes near 0, and a reference that escaped
+// early would end the pixel. Without rebasing such pixels are flagged as
+// glitches for another reference to redo. Point is the orbit's storage
+// type; float points are widened as they are read.
+//
+// The interior check works on the full z = Z + delta, as in iteratePoints;
+// rebasing does not touch it.
+template <unsigned Features, class Point>
+inline float perturbPoint(const KernelView& view, const Point* orbit, double dcx, double dcy, int& caught) {
+    constexpr bool kInteriorCheck = (Features & kKernelInteriorCheck) != 0;
+    const int last = view.referenceLength - 1;
+    double dx = 0.0;
+    double dy = 0.0;
+    double derivative = 1.0;
+    int m = 0;
+    for (int i = 0; i < view.maxIterations; i++) {
+        __builtin_prefetch(orbit + 2 * min(m + kOrbitPrefetchPoints, last));
+        double zx = orbit[2 * m] + dx;
+        double zy = orbit[2 * m + 1] + dy;
+        double modulus = zx * zx + zy * zy;
+        if (modulus > 4.0) return escapeValue<2, Features>(i, modulus);
+        if constexpr (kInteriorCheck) {
+            if (i > 0) {
+                derivative *= 4.0 * modulus;
+                if (derivative < view.interiorLimit) {
+                    caught++;
+                    return kInteriorIteration;
+                }
+            }
+        }
+
+        if (view.rebasing) {
+            if (modulus < dx * dx + dy * dy || m == last) {
+                dx = zx;
+                dy = zy;
+                m = 0;
+            }
+        } else {
+            double referenceX = orbit[2 * m];
+            double referenceY = orbit[2 * m + 1];
+            double reference = referenceX * referenceX + referenceY * referenceY;
+            bool exhausted = m == last && i + 1 < view.maxIterations;
+            if (modulus < kGlitchTolerance * reference || exhausted) return kGlitchIteration;
+        }
+
+        double tx = 2.0 * orbit[2 * m] + dx;
+        double ty = 2.0 * orbit[2 * m + 1] + dy;
+        double nextX = tx * dx - ty * dy + dcx;
+        dy = tx * dy + ty * dx + dcy;
+        dx = nextX;
+        m++;
+    }
+    return kInteriorIteration;
+}
+
+template <unsigned Features>
+void perturbationBlock(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    constexpr bool kCardioidCheck = (Features & kKernelCardioidCheck) != 0;
+
+    int caught = 0;
+    for (int y = y0; y < y1; y++) {
+        double pixelY = (view.height * 0.5 - (y + 0.5)) * view.scaleY;
+        double dcy = pixelY - view.referenceY;
+        float* row = image + static_cast<size_t>(y) * view.width;
+        for (int x = x0; x < x1; x++) {
+            if (view.glitchedOnly && row[x] != kGlitchIteration) continue;
+            double pixelX = (x + 0.5 - view.width * 0.5) * view.scaleX;
+            if constexpr (kCardioidCheck) {
+                if (safelyInMainCardioidOrBulb(view.offsetX.hi + pixelX, view.offsetY.hi + pixelY)) {
+                    row[x] = kInteriorIteration;
+                    continue;
+                }
+            }
+            row[x] = view.referenceOrbit
+                         ? perturbPoint<Features>(view, view.referenceOrbit, pixelX - view.referenceX, dcy, caught)
+                         : perturbPoint<Features>(view, view.compactReferenceOrbit, pixelX - view.referenceX, dcy,
+                                                  caught);
+        }
+    }
+    if (caught && view.interiorCaught) view.interiorCaught->fetch_add(caught, memory_order_relaxed);
+}
+
+// Feature sets never include kKernelJulia; this drops its bit from the index
+inline unsigned perturbationIndex(unsigned features) {
+    return (features & (kKernelCardioidCheck | kKernelSmoothColoring)) |
+           ((features & kKernelInteriorCheck) != 0 ? 4u : 0u);
+}
+
+const BlockKernel kPerturbationKernels[] = {
+    &perturbationBlock<0>,
+    &perturbationBlock<kKernelCardioidCheck>,
+    &perturbationBlock<kKernelSmoothColoring>,
+    &perturbationBlock<kKernelCardioidCheck | kKernelSmoothColoring>,
+    &perturbationBlock<kKernelInteriorCheck>,
+    &perturbationBlock<kKernelInteriorCheck | kKernelCardioidCheck>,
+    &perturbationBlock<kKernelInteriorCheck | kKernelSmoothColoring>,
+    &perturbationBlock<kKernelInteriorCheck | kKernelCardioidCheck | kKernelSmoothColoring>,
+};
+
+#ifdef MANDEL_X86_SIMD
+// perturbPoint for the listed pixels of a row, Lanes::kLanes at a time.
+// Lanes rebase independently, so each keeps its own offset into the
+// reference and the reference points are gathered per lane rather than
+// broadcast. A lane whose pixel finishes is refilled with the row's next
+// pixel straight away, so no lane idles while a slow neighbour runs on.
+template <class Lanes, unsigned Features, class Point>
+inline int perturbPoints(const KernelView& view, const Point* orbit, const double* dcx, double dcy,
+                         const int* points, int count, float* out) {
+    using Value = typename Lanes::Value;
+    using Index = typename Lanes::Index;
+    constexpr int kLanes = Lanes::kLanes;
+    constexpr bool kInteriorCheck = (Features & kKernelInteriorCheck) != 0;
+    // Without an iteration or a reference point there is nothing to gather;
+    // points count as bounded, as perturbPoint's empty loop leaves them
+    if (view.maxIterations <= 0 || view.referenceLength <= 0) {
+        for (int i = 0; i < count; i++) out[points[i]] = kInteriorIteration;
+        return 0;
+    }
+    const Value ci = Lanes::broadcast(dcy);
+    const Value one = Lanes::broadcast(1.0);
+    const Value four = Lanes::broadcast(4.0);
+    const Value interiorLimit = Lanes::broadcast(view.interiorLimit);
+    const Value tolerance = Lanes::broadcast(kGlitchTolerance);
+    const Index zeroIndex = Lanes::broadcastIndex(0);
+    const Index lastOffset = Lanes::broadcastIndex(2 * static_cast<int64_t>(view.referenceLength - 1));
+    const Index lastIteration = Lanes::broadcastIndex(view.maxIterations - 1);
+    const Index iterationLimit = Lanes::broadcastIndex(view.maxIterations);
+
+    int pixel[kLanes] = {};
+    double laneDcx[kLanes] = {};
+    Value dx = Lanes::zero();
+    Value dy = Lanes::zero();
+    Value cr = Lanes::zero();
+    Value derivative = one;
+    Index offset = zeroIndex;  // of Z_m in orbit, 2m
+    Index iteration = zeroIndex;
+    Index offsetStep = zeroIndex;  // 2 in active lanes, 0 in retired ones
+    Index iterationStep = zeroIndex;
+    int active = 0;
+    int next = 0;
+    int caught = 0;
+
+    // Start the next pixels in the given lanes, retiring lanes once the row runs out
+    auto refill = [&](int lanes) {
+        for (int lane = 0; lane < kLanes; lane++) {
+            if (!(lanes & (1 << lane))) continue;
+            if (next < count) {
+                pixel[lane] = points[next++];
+                laneDcx[lane] = dcx[pixel[lane]];
+                active |= 1 << lane;
+            } else {
+                active &= ~(1 << lane);
+            }
+        }
+        dx = Lanes::select(lanes, Lanes::zero(), dx);
+        dy = Lanes::select(lanes, Lanes::zero(), dy);
+        if constexpr (kInteriorCheck) derivative = Lanes::select(lanes, one, derivative);
+        cr = Lanes::load(laneDcx);
+        offset = Lanes::selectIndex(lanes, zeroIndex, offset);
+        iteration = Lanes::selectIndex(lanes, zeroIndex, iteration);
+        offsetStep = Lanes::selectIndex(active, Lanes::broadcastIndex(2), zeroIndex);
+        iterationStep = Lanes::selectIndex(active, Lanes::broadcastIndex(1), zeroIndex);
+    };
+    auto finish = [&](int lanes, float value) {
+        for (int lane = 0; lane < kLanes; lane++) {
+            if (lanes & (1 << lane)) out[pixel[lane]] = value;
+        }
+    };
+    refill((1 << kLanes) - 1);
+
+    while (active) {
+        Value orbitX = Lanes::gatherAt(orbit, offset);
+        Value orbitY = Lanes::gatherAt(orbit + 1, offset);
+        Value zx = Lanes::add(orbitX, dx);
+        Value zy = Lanes::add(orbitY, dy);
+        Value zx2 = Lanes::square(zx);
+        Value zy2 = Lanes::square(zy);
+        double modulus[kLanes];
+        int finished = Lanes::escaped(zx, zy, zx2, zy2, modulus) & active;
+        if (finished) {
+            int64_t iterations[kLanes];
+            Lanes::storeIndex(iterations, iteration);
+            for (int lane = 0; lane < kLanes; lane++) {
+                if (finished & (1 << lane)) {
+                    out[pixel[lane]] = escapeValue<2, Features>(static_cast<int>(iterations[lane]), modulus[lane]);
+                }
+            }
+        }
+        Value r2 = Lanes::add(zx2, zy2);
+        if constexpr (kInteriorCheck) {
+            // From z1 on, as z0 = 0 has derivative 0
+            int started = active & ~finished & ~Lanes::equalIndex(iteration, zeroIndex);
+            derivative = Lanes::select(started, Lanes::mul(derivative, Lanes::mul(four, r2)), derivative);
+            int interior = Lanes::lessThan(derivative, interiorLimit) & started;
+            if (interior) {
+                finish(interior, kInteriorIteration);
+                caught += __builtin_popcount(interior);
+                finished |= interior;
+            }
+        }
+
+        if (view.rebasing) {
+            int rebase = Lanes::lessThan(r2, Lanes::add(Lanes::square(dx), Lanes::square(dy))) |
+                         Lanes::equalIndex(offset, lastOffset);
+            if (rebase) {
+                dx = Lanes::select(rebase, zx, dx);
+                dy = Lanes::select(rebase, zy, dy);
+                orbitX = Lanes::select(rebase, Lanes::zero(), orbitX);
+                orbitY = Lanes::select(rebase, Lanes::zero(), orbitY);
+                offset = Lanes::selectIndex(rebase, zeroIndex, offset);
+            }
+        } else {
+            Value reference = Lanes::add(Lanes::square(orbitX), Lanes::square(orbitY));
+            int glitched = Lanes::lessThan(r2, Lanes::mul(tolerance, reference)) |
+                           (Lanes::equalIndex(offset, lastOffset) & ~Lanes::equalIndex(iteration, lastIteration));
+            glitched &= active & ~finished;
+            finish(glitched, kGlitchIteration);
+            finished |= glitched;
+        }
+
+        Value tx = Lanes::add(Lanes::twice(orbitX), dx);
+        Value ty = Lanes::add(Lanes::twice(orbitY), dy);
+        Value nextX = Lanes::add(Lanes::sub(Lanes::mul(tx, dx), Lanes::mul(ty, dy)), cr);
+        dy = Lanes::add(Lanes::add(Lanes::mul(tx, dy), Lanes::mul(ty, dx)), ci);
+        dx = nextX;
+        offset = Lanes::addIndex(offset, offsetStep);
+        iteration = Lanes::addIndex(iteration, iterationStep);
+
+        int bounded = Lanes::equalIndex(iteration, iterationLimit) & active & ~finished;
+        finish(bounded, kInteriorIteration);
+        finished |= bounded;
+        if (finished) refill(finished);
+    }
+    return caught;
+}
+
+template <class Lanes, unsigned Features>
+inline void perturbationBlockLanes(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    constexpr bool kCardioidCheck = (Features & kKernelCardioidCheck) != 0;
+
+    thread_local vector<double> pixelX;
+    thread_local vector<double> dcx;
+    thread_local vector<int> points;
+    int count = x1 - x0;
+    pixelX.resize(count);
+    dcx.resize(count);
+    for (int i = 0; i < count; i++) {
+        pixelX[i] = (x0 + i + 0.5 - view.width * 0.5) * view.scaleX;
+        dcx[i] = pixelX[i] - view.referenceX;
+    }
+
+    int caught = 0;
+    for (int y = y0; y < y1; y++) {
+        double pixelY = (view.height * 0.5 - (y + 0.5)) * view.scaleY;
+        double dcy = pixelY - view.referenceY;
+        float* row = image + static_cast<size_t>(y) * view.width + x0;
+
+        points.clear();
+        for (int i = 0; i < count; i++) {
+            if (view.glitchedOnly && row[i] != kGlitchIteration) continue;
+            if constexpr (kCardioidCheck) {
+                if (safelyInMainCardioidOrBulb(view.offsetX.hi + pixelX[i], view.offsetY.hi + pixelY)) {
+                    row[i] = kInteriorIteration;
+                    continue;
+                }
+            }
+            points.push_back(i);
+        }
+        if (points.empty()) continue;
+        if (view.referenceOrbit) {
+            caught += perturbPoints<Lanes, Features>(view, view.referenceOrbit, dcx.data(), dcy, points.data(),
+                                                     static_cast<int>(points.size()), row);
+        } else {
+            caught += perturbPoints<Lanes, Features>(view, view.compactReferenceOrbit, dcx.data(), dcy,
+                                                     points.data(), static_cast<int>(points.size()), row);
+        }
+    }
+    if (caught && view.interiorCaught) view.interiorCaught->fetch_add(caught, memory_order_relaxed);
+}
+
+template <unsigned Features>
+__attribute__((target("avx2,fma"), flatten))
+void perturbationBlockAvx2(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    perturbationBlockLanes<Avx2Lanes, Features>(view, x0, y0, x1, y1, image);
+}
+
+template <unsigned Features>
+__attribute__((target("avx512f"), flatten))
+void perturbationBlockAvx512(const KernelView& view, int x0, int y0, int x1, int y1, float* image) {
+    perturbationBlockLanes<Avx512Lanes, Features>(view, x0, y0, x1, y1, image);
+}
+
+const BlockKernel kPerturbationKernelsAvx2[] = {
+    &perturbationBlockAvx2<0>,
+    &perturbationBlockAvx2<kKernelCardioidCheck>,
+    &perturbationBlockAvx2<kKernelSmoothColoring>,
+    &perturbationBlockAvx2<kKernelCardioidCheck | kKernelSmoothColoring>,
+    &perturbationBlockAvx2<kKernelInteriorCheck>,
+    &perturbationBlockAvx2<kKernelInteriorCheck | kKernelCardioidCheck>,
+    &perturbationBlockAvx2<kKernelInteriorCheck | kKernelSmoothColoring>,
+    &perturbationBlockAvx2<kKernelInteriorCheck | kKernelCardioidCheck | kKernelSmoothColoring>,
+};
+
+const BlockKernel kPerturbationKernelsAvx512[] = {
+    &perturbationBlockAvx512<0>,
+    &perturbationBlockAvx512<kKernelCardioidCheck>,
+    &perturbationBlockAvx512<kKernelSmoothColoring>,
+    &perturbationBlockAvx512<kKernelCardioidCheck | kKernelSmoothColoring>,
+    &perturbationBlockAvx512<kKernelInteriorCheck>,
+    &perturbationBlockAvx512<kKernelInteriorCheck | kKernelCardioidCheck>,
+    &perturbationBlockAvx512<kKernelInteriorCheck | kKernelSmoothColoring>,
+    &perturbationBlockAvx512<kKernelInteriorCheck | kKernelCardioidCheck | kKernelSmoothColoring>,
+};
+#endif
+
+// Distance below which a returning orbit counts as periodic. Attracting
+// cycles converge geometrically, so a tight bound costs few iterations.
+const double kPeriodicityTolerance = 1e-10;
+
+// Membership of points of the Mandelbrot set for the double lane types.
+// Bounded orbits are cut short by Brent's cycle check: z is saved at
+// iterations 2^k and the point is periodic once a later z comes back to it.
+template <class Lanes>
+inline void classifyPoints(const double* cx, const double* cy, int count, int maxIterations,
+                           MembershipCounts& counts) {
+    using Value = typename Lanes::Value;
+    constexpr int kLanes = Lanes::kLanes;
+    constexpr int kAllDone = (1 << kLanes) - 1;
+
+    thread_local vector<int> points;
+    points.clear();
+    for (int i = 0; i < count; i++) {
+        if (inMainCardioidOrBulb(cx[i], cy[i])) {
+            counts.cardioid++;
+        } else {
+            points.push_back(i);
+        }
+    }
+    counts.points += count;
+
+    const Value tolerance = Lanes::broadcast(kPeriodicityTolerance);
+    int remaining = static_cast<int>(points.size());
+    for (int base = 0; base < remaining; base += kLanes) {
+        int lanes = min(kLanes, remaining - base);
+        int index[kLanes];
+        for (int lane = 0; lane < kLanes; lane++) index[lane] = points[base + min(lane, lanes - 1)];
+
+        // Padding lanes start out done so they are never counted
+        int doneMask = kAllDone & ~((1 << lanes) - 1);
+        const Value cr = Lanes::gather(cx, index);
+        const Value ci = Lanes::gather(cy, index);
+        Value zx = Lanes::zero(), zy = Lanes::zero();
+        Value savedX = zx, savedY = zy;
+        int saveAt = 1;
+        for (int i = 0; i < maxIterations; i++) {
+            Value zx2 = Lanes::square(zx);
+            Value zy2 = Lanes::square(zy);
+            double modulus[kLanes];
+            int escaped = Lanes::escaped(zx, zy, zx2, zy2, modulus) & ~doneMask;
+            if (escaped) {
+                counts.escaped += __builtin_popcount(escaped);
+                doneMask |= escaped;
+                if (doneMask == kAllDone) break;
+            }
+            zy = Lanes::mulAdd(Lanes::twice(zx), zy, ci);
+            zx = Lanes::add(Lanes::sub(zx2, zy2), cr);
+
+            Value distance = Lanes::add(Lanes::absolute(Lanes::sub(zx, savedX)),
+                                        Lanes::absolute(Lanes::sub(zy, savedY)));
+            int periodic = Lanes::lessThan(distance, tolerance) & ~doneMask;
+            if (periodic) {
+                counts.periodic += __builtin_popcount(periodic);
+                doneMask |= periodic;
+                if (doneMask == kAllDone) break;
+            }
+            if (i + 1 == saveAt) {
+                savedX = zx;
+                savedY = zy;
+                saveAt *= 2;
+            }
+        }
+        counts.undecided += __builtin_popcount(kAllDone & ~doneMask);
+    }
+}
+
+void membershipGeneric(const double* cx, const double* cy, int count, int maxIterations, MembershipCounts& counts) {
+    classifyPoints<DoubleLanes>(cx, cy, count, maxIterations, counts);
+}
+
+#ifdef MANDEL_X86_SIMD
+__attribute__((target("avx2,fma"), flatten))
+void membershipAvx2(const double* cx, const double* cy, int count, int maxIterations, MembershipCounts& counts) {
+    classifyPoints<Avx2Lanes>(cx, cy, count, maxIterations, counts);
+}
+
+__attribute__((target("avx512f"), flatten))
+void membershipAvx512(const double* cx, const double* cy, int count, int maxIterations, MembershipCounts& counts) {
+    classifyPoints<Avx512Lanes>(cx, cy, count, maxIterations, counts);
+}
+#endif
+
+// Fixed-point loop for a single point from z = (zx, zy), appending every z
+// to orbit until it holds `until` points. Returns |z|^2 of the escaping z,
+// or 0 if none escaped; (zx, zy) is left at the next z.
+template <int Limbs>
+inline double extendOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, FixedPoint<Limbs>& zx,
+                          FixedPoint<Limbs>& zy, size_t until, vector<double>& orbit) {
+    while (orbit.size() < 2 * until) {
+        orbit.push_back(zx.toDouble());
+        orbit.push_back(zy.toDouble());
+        FixedPoint<Limbs> zx2 = square(zx);
+        FixedPoint<Limbs> zy2 = square(zy);
+        FixedPoint<Limbs> r2 = zx2 + zy2;
+        if (r2.integerPart() >= 4) {
+            double modulus = r2.toDouble();
+            if (modulus > 4.0) return modulus;
+        }
+        zy = twice(zx * zy) + cy;
+        zx = zx2 - zy2 + cx;
+    }
+    return 0.0;
+}
+
+template <int Limbs>
+inline float recordFixedPointOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy,
+                                   int maxIterations, vector<double>& orbit) {
+    FixedPoint<Limbs> zx;
+    FixedPoint<Limbs> zy;
+    size_t first = orbit.size() / 2;
+    double modulus = extendOrbit(cx, cy, zx, zy, first + maxIterations, orbit);
+    if (modulus == 0.0) return kInteriorIteration;
+    return escapeValue<2, kKernelSmoothColoring>(static_cast<int>(orbit.size() / 2 - first - 1), modulus);
+}
+
+#ifdef MANDEL_X86_SIMD
+template <int Limbs>
+__attribute__((target("bmi2,adx"), flatten))
+float recordFixedPointOrbitBmi2(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, int maxIterations,
+                                vector<double>& orbit) {
+    return recordFixedPointOrbit(cx, cy, maxIterations, orbit);
+}
+
+template <int Limbs>
+__attribute__((target("bmi2,adx"), flatten))
+double extendOrbitBmi2(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, FixedPoint<Limbs>& zx,
+                       FixedPoint<Limbs>& zy, size_t until, vector<double>& orbit) {
+    return extendOrbit(cx, cy, zx, zy, until, orbit);
+}
+#endif
+
+} // namespace
+
+const char* kernelVariantName(KernelVariant variant) {
+    switch (variant) {
+        case KernelVariant::Scalar: return "scalar";
+        case KernelVariant::Avx2:   return "avx2";
+        case KernelVariant::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+bool parseKernelVariant(const string& name, KernelVariant& variant) {
+    for (KernelVariant candidate : {KernelVariant::Scalar, KernelVariant::Avx2, KernelVariant::Avx512}) {
+        if (name == kernelVariantName(candidate)) {
+            variant = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool kernelVariantSupported(KernelVariant variant) {
+    switch (variant) {
+        case KernelVariant::Scalar: return true;
+#ifdef MANDEL_X86_SIMD
+        case KernelVariant::Avx2:   return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case KernelVariant::Avx512: return __builtin_cpu_supports("avx512f");
+#else
+        default: return false;
+#endif
+    }
+    return false;
+}
+
+KernelVariant bestKernelVariant() {
+    if (kernelVariantSupported(KernelVariant::Avx512)) return KernelVariant::Avx512;
+    if (kernelVariantSupported(KernelVariant::Avx2)) return KernelVariant::Avx2;
+    return KernelVariant::Scalar;
+}
+
+const char* cpuPrecisionName(CpuPrecision precision) {
+    switch (precision) {
+        case CpuPrecision::Auto:         return "auto";
+        case CpuPrecision::Double:       return "double";
+        case CpuPrecision::DoubleDouble: return "double-double";
+        case CpuPrecision::Fixed128:     return "fixed128";
+        case CpuPrecision::Fixed192:     return "fixed192";
+        case CpuPrecision::Fixed256:     return "fixed256";
+        case CpuPrecision::Perturbation: return "perturbation";
+    }
+    return "unknown";
+}
+
+bool parseCpuPrecision(const string& name, CpuPrecision& precision) {
+    if (name == "auto") precision = CpuPrecision::Auto;
+    else if (name == "double") precision = CpuPrecision::Double;
+    else if (name == "dd" || name == "double-double") precision = CpuPrecision::DoubleDouble;
+    else if (name == "fixed128") precision = CpuPrecision::Fixed128;
+    else if (name == "fixed192") precision = CpuPrecision::Fixed192;
+    else if (name == "fixed256") precision = CpuPrecision::Fixed256;
+    else if (name == "perturbation") precision = CpuPrecision::Perturbation;
+    else return false;
+    return true;
+}
+
+BlockKernel selectBlockKernel(CpuPrecision precision, KernelVariant variant, Formula formula, unsigned features) {
+    if (features >= kKernelFeatureCombinations) return nullptr;
+
+    const KernelSet* set = nullptr;
+    switch (precision) {
+        case CpuPrecision::Double:
+            set = &kernelSet<KernelTarget::Generic, DoubleLanes>();
+#ifdef MANDEL_X86_SIMD
+            if (variant == KernelVariant::Avx2) set = &kernelSet<KernelTarget::Avx2, Avx2Lanes>();
+            if (variant == KernelVariant::Avx512) set = &kernelSet<KernelTarget::Avx512, Avx512Lanes>();
+#endif
+            break;
+        case CpuPrecision::DoubleDouble:
+            set = &kernelSet<KernelTarget::Generic, DoubleDoubleLanes>();
+#ifdef MANDEL_X86_SIMD
+            if (variant == KernelVariant::Avx2) set = &kernelSet<KernelTarget::Avx2, Avx2DoubleDoubleLanes>();
+            if (variant == KernelVariant::Avx512) set = &kernelSet<KernelTarget::Avx512, Avx512DoubleDoubleLanes>();
+#endif
+            break;
+        case CpuPrecision::Fixed128: set = &fixedPointKernelSet<2>(); break;
+        case CpuPrecision::Fixed192: set = &fixedPointKernelSet<3>(); break;
+        case CpuPrecision::Fixed256: set = &fixedPointKernelSet<4>(); break;
+        case CpuPrecision::Perturbation:
+            if (formula != Formula::Mandelbrot || (features & kKernelJulia) != 0) return nullptr;
+#ifdef MANDEL_X86_SIMD
+            if (variant == KernelVariant::Avx2) return kPerturbationKernelsAvx2[perturbationIndex(features)];
+            if (variant == KernelVariant::Avx512) return kPerturbationKernelsAvx512[perturbationIndex(features)];
+#endif
+            return kPerturbationKernels[perturbationIndex(features)];
+        case CpuPrecision::Auto: return nullptr;
+    }
+    return set->kernels[static_cast<int>(formula)][features];
+}
+
+MembershipKernel selectMembershipKernel(KernelVariant variant) {
+#ifdef MANDEL_X86_SIMD
+    if (variant == KernelVariant::Avx2) return &membershipAvx2;
+    if (variant == KernelVariant::Avx512) return &membershipAvx512;
+#else
+    (void)variant;
+#endif
+    return &membershipGeneric;
+}
+
+double exteriorDistance(const KernelView& view, int power, double x, double y, int maxIterations) {
+    // A far larger bailout than the kernels', so log|z| / |dz/dc| is close to its limit
+    const double kBailout = 1e20;
+    double cx = view.offsetX.hi + (x + 0.5 - view.width * 0.5) * view.scaleX;
+    double cy = view.offsetY.hi - (y + 0.5 - view.height * 0.5) * view.scaleY;
+    if (power == 2 && inMainCardioidOrBulb(cx, cy)) return 0.0;
+
+    double zx = 0.0, zy = 0.0;
+    double dx = 0.0, dy = 0.0;  // dz/dc
+    for (int i = 0; i < maxIterations; i++) {
+        // w = z^(power - 1), then dz <- power w dz + 1 and z <- w z + c
+        double wx = 1.0, wy = 0.0;
+        for (int k = 1; k < power; k++) {
+            double t = wx * zx - wy * zy;
+            wy = wx * zy + wy * zx;
+            wx = t;
+        }
+        double nextDx = power * (wx * dx - wy * dy) + 1.0;
+        dy = power * (wx * dy + wy * dx);
+        dx = nextDx;
+        double nextZx = wx * zx - wy * zy + cx;
+        zy = wx * zy + wy * zx + cy;
+        zx = nextZx;
+
+        double modulusSquared = zx * zx + zy * zy;
+        if (modulusSquared > kBailout) {
+            // With G = log|z_n| / power^n the Green's function, the distance
+            // is at least sinh(G) / (2 e^G |G'|) = (1 - e^-2G) / 2G * |z| log|z| / 2|dz|
+            double modulus = sqrt(modulusSquared);
+            double logModulus = log(modulus);
+            double green = logModulus / pow(static_cast<double>(power), i + 1);
+            double koebe = green > 0.0 ? -expm1(-2.0 * green) / (2.0 * green) : 1.0;
+            return koebe * modulus * logModulus / (2.0 * hypot(dx, dy)) / view.scaleY;
+        }
+    }
+    return 0.0;
+}
+
+template <int Limbs>
+float fixedPointOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, int maxIterations,
+                      vector<double>& orbit) {
+#ifdef MANDEL_X86_SIMD
+    if (hasBmi2Adx()) return recordFixedPointOrbitBmi2(cx, cy, maxIterations, orbit);
+#endif
+    return recordFixedPointOrbit(cx, cy, maxIterations, orbit);
+}
+
+template float fixedPointOrbit<2>(const FixedPoint<2>&, const FixedPoint<2>&, int, vector<double>&);
+template float fixedPointOrbit<3>(const FixedPoint<3>&, const FixedPoint<3>&, int, vector<double>&);
+template float fixedPointOrbit<4>(const FixedPoint<4>&, const FixedPoint<4>&, int, vector<double>&);
+
+template <int Limbs>
+bool extendFixedPointOrbit(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, FixedPoint<Limbs>& zx,
+                           FixedPoint<Limbs>& zy, int until, vector<double>& orbit) {
+#ifdef MANDEL_X86_SIMD
+    if (hasBmi2Adx()) return extendOrbitBmi2(cx, cy, zx, zy, until, orbit) != 0.0;
+#endif
+    return extendOrbit(cx, cy, zx, zy, until, orbit) != 0.0;
+}
+
+template bool extendFixedPointOrbit<2>(const FixedPoint<2>&, const FixedPoint<2>&, FixedPoint<2>&, FixedPoint<2>&,
+                                       int, vector<double>&);
+template bool extendFixedPointOrbit<3>(const FixedPoint<3>&, const FixedPoint<3>&, FixedPoint<3>&, FixedPoint<3>&,
+                                       int, vector<double>&);
+template bool extendFixedPointOrbit<4>(const FixedPoint<4>&, const FixedPoint<4>&, FixedPoint<4>&, FixedPoint<4>&,
+                                       int, vector<double>&);
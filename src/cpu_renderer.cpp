@@ -0,0 +1,781 @@
+#include "cpu_renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// Pre-pass pixels cover this many pixels along each edge
+const int kCostDownscale = 8;
+// Tiles estimated above 1 / (workers * kSplitShare) of the frame are split
+const double kSplitShare = 8.0;
+// Smallest subtile edge
+const int kMinSplitSize = 16;
+// Tile budgets start at this cap and grow by kBudgetGrowth per step
+const int kStartBudget = 256;
+const int kBudgetGrowth = 16;
+// Width of the side strips of a tile's edge, a vector of doubles on the widest kernels
+const int kEdgeStrip = 8;
+// Share of the guaranteed exterior disk that distance filling relies on
+const double kFillShare = 0.5;
+// Quadrants are tried while the disk reaches this share of the half diagonal
+const double kFillReach = 0.5;
+// Smallest rectangle distance filling splits down to
+const int kMinFillSize = 8;
+// Below this iteration value distance filling stays within one whole iteration
+const float kMinFillValue = 4.0f;
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+KernelView makeKernelView(const CpuView& view, CpuPrecision precision) {
+    KernelView result;
+    result.offsetX = DoubleDouble(view.offsetX, view.offsetXLo);
+    result.offsetY = DoubleDouble(view.offsetY, view.offsetYLo);
+    result.juliaX = view.juliaX;
+    result.juliaY = view.juliaY;
+    double aspectRatio = static_cast<double>(view.width) / static_cast<double>(view.height);
+    result.scaleX = view.zoom * aspectRatio * 2.0 / view.width;
+    result.scaleY = view.zoom * 2.0 / view.height;
+    result.width = view.width;
+    result.height = view.height;
+    result.maxIterations = view.maxIterations;
+
+    // Prefer the decimal offset for fixed point; double-double only carries about 32 digits
+    if (precision == CpuPrecision::Fixed128 || precision == CpuPrecision::Fixed192 ||
+        precision == CpuPrecision::Fixed256 || precision == CpuPrecision::Perturbation) {
+        using Fixed = FixedPoint<4>;
+        if (view.offsetXDigits.empty() || !Fixed::parse(view.offsetXDigits, result.fixedOffsetX)) {
+            result.fixedOffsetX = Fixed::fromDouble(view.offsetX) + Fixed::fromDouble(view.offsetXLo);
+        }
+        if (view.offsetYDigits.empty() || !Fixed::parse(view.offsetYDigits, result.fixedOffsetY)) {
+            result.fixedOffsetY = Fixed::fromDouble(view.offsetY) + Fixed::fromDouble(view.offsetYLo);
+        }
+    }
+    return result;
+}
+
+// View centre for perturbation references, from the decimal offset where
+// there is one, as only that carries digits past double-double
+ReferenceCoordinate referenceCoordinate(const string& digits, double high, double low) {
+    ReferenceCoordinate coordinate;
+    if (digits.empty() || !ReferenceCoordinate::parse(digits, coordinate)) {
+        coordinate = ReferenceCoordinate::fromDouble(high) + ReferenceCoordinate::fromDouble(low);
+    }
+    return coordinate;
+}
+
+// Palette blend of one iteration value into 8-bit RGB
+inline void colorizePixel(float value, int maxIterations, const float color[3], const float colorBg[3],
+                          uint8_t* rgb) {
+    for (int channel = 0; channel < 3; channel++) {
+        float mixed = 0.0f;
+        if (value != kInteriorIteration) {
+            float t = min(value / static_cast<float>(maxIterations), 1.0f);
+            mixed = colorBg[channel] + (color[channel] - colorBg[channel]) * t;
+        }
+        rgb[channel] = static_cast<uint8_t>(clamp(mixed, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+} // namespace
+
+void TileQueue::reset(int tileCount) {
+    if (tileCount != nodeCount) {
+        nodes = make_unique<Node[]>(tileCount);
+        nodeCount = tileCount;
+    }
+    for (int i = 0; i < nodeCount; i++) nodes[i].queued.store(false, memory_order_relaxed);
+    head.store(nullptr, memory_order_relaxed);
+}
+
+void TileQueue::push(int tileIndex, const TileRect& rect) {
+    if (tileIndex < 0 || tileIndex >= nodeCount) return;
+    Node& node = nodes[tileIndex];
+    // Counted before the flag is tested, so a drain that clears the flag
+    // after this push found it set still sees the push, and its pixels
+    node.pushes.fetch_add(1, memory_order_seq_cst);
+    if (node.queued.exchange(true, memory_order_seq_cst)) return;
+    node.rect = rect;
+    node.next = head.load(memory_order_relaxed);
+    // Release publishes the tile's pixels along with the node
+    while (!head.compare_exchange_weak(node.next, &node, memory_order_release, memory_order_relaxed)) {
+    }
+}
+
+void TileQueue::drain(vector<TileRect>& tiles) {
+    Node* node = head.exchange(nullptr, memory_order_acquire);
+    drained.clear();
+    for (; node; node = node->next) drained.push_back(node);
+    // The list is newest first; clear the flags only once the links are read,
+    // as a worker may push the tile again right after
+    for (auto it = drained.rbegin(); it != drained.rend(); ++it) {
+        tiles.push_back((*it)->rect);
+        (*it)->queued.store(false, memory_order_seq_cst);
+        // A push that found the flag still set returned without linking the
+        // node; reading the count after the clear acquires its pixels, which
+        // the consumer reads for this listing. Later pushes link it again.
+        (*it)->pushes.load(memory_order_seq_cst);
+    }
+}
+
+CpuRenderer::CpuRenderer(const CpuRenderSettings& settings)
+    : config(settings), topology(NumaTopology::detect()), reference(settings.orbitMemoryBudget) {
+    config.tileSize = clamp(config.tileSize, 8, kMaxTileSize);
+    if (!kernelVariantSupported(config.kernel)) {
+        config.kernel = bestKernelVariant();
+    }
+    int workerCount = config.threadCount > 0 ? config.threadCount
+                                             : max(1u, thread::hardware_concurrency());
+    placeByNode = config.numaAware && topology.nodeCount() > 1;
+
+    vector<pair<int, int>> slots = topology.interleavedCpus();
+
+    workers.resize(workerCount);
+    for (int i = 0; i < workerCount; i++) {
+        const auto& slot = slots[i % slots.size()];
+        workers[i].node = placeByNode ? slot.first : 0;
+        workers[i].cpu = slot.second;
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers[i].thread = thread(&CpuRenderer::workerLoop, this, i);
+    }
+}
+
+CpuRenderer::~CpuRenderer() {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        stopping = true;
+    }
+    poolWake.notify_all();
+    for (auto& worker : workers) {
+        if (worker.thread.joinable()) worker.thread.join();
+    }
+}
+
+void CpuRenderer::workerLoop(int index) {
+    if (placeByNode && pinCurrentThreadToCpu(workers[index].cpu)) {
+        pinnedCount++;
+    }
+
+    uint64_t seenGeneration = 0;
+    while (true) {
+        function<void(int)> job;
+        {
+            unique_lock<mutex> lock(poolMutex);
+            poolWake.wait(lock, [&] { return stopping || jobGeneration != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = jobGeneration;
+            job = currentJob;
+        }
+
+        job(index);
+
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (--pendingWorkers == 0) poolDone.notify_one();
+        }
+    }
+}
+
+void CpuRenderer::runOnWorkers(const function<void(int)>& job) {
+    unique_lock<mutex> lock(poolMutex);
+    currentJob = job;
+    pendingWorkers = static_cast<int>(workers.size());
+    jobGeneration++;
+    poolWake.notify_all();
+    poolDone.wait(lock, [&] { return pendingWorkers == 0; });
+    currentJob = nullptr;
+}
+
+bool CpuRenderer::ensureBuffer(int width, int height) {
+    if (width == bufferWidth && height == bufferHeight && buffer.data()) return true;
+
+    auto start = chrono::steady_clock::now();
+    size_t bytes = static_cast<size_t>(width) * static_cast<size_t>(height) * sizeof(float);
+    if (!buffer.allocate(bytes, config.hugePages)) {
+        cerr << "Failed to allocate " << bytes << " byte iteration buffer" << endl;
+        bufferWidth = bufferHeight = 0;
+        return false;
+    }
+    bufferWidth = width;
+    bufferHeight = height;
+    lastStats.allocateSeconds = secondsSince(start);
+    lastStats.pageMode = buffer.pageMode();
+
+    // One band of tile rows per node, sized by how many workers the node has
+    int nodeCount = placeByNode ? topology.nodeCount() : 1;
+    vector<int> workersPerNode(nodeCount, 0);
+    for (const auto& worker : workers) workersPerNode[worker.node]++;
+
+    tilesX = (width + config.tileSize - 1) / config.tileSize;
+    int tilesY = (height + config.tileSize - 1) / config.tileSize;
+    bands = vector<Band>(nodeCount);
+    int assignedRows = 0;
+    int assignedWorkers = 0;
+    for (int node = 0; node < nodeCount; node++) {
+        assignedWorkers += workersPerNode[node];
+        int endRow = static_cast<int>(static_cast<long long>(tilesY) * assignedWorkers / workers.size());
+        bands[node].firstTileRow = assignedRows;
+        bands[node].endTileRow = endRow;
+        assignedRows = endRow;
+    }
+
+    // First touch: each node's workers fault in their own band so the pages land locally
+    start = chrono::steady_clock::now();
+    vector<int> rankInNode(workers.size());
+    vector<int> seen(nodeCount, 0);
+    for (size_t i = 0; i < workers.size(); i++) rankInNode[i] = seen[workers[i].node]++;
+
+    char* base = static_cast<char*>(buffer.data());
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(float);
+    runOnWorkers([&](int index) {
+        const Band& band = bands[workers[index].node];
+        size_t first = min<size_t>(height, static_cast<size_t>(band.firstTileRow) * config.tileSize) * rowBytes;
+        size_t end = min<size_t>(height, static_cast<size_t>(band.endTileRow) * config.tileSize) * rowBytes;
+        int shareCount = workersPerNode[workers[index].node];
+        size_t shareBegin = first + (end - first) * rankInNode[index] / shareCount;
+        size_t shareEnd = first + (end - first) * (rankInNode[index] + 1) / shareCount;
+        memset(base + shareBegin, 0, shareEnd - shareBegin);
+    });
+    lastStats.firstTouchSeconds = secondsSince(start);
+    return true;
+}
+
+TileRect CpuRenderer::tileRect(int tile) const {
+    TileRect rect;
+    rect.x0 = (tile % tilesX) * config.tileSize;
+    rect.y0 = (tile / tilesX) * config.tileSize;
+    rect.x1 = min(rect.x0 + config.tileSize, bufferWidth);
+    rect.y1 = min(rect.y0 + config.tileSize, bufferHeight);
+    return rect;
+}
+
+void CpuRenderer::planTiles(const KernelView& view, BlockKernel kernel) {
+    auto start = chrono::steady_clock::now();
+    int tilesY = (view.height + config.tileSize - 1) / config.tileSize;
+    partsPerTile.assign(static_cast<size_t>(tilesX) * tilesY, 1);
+    partsLeft = make_unique<atomic<int>[]>(partsPerTile.size());
+    for (auto& band : bands) band.items.clear();
+    lastStats.estimateSeconds = 0.0;
+    lastStats.workItems = static_cast<int>(partsPerTile.size());
+    planned = true;
+
+    if (!config.costScheduling) {
+        for (auto& band : bands) {
+            for (int tile = band.firstTileRow * tilesX; tile < band.endTileRow * tilesX; tile++) {
+                band.items.push_back({tileRect(tile), tile, 0.0, kStartBudget});
+            }
+        }
+        return;
+    }
+
+    // Low-resolution pass over the same view, spread over the workers by row
+    KernelView coarse = view;
+    coarse.width = (view.width + kCostDownscale - 1) / kCostDownscale;
+    coarse.height = (view.height + kCostDownscale - 1) / kCostDownscale;
+    coarse.scaleX = view.scaleX * kCostDownscale;
+    coarse.scaleY = view.scaleY * kCostDownscale;
+    coarse.glitchedOnly = false;
+    coarse.interiorCaught = nullptr;
+    costImage.assign(static_cast<size_t>(coarse.width) * coarse.height, 0.0f);
+    atomic<int> nextRow{0};
+    runOnWorkers([&](int) {
+        int row;
+        while ((row = nextRow.fetch_add(1, memory_order_relaxed)) < coarse.height) {
+            kernel(coarse, 0, row, coarse.width, row + 1, costImage.data());
+        }
+    });
+
+    // Summed-area table of the estimated iterations per cell, plus one for the
+    // per-pixel overhead. Interior points run to the cap unless the cardioid
+    // check resolves them; glitched ones are at least as dear.
+    int cellsX = coarse.width;
+    int cellsY = coarse.height;
+    vector<double> sums(static_cast<size_t>(cellsX + 1) * (cellsY + 1), 0.0);
+    for (int y = 0; y < cellsY; y++) {
+        double rowSum = 0.0;
+        for (int x = 0; x < cellsX; x++) {
+            float value = costImage[static_cast<size_t>(y) * cellsX + x];
+            double cost = value;
+            if (value == kInteriorIteration) {
+                double cx = view.offsetX.hi + (x + 0.5 - cellsX * 0.5) * coarse.scaleX;
+                double cy = view.offsetY.hi - (y + 0.5 - cellsY * 0.5) * coarse.scaleY;
+                cost = cardioidResolved && inMainCardioidOrBulb(cx, cy) ? 0.0 : view.maxIterations;
+            } else if (value < 0.0f) {
+                cost = view.maxIterations;
+            }
+            rowSum += cost + 1.0;
+            sums[static_cast<size_t>(y + 1) * (cellsX + 1) + x + 1] =
+                sums[static_cast<size_t>(y) * (cellsX + 1) + x + 1] + rowSum;
+        }
+    }
+    // Cells overlapping a rectangle, so every item costs something
+    struct CellRange {
+        int x0, y0, x1, y1;
+    };
+    auto cellsOf = [&](const TileRect& rect) {
+        return CellRange{rect.x0 / kCostDownscale, rect.y0 / kCostDownscale,
+                         min(cellsX, (rect.x1 + kCostDownscale - 1) / kCostDownscale),
+                         min(cellsY, (rect.y1 + kCostDownscale - 1) / kCostDownscale)};
+    };
+    auto rectCost = [&](const TileRect& rect) {
+        CellRange cells = cellsOf(rect);
+        auto at = [&](int x, int y) { return sums[static_cast<size_t>(y) * (cellsX + 1) + x]; };
+        return at(cells.x1, cells.y1) - at(cells.x0, cells.y1) - at(cells.x1, cells.y0) + at(cells.x0, cells.y0);
+    };
+    // Tile budgets start above the slowest escape the pre-pass saw in the
+    // rectangle, and at the full cap if it saw bounded points there
+    auto startBudget = [&](const TileRect& rect) {
+        CellRange cells = cellsOf(rect);
+        float slowest = 0.0f;
+        for (int y = cells.y0; y < cells.y1; y++) {
+            for (int x = cells.x0; x < cells.x1; x++) {
+                float value = costImage[static_cast<size_t>(y) * cellsX + x];
+                if (value < 0.0f) return view.maxIterations;
+                slowest = max(slowest, value);
+            }
+        }
+        return min(view.maxIterations, max(kStartBudget, static_cast<int>(2.0f * slowest)));
+    };
+
+    double splitCost = sums.back() / (static_cast<double>(workers.size()) * kSplitShare);
+    function<void(vector<WorkItem>&, const TileRect&, int)> add = [&](vector<WorkItem>& items,
+                                                                       const TileRect& rect, int tile) {
+        double cost = rectCost(rect);
+        int width = rect.x1 - rect.x0;
+        int height = rect.y1 - rect.y0;
+        if (cost <= splitCost || width < 2 * kMinSplitSize || height < 2 * kMinSplitSize) {
+            items.push_back({rect, tile, cost, startBudget(rect)});
+            return;
+        }
+        // Quadrants on a multiple of the pre-pass cell so their estimates add up
+        int midX = rect.x0 + (width / 2 + kCostDownscale - 1) / kCostDownscale * kCostDownscale;
+        int midY = rect.y0 + (height / 2 + kCostDownscale - 1) / kCostDownscale * kCostDownscale;
+        partsPerTile[tile] += 3;
+        add(items, {rect.x0, rect.y0, midX, midY}, tile);
+        add(items, {midX, rect.y0, rect.x1, midY}, tile);
+        add(items, {rect.x0, midY, midX, rect.y1}, tile);
+        add(items, {midX, midY, rect.x1, rect.y1}, tile);
+    };
+    lastStats.workItems = 0;
+    for (auto& band : bands) {
+        for (int tile = band.firstTileRow * tilesX; tile < band.endTileRow * tilesX; tile++) {
+            add(band.items, tileRect(tile), tile);
+        }
+        stable_sort(band.items.begin(), band.items.end(),
+                    [](const WorkItem& a, const WorkItem& b) { return a.cost > b.cost; });
+        lastStats.workItems += static_cast<int>(band.items.size());
+    }
+    lastStats.estimateSeconds = secondsSince(start);
+}
+
+bool CpuRenderer::nextItem(int node, const WorkItem*& item) {
+    // Own band first, then steal from the others
+    int nodeCount = static_cast<int>(bands.size());
+    for (int step = 0; step < nodeCount; step++) {
+        Band& band = bands[(node + step) % nodeCount];
+        int local = band.nextItem.fetch_add(1, memory_order_relaxed);
+        if (local < static_cast<int>(band.items.size())) {
+            item = &band.items[local];
+            return true;
+        }
+    }
+    return false;
+}
+
+void CpuRenderer::renderWithBudget(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget) {
+    float* image = static_cast<float*>(buffer.data());
+    KernelView budgeted = view;
+    budgeted.maxIterations = budget;
+    // Edge pixels the interior check stops are redone on every raise, so only
+    // the last edge pass's count stands
+    atomic<int64_t> edgeCaught{0};
+    budgeted.interiorCaught = &edgeCaught;
+
+    // The edge: the top and bottom rows and a strip down each side. The
+    // kernels vectorise along rows, so the strips are a vector wide rather
+    // than single columns.
+    const TileRect edge[4] = {{rect.x0, rect.y0, rect.x1, rect.y0 + 1},
+                              {rect.x0, rect.y1 - 1, rect.x1, rect.y1},
+                              {rect.x0, rect.y0 + 1, rect.x0 + kEdgeStrip, rect.y1 - 1},
+                              {rect.x1 - kEdgeStrip, rect.y0 + 1, rect.x1, rect.y1 - 1}};
+    auto unresolvedAt = [&](int x, int y) { return image[static_cast<size_t>(y) * view.width + x] < 0.0f; };
+    auto edgeUnresolved = [&] {
+        for (const TileRect& part : edge) {
+            for (int y = part.y0; y < part.y1; y++) {
+                for (int x = part.x0; x < part.x1; x++) {
+                    if (unresolvedAt(x, y)) return true;
+                }
+            }
+        }
+        return false;
+    };
+    for (const TileRect& part : edge) kernel(budgeted, part.x0, part.y0, part.x1, part.y1, image);
+    while (budgeted.maxIterations < view.maxIterations && edgeUnresolved()) {
+        // An edge pixel in an attracting cycle means the set reaches the tile
+        budgeted.maxIterations = edgeCaught.load(memory_order_relaxed) > 0
+                                     ? view.maxIterations
+                                     : static_cast<int>(min<long long>(
+                                           static_cast<long long>(budgeted.maxIterations) * kBudgetGrowth,
+                                           view.maxIterations));
+        edgeCaught.store(0, memory_order_relaxed);
+        // Redo the runs of edge pixels still bounded (or glitched) at the last cap
+        for (const TileRect& part : edge) {
+            for (int y = part.y0; y < part.y1; y++) {
+                for (int x = part.x0; x < part.x1;) {
+                    if (!unresolvedAt(x, y)) {
+                        x++;
+                        continue;
+                    }
+                    int end = x + 1;
+                    while (end < part.x1 && unresolvedAt(end, y)) end++;
+                    kernel(budgeted, x, y, end, y + 1, image);
+                    x = end;
+                }
+            }
+        }
+    }
+
+    budgeted.interiorCaught = view.interiorCaught;
+    if (view.interiorCaught) {
+        view.interiorCaught->fetch_add(edgeCaught.load(memory_order_relaxed), memory_order_relaxed);
+    }
+    kernel(budgeted, rect.x0 + kEdgeStrip, rect.y0 + 1, rect.x1 - kEdgeStrip, rect.y1 - 1, image);
+    if (budgeted.maxIterations < view.maxIterations) reducedItems.fetch_add(1, memory_order_relaxed);
+}
+
+bool CpuRenderer::fillFromCorners(const KernelView& view, BlockKernel kernel, const TileRect& rect) {
+    float* image = static_cast<float*>(buffer.data());
+    auto at = [&](int x, int y) -> float& { return image[static_cast<size_t>(y) * view.width + x]; };
+    int right = rect.x1 - 1;
+    int top = rect.y1 - 1;
+    kernel(view, rect.x0, rect.y0, rect.x0 + 1, rect.y0 + 1, image);
+    kernel(view, right, rect.y0, rect.x1, rect.y0 + 1, image);
+    kernel(view, rect.x0, top, rect.x0 + 1, rect.y1, image);
+    kernel(view, right, top, rect.x1, rect.y1, image);
+    float v00 = at(rect.x0, rect.y0), v10 = at(right, rect.y0);
+    float v01 = at(rect.x0, top), v11 = at(right, top);
+    // Outside the set but slower than the cap
+    float lowest = min({v00, v10, v01, v11});
+    if (lowest < 0.0f) return false;
+    // The smooth count, computed at a bailout of 2, jumps visibly where the
+    // first few whole iterations change, so only interpolate within one there
+    float highest = max({v00, v10, v01, v11});
+    if (lowest < kMinFillValue && floor(lowest) != floor(highest)) return false;
+
+    float spanX = static_cast<float>(max(1, right - rect.x0));
+    float spanY = static_cast<float>(max(1, top - rect.y0));
+    for (int y = rect.y0; y < rect.y1; y++) {
+        float ty = (y - rect.y0) / spanY;
+        float left = v00 + (v01 - v00) * ty;
+        float rightValue = v10 + (v11 - v10) * ty;
+        for (int x = rect.x0; x < rect.x1; x++) {
+            at(x, y) = left + (rightValue - left) * ((x - rect.x0) / spanX);
+        }
+    }
+    filledPixels.fetch_add(static_cast<int64_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0) - 4,
+                           memory_order_relaxed);
+    return true;
+}
+
+void CpuRenderer::renderByDistance(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget) {
+    int width = rect.x1 - rect.x0;
+    int height = rect.y1 - rect.y0;
+    // The estimate's orbit gets the item's budget: a centre escaping later
+    // than that is too close to the set to cover anything
+    double radius = kFillShare * exteriorDistance(view, fillPower, 0.5 * (rect.x0 + rect.x1 - 1),
+                                                  0.5 * (rect.y0 + rect.y1 - 1),
+                                                  min(budget, view.maxIterations));
+    distanceEstimates.fetch_add(1, memory_order_relaxed);
+    double halfDiagonal = 0.5 * hypot(width - 1, height - 1);
+    if (radius >= halfDiagonal && fillFromCorners(view, kernel, rect)) return;
+    if (radius < kFillReach * halfDiagonal || width < 2 * kMinFillSize || height < 2 * kMinFillSize) {
+        renderPart(view, kernel, rect, budget);
+        return;
+    }
+    int midX = rect.x0 + width / 2;
+    int midY = rect.y0 + height / 2;
+    renderByDistance(view, kernel, {rect.x0, rect.y0, midX, midY}, budget);
+    renderByDistance(view, kernel, {midX, rect.y0, rect.x1, midY}, budget);
+    renderByDistance(view, kernel, {rect.x0, midY, midX, rect.y1}, budget);
+    renderByDistance(view, kernel, {midX, midY, rect.x1, rect.y1}, budget);
+}
+
+void CpuRenderer::renderPart(const KernelView& view, BlockKernel kernel, const TileRect& rect, int budget) {
+    // Glitch passes redo scattered pixels at the full cap
+    if (config.tileBudgets && !view.glitchedOnly && budget < view.maxIterations &&
+        rect.x1 - rect.x0 > 4 * kEdgeStrip && rect.y1 - rect.y0 > 4) {
+        renderWithBudget(view, kernel, rect, budget);
+    } else {
+        kernel(view, rect.x0, rect.y0, rect.x1, rect.y1, static_cast<float*>(buffer.data()));
+    }
+}
+
+void CpuRenderer::renderItem(const KernelView& view, BlockKernel kernel, const WorkItem& item) {
+    if (distanceFilling) {
+        renderByDistance(view, kernel, item.rect, item.budget);
+    } else {
+        renderPart(view, kernel, item.rect, item.budget);
+    }
+    // The last part of a tile to finish publishes the whole tile; acq_rel
+    // carries the other parts' pixels along to its push
+    if (partsLeft[item.tile].fetch_sub(1, memory_order_acq_rel) == 1 && progress.completedTiles) {
+        progress.completedTiles->push(item.tile, tileRect(item.tile));
+    }
+}
+
+void CpuRenderer::renderTiles(const KernelView& view, BlockKernel kernel) {
+    // Plan on the first pass, once a perturbation reference is in place, and
+    // reuse it for glitch passes
+    if (!planned) planTiles(view, kernel);
+    for (auto& band : bands) band.nextItem.store(0, memory_order_relaxed);
+    for (size_t tile = 0; tile < partsPerTile.size(); tile++) {
+        partsLeft[tile].store(partsPerTile[tile], memory_order_relaxed);
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<double> finished(workers.size(), 0.0);
+    runOnWorkers([&](int index) {
+        const WorkItem* item;
+        while (!cancelled() && nextItem(workers[index].node, item)) {
+            renderItem(view, kernel, *item);
+        }
+        finished[index] = secondsSince(start);
+    });
+    auto range = minmax_element(finished.begin(), finished.end());
+    lastStats.tailSeconds += *range.second - *range.first;
+}
+
+void CpuRenderer::renderPerturbed(KernelView& view, BlockKernel kernel, int referenceLimbs,
+                                  const ReferenceCoordinate& centreX, const ReferenceCoordinate& centreY) {
+    // Wide references share their steps with the workers, idle until the tiles
+    // start; never more than run at once, as a descheduled helper stalls every step
+    ReferenceTeam team;
+    team.threads = min(static_cast<int>(workers.size()), static_cast<int>(max(1u, thread::hardware_concurrency())));
+    team.minLimbs = config.referenceTeamLimbs;
+    team.run = [this](const function<void(int)>& job) { runOnWorkers(job); };
+    lastStats.referenceSeconds =
+        computeReferenceOrbit(centreX, centreY, referenceLimbs, view.maxIterations, reference, team);
+    lastStats.referenceOrbits = 1;
+    lastStats.referenceStorage = reference.storageName();
+    view.referenceOrbit = reference.doublePoints();
+    view.compactReferenceOrbit = reference.floatPoints();
+    view.referenceLength = reference.length();
+    view.referenceX = 0.0;
+    view.referenceY = 0.0;
+    view.rebasing = config.rebasing;
+    view.glitchedOnly = false;
+    if (cancelled()) return;
+    renderTiles(view, kernel);
+    if (config.rebasing) return;
+
+    view.glitchedOnly = true;
+    int x, y;
+    while (!cancelled() && lastStats.referenceOrbits < kMaxReferences && findGlitchCentre(x, y)) {
+        double pixelX = (x + 0.5 - view.width * 0.5) * view.scaleX;
+        double pixelY = (view.height * 0.5 - (y + 0.5)) * view.scaleY;
+        lastStats.referenceSeconds += computeReferenceOrbit(centreX + ReferenceCoordinate::fromDouble(pixelX),
+                                                            centreY + ReferenceCoordinate::fromDouble(pixelY),
+                                                            referenceLimbs, view.maxIterations, reference, team);
+        lastStats.referenceOrbits++;
+        view.referenceOrbit = reference.doublePoints();
+        view.compactReferenceOrbit = reference.floatPoints();
+        view.referenceLength = reference.length();
+        view.referenceX = pixelX;
+        view.referenceY = pixelY;
+        renderTiles(view, kernel);
+    }
+
+    // Past the reference limit, borrow the neighbour's value
+    float* image = static_cast<float*>(buffer.data());
+    for (int row = 0; row < view.height; row++) {
+        float* values = image + static_cast<size_t>(row) * view.width;
+        for (int column = 0; column < view.width; column++) {
+            if (values[column] != kGlitchIteration) continue;
+            lastStats.glitchedPixels++;
+            values[column] = column > 0 ? values[column - 1] : kInteriorIteration;
+        }
+    }
+}
+
+// Pixel nearest the centroid of the largest 4-connected group of glitched
+// pixels, which is where a new reference repairs the most of them
+bool CpuRenderer::findGlitchCentre(int& x, int& y) {
+    const float* image = static_cast<const float*>(buffer.data());
+    size_t count = static_cast<size_t>(bufferWidth) * bufferHeight;
+    vector<uint8_t> visited(count, 0);
+    vector<size_t> group;
+    vector<size_t> largest;
+    for (size_t seed = 0; seed < count; seed++) {
+        if (visited[seed] || image[seed] != kGlitchIteration) continue;
+        group.clear();
+        group.push_back(seed);
+        visited[seed] = 1;
+        for (size_t next = 0; next < group.size(); next++) {
+            size_t pixel = group[next];
+            int column = static_cast<int>(pixel % bufferWidth);
+            size_t neighbours[4] = {pixel - 1, pixel + 1, pixel - bufferWidth, pixel + bufferWidth};
+            bool valid[4] = {column > 0, column + 1 < bufferWidth, pixel >= static_cast<size_t>(bufferWidth),
+                             pixel + bufferWidth < count};
+            for (int i = 0; i < 4; i++) {
+                if (valid[i] && !visited[neighbours[i]] && image[neighbours[i]] == kGlitchIteration) {
+                    visited[neighbours[i]] = 1;
+                    group.push_back(neighbours[i]);
+                }
+            }
+        }
+        if (group.size() > largest.size()) swap(group, largest);
+    }
+    if (largest.empty()) return false;
+
+    double sumX = 0.0, sumY = 0.0;
+    for (size_t pixel : largest) {
+        sumX += static_cast<double>(pixel % bufferWidth);
+        sumY += static_cast<double>(pixel / bufferWidth);
+    }
+    double centreX = sumX / largest.size();
+    double centreY = sumY / largest.size();
+    double best = HUGE_VAL;
+    for (size_t pixel : largest) {
+        double dx = static_cast<double>(pixel % bufferWidth) - centreX;
+        double dy = static_cast<double>(pixel / bufferWidth) - centreY;
+        if (dx * dx + dy * dy < best) {
+            best = dx * dx + dy * dy;
+            x = static_cast<int>(pixel % bufferWidth);
+            y = static_cast<int>(pixel / bufferWidth);
+        }
+    }
+    return true;
+}
+
+int CpuRenderer::tileCount(int width, int height) const {
+    return ((width + config.tileSize - 1) / config.tileSize) * ((height + config.tileSize - 1) / config.tileSize);
+}
+
+bool CpuRenderer::render(const CpuView& view, const RenderProgress& renderProgress) {
+    if (view.width <= 0 || view.height <= 0) return false;
+    if (!ensureBuffer(view.width, view.height)) return false;
+
+    CpuPrecision precision = selectCpuPrecision(view, config.precision);
+    unsigned features = 0;
+    if (config.cardioidCheck) features |= kKernelCardioidCheck;
+    if (config.smoothColoring) features |= kKernelSmoothColoring;
+    if (view.julia) features |= kKernelJulia;
+    if (config.interiorThreshold > 0.0) features |= kKernelInteriorCheck;
+    BlockKernel kernel = selectBlockKernel(precision, config.kernel, view.formula, features);
+    if (!kernel) {
+        cerr << "No CPU kernel for formula " << formulaName(view.formula) << endl;
+        return false;
+    }
+    KernelView kernelView = makeKernelView(view, precision);
+    kernelView.interiorLimit = config.interiorThreshold * config.interiorThreshold;
+    kernelView.interiorCaught = &interiorCaught;
+
+    auto start = chrono::steady_clock::now();
+    lastStats.referenceOrbits = 0;
+    lastStats.referenceSeconds = 0.0;
+    lastStats.glitchedPixels = 0;
+    lastStats.tailSeconds = 0.0;
+    reducedItems.store(0, memory_order_relaxed);
+    interiorCaught.store(0, memory_order_relaxed);
+    planned = false;
+    cardioidResolved = config.cardioidCheck && view.formula == Formula::Mandelbrot && !view.julia;
+    // Interpolating whole iteration counts would smear their bands
+    const FormulaDescription& description = describeFormula(view.formula);
+    distanceFilling = config.distanceFill && config.smoothColoring && precision == CpuPrecision::Double &&
+                      !view.julia && !description.conjugate && !description.absolute;
+    fillPower = description.power;
+    filledPixels.store(0, memory_order_relaxed);
+    distanceEstimates.store(0, memory_order_relaxed);
+    progress = renderProgress;
+    if (precision == CpuPrecision::Perturbation) {
+        renderPerturbed(kernelView, kernel, referenceLimbs(requiredPrecisionBits(view)),
+                        referenceCoordinate(view.offsetXDigits, view.offsetX, view.offsetXLo),
+                        referenceCoordinate(view.offsetYDigits, view.offsetY, view.offsetYLo));
+    } else {
+        renderTiles(kernelView, kernel);
+    }
+    bool finished = !cancelled();
+    progress = RenderProgress();
+    if (!finished) return false;
+    lastStats.precision = precision;
+    lastStats.reducedItems = reducedItems.load(memory_order_relaxed);
+    lastStats.derivativeInterior = interiorCaught.load(memory_order_relaxed);
+    lastStats.filledPixels = filledPixels.load(memory_order_relaxed);
+    lastStats.distanceEstimates = distanceEstimates.load(memory_order_relaxed);
+    lastStats.renderSeconds = secondsSince(start);
+    lastStats.workerCount = static_cast<int>(workers.size());
+    lastStats.nodeCount = placeByNode ? topology.nodeCount() : 1;
+    lastStats.pinnedWorkers = pinnedCount.load();
+    return true;
+}
+
+double requiredPrecisionBits(const CpuView& view) {
+    // Bits needed to keep neighbouring pixels distinct, plus guard bits for the
+    // rounding error the iteration amplifies
+    double pixelSpacing = view.zoom * 2.0 / max(1, view.height);
+    double magnitude = max({fabs(view.offsetX), fabs(view.offsetY), 1.0});
+    return log2(magnitude / pixelSpacing) + 13.0;
+}
+
+CpuPrecision selectCpuPrecision(const CpuView& view, CpuPrecision requested) {
+    if (requested != CpuPrecision::Auto) return requested;
+
+    double requiredBits = requiredPrecisionBits(view);
+    if (requiredBits <= 53.0) return CpuPrecision::Double;
+    if (requiredBits <= 106.0) return CpuPrecision::DoubleDouble;
+    if (view.formula == Formula::Mandelbrot && !view.julia) return CpuPrecision::Perturbation;
+    if (requiredBits <= FixedPoint<2>::kFractionBits) return CpuPrecision::Fixed128;
+    if (requiredBits <= FixedPoint<3>::kFractionBits) return CpuPrecision::Fixed192;
+    return CpuPrecision::Fixed256;
+}
+
+int adaptiveIterationCount(int maxIterations, double zoom) {
+    double zoomFactor = 1.0 / zoom;
+    int iterations = static_cast<int>(maxIterations * (1.0 + log2(max(zoomFactor, 1.0)) * 0.1));
+    return min(iterations, 2000);
+}
+
+void colorizeIterations(const float* iterations, int width, int height, int maxIterations,
+                        const float color[3], const float colorBg[3], vector<uint8_t>& rgb) {
+    size_t count = static_cast<size_t>(width) * static_cast<size_t>(height);
+    rgb.resize(count * 3);
+    for (size_t i = 0; i < count; i++) {
+        colorizePixel(iterations[i], maxIterations, color, colorBg, &rgb[i * 3]);
+    }
+}
+
+void colorizeTile(const float* iterations, int width, const TileRect& rect, int maxIterations,
+                  const float color[3], const float colorBg[3], uint8_t* rgba) {
+    for (int y = rect.y0; y < rect.y1; y++) {
+        size_t row = static_cast<size_t>(y) * width;
+        for (int x = rect.x0; x < rect.x1; x++) {
+            uint8_t* pixel = rgba + (row + x) * 4;
+            colorizePixel(iterations[row + x], maxIterations, color, colorBg, pixel);
+            pixel[3] = 255;
+        }
+    }
+}
+
+bool writePpm(const string& path, const vector<uint8_t>& rgb, int width, int height) {
+    ofstream file(path, ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to open output image: " << path << endl;
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    // PPM stores rows top-down
+    size_t rowBytes = static_cast<size_t>(width) * 3;
+    for (int y = height - 1; y >= 0; y--) {
+        file.write(reinterpret_cast<const char*>(rgb.data() + y * rowBytes), rowBytes);
+    }
+    return static_cast<bool>(file);
+}
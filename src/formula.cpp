@@ -0,0 +1,69 @@
+#include "formula.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+const char* kFormulaBeginMarker = "// @formula-begin";
+const char* kFormulaEndMarker = "// @formula-end";
+
+// Statements raising w (initially z) to the given power, by the same
+// square-and-multiply chain as complexPower() in cpu_kernels.cpp
+void appendPower(ostringstream& code, int power) {
+    if (power == 1) return;
+    if (power % 2 == 0) {
+        appendPower(code, power / 2);
+        code << "    w = vec2(w.x * w.x - w.y * w.y, 2.0 * w.x * w.y);\n";
+    } else {
+        appendPower(code, power - 1);
+        code << "    w = vec2(w.x * z.x - w.y * z.y, w.x * z.y + w.y * z.x);\n";
+    }
+}
+
+} // namespace
+
+const char* formulaName(Formula formula) {
+    return describeFormula(formula).name;
+}
+
+bool parseFormula(const string& name, Formula& formula) {
+    for (int i = 0; i < kFormulaCount; i++) {
+        if (name == kFormulaDescriptions[i].name) {
+            formula = static_cast<Formula>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+string formulaGlsl(Formula formula) {
+    const FormulaDescription& description = describeFormula(formula);
+    ostringstream code;
+    code << "// " << description.name << ", generated from its formula description\n";
+    code << "vec2 formulaStep(PRECISION_QUALIFIER vec2 z, PRECISION_QUALIFIER vec2 c) {\n";
+    if (description.absolute) code << "    z = abs(z);\n";
+    if (description.conjugate) code << "    z.y = -z.y;\n";
+    code << "    PRECISION_QUALIFIER vec2 w = z;\n";
+    appendPower(code, description.power);
+    code << "    return w + c;\n";
+    code << "}\n\n";
+    // abs() and conjugation keep |f'(z)| = power |z|^(power - 1)
+    code << "float formulaDerivative(float r2) {\n";
+    code << "    return " << description.power * description.power << ".0";
+    for (int i = 1; i < description.power; i++) code << " * r2";
+    code << ";\n";
+    code << "}\n";
+    return code.str();
+}
+
+void insertFormulaGlsl(string& source, Formula formula) {
+    size_t begin = source.find(kFormulaBeginMarker);
+    if (begin == string::npos) return;
+    size_t end = source.find(kFormulaEndMarker, begin);
+    if (end == string::npos) return;
+    size_t codeBegin = source.find('\n', begin);
+    if (codeBegin == string::npos || codeBegin > end) return;
+    source.replace(codeBegin + 1, end - codeBegin - 1, formulaGlsl(formula));
+}
@@ -0,0 +1,263 @@
+#include "iteration_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// A new pyramid puts the first view's pixels this many levels above level 0,
+// and shifts leave as much room, so zooming on does not shift every frame
+const int kHeadroom = 8;
+// Cells further from the anchor than this are not kept, so tile coordinates fit 32 bits
+const double kMaxCellIndex = 1e11;
+// Sampling falls back at most this many levels, beyond which cells are too
+// coarse to say anything about a pixel
+const int kMaxFallback = 3;
+
+uint64_t tileKey(int64_t tileX, int64_t tileY) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(tileX)) << 32) | static_cast<uint32_t>(tileY);
+}
+
+double pixelSpacing(const CpuView& view) {
+    return view.zoom * 2.0 / view.height;
+}
+
+} // namespace
+
+bool IterationPyramid::accepts(const CpuView& view) {
+    return view.width > 0 && view.height > 0 && requiredPrecisionBits(view) <= 106.0;
+}
+
+bool IterationPyramid::sameFractal(const CpuView& view) const {
+    return view.formula == formula && view.julia == julia && view.juliaX == juliaX && view.juliaY == juliaY;
+}
+
+IterationPyramid::Placement IterationPyramid::place(const CpuView& view) const {
+    DoubleDouble dx = DoubleDouble(view.offsetX, view.offsetXLo) - anchorX;
+    DoubleDouble dy = DoubleDouble(view.offsetY, view.offsetYLo) - anchorY;
+    Placement placement;
+    placement.centreX = dx.hi + dx.lo;
+    placement.centreY = dy.hi + dy.lo;
+    placement.spacing = pixelSpacing(view);
+    return placement;
+}
+
+void IterationPyramid::reset(const CpuView& view) {
+    for (Level& level : levels) level.clear();
+    tileCount = 0;
+    anchorX = DoubleDouble(view.offsetX, view.offsetXLo);
+    anchorY = DoubleDouble(view.offsetY, view.offsetYLo);
+    baseSpacing = ldexp(pixelSpacing(view), -kHeadroom);
+    formula = view.formula;
+    julia = view.julia;
+    juliaX = view.juliaX;
+    juliaY = view.juliaY;
+    empty = false;
+    changes++;
+}
+
+void IterationPyramid::shift(int levelsUp) {
+    vector<Level> moved(kLevels);
+    for (int level = 0; level < kLevels; level++) {
+        int target = level - levelsUp;
+        if (target >= 0 && target < kLevels) {
+            moved[target] = move(levels[level]);
+        } else {
+            tileCount -= levels[level].size();
+        }
+    }
+    levels = move(moved);
+    baseSpacing = ldexp(baseSpacing, levelsUp);
+    changes++;
+}
+
+void IterationPyramid::evict(int keepFrom) {
+    // Finer levels go first; levels above the one being written are small
+    // and hold the widest context
+    for (int level = 0; level <= keepFrom && tileCount > kMaxTiles; level++) {
+        tileCount -= levels[level].size();
+        levels[level].clear();
+        changes++;
+    }
+}
+
+IterationPyramid::Tile* IterationPyramid::findTile(int level, int64_t tileX, int64_t tileY, bool create) {
+    Level& tiles = levels[level];
+    auto found = tiles.find(tileKey(tileX, tileY));
+    if (found != tiles.end()) return &found->second;
+    if (!create) return nullptr;
+    tileCount++;
+    return &tiles.emplace(tileKey(tileX, tileY), Tile(kTileCells * kTileCells, kUnknownIteration)).first->second;
+}
+
+// Cell indices may be negative: the shifts and masks below floor them
+void IterationPyramid::rebuildAbove(int level, int64_t i0, int64_t j0, int64_t i1, int64_t j1) {
+    const int64_t mask = kTileCells - 1;
+    for (int parent = level + 1; parent < kLevels; parent++) {
+        i0 >>= 1;
+        j0 >>= 1;
+        i1 >>= 1;
+        j1 >>= 1;
+        for (int64_t j = j0; j <= j1; j++) {
+            // Child rows 2j and 2j + 1 lie in one tile row, and each child
+            // tile holds the children of half a parent tile's row
+            for (int64_t childX = (2 * i0) >> kTileShift; childX <= (2 * i1 + 1) >> kTileShift; childX++) {
+                const Tile* child = findTile(parent - 1, childX, (2 * j) >> kTileShift, false);
+                if (!child) continue;
+                const float* lower = child->data() + ((2 * j) & mask) * kTileCells;
+                const float* upper = lower + kTileCells;
+                float* target = nullptr;
+                int64_t from = max(i0, (childX << kTileShift) >> 1);
+                int64_t to = min(i1, (((childX + 1) << kTileShift) >> 1) - 1);
+                for (int64_t i = from; i <= to; i++) {
+                    // Smooth counts average; a block mostly inside the set stays inside
+                    int64_t column = (2 * i) & mask;
+                    const float values[4] = {lower[column], lower[column + 1], upper[column], upper[column + 1]};
+                    float sum = 0.0f;
+                    int exterior = 0;
+                    int interior = 0;
+                    for (float value : values) {
+                        if (value == kUnknownIteration) continue;
+                        if (value == kInteriorIteration) {
+                            interior++;
+                        } else {
+                            sum += value;
+                            exterior++;
+                        }
+                    }
+                    if (exterior + interior == 0) continue;
+                    if (!target) {
+                        target = findTile(parent, i >> kTileShift, j >> kTileShift, true)->data() +
+                                 (j & mask) * kTileCells;
+                    }
+                    // A partly known block only fills a gap; a complete one
+                    // replaces what an earlier, coarser render left
+                    float& cell = target[i & mask];
+                    if (exterior + interior < 4 && cell != kUnknownIteration) continue;
+                    cell = exterior >= interior ? sum / exterior : kInteriorIteration;
+                }
+            }
+        }
+    }
+}
+
+void IterationPyramid::insert(const CpuView& view, const float* iterations, const TileRect& rect) {
+    if (!accepts(view)) return;
+    if (empty || !sameFractal(view)) reset(view);
+
+    Placement placement = place(view);
+    int level = static_cast<int>(lround(log2(placement.spacing / baseSpacing)));
+    if (level < 0) {
+        shift(level - kHeadroom);
+    } else if (level >= kLevels) {
+        shift(level - (kLevels - 1 - kHeadroom));
+    }
+    level = static_cast<int>(lround(log2(placement.spacing / baseSpacing)));
+    double size = ldexp(baseSpacing, level);
+    if (max(fabs(placement.centreX), fabs(placement.centreY)) / size > kMaxCellIndex) {
+        reset(view);
+        placement = place(view);
+        level = kHeadroom;
+        size = ldexp(baseSpacing, level);
+    }
+    if (tileCount > kMaxTiles) evict(level);
+
+    // Pixel columns and rows relative to the anchor: column x spans
+    // [left + x s, left + (x + 1) s), row y spans (top - (y + 1) s, top - y s]
+    double spacing = placement.spacing;
+    double left = placement.centreX - view.width * 0.5 * spacing;
+    double top = placement.centreY + view.height * 0.5 * spacing;
+    int64_t i0 = static_cast<int64_t>(floor((left + rect.x0 * spacing) / size));
+    int64_t i1 = static_cast<int64_t>(floor((left + rect.x1 * spacing) / size));
+    int64_t j0 = static_cast<int64_t>(floor((top - rect.y1 * spacing) / size));
+    int64_t j1 = static_cast<int64_t>(floor((top - rect.y0 * spacing) / size));
+    // Each cell takes the pixel under its centre: cell i's centre is in
+    // column floor(firstColumn + i * ratio), cell j's in row floor(firstRow - j * ratio)
+    double ratio = size / spacing;
+    double firstColumn = (0.5 * size - left) / spacing;
+    double firstRow = (top - 0.5 * size) / spacing;
+    const int64_t mask = kTileCells - 1;
+    for (int64_t j = j0; j <= j1; j++) {
+        int y = static_cast<int>(floor(firstRow - j * ratio));
+        if (y < rect.y0 || y >= rect.y1) continue;
+        const float* row = iterations + static_cast<size_t>(y) * view.width;
+        for (int64_t tileX = i0 >> kTileShift; tileX <= i1 >> kTileShift; tileX++) {
+            float* cells = nullptr;
+            int64_t to = min(i1, ((tileX + 1) << kTileShift) - 1);
+            for (int64_t i = max(i0, tileX << kTileShift); i <= to; i++) {
+                int x = static_cast<int>(floor(firstColumn + i * ratio));
+                if (x < rect.x0 || x >= rect.x1 || row[x] == kGlitchIteration) continue;
+                if (!cells) cells = findTile(level, tileX, j >> kTileShift, true)->data() + (j & mask) * kTileCells;
+                cells[i & mask] = row[x];
+            }
+        }
+    }
+    rebuildAbove(level, i0, j0, i1, j1);
+    changes++;
+}
+
+size_t IterationPyramid::sample(const CpuView& view, float* iterations) const {
+    if (empty || !accepts(view) || !sameFractal(view)) return 0;
+
+    Placement placement = place(view);
+    double spacing = placement.spacing;
+    double left = placement.centreX - view.width * 0.5 * spacing;
+    double top = placement.centreY + view.height * 0.5 * spacing;
+    int first = clamp(static_cast<int>(lround(log2(spacing / baseSpacing))), 0, kLevels - 1);
+    int last = min(kLevels - 1, first + kMaxFallback);
+    double finest = 1.0 / ldexp(baseSpacing, first);
+    double reach = max({fabs(left), fabs(left + view.width * spacing), fabs(top), fabs(top - view.height * spacing)});
+    if (reach * finest > kMaxCellIndex) return 0;
+
+    // Per level, pixel x's cell column is floor(columnStart + x * columnStep)
+    double inverseSizes[kLevels];
+    double columnStart[kLevels];
+    double columnStep[kLevels];
+    for (int level = first; level <= last; level++) {
+        inverseSizes[level] = ldexp(finest, first - level);
+        columnStart[level] = (left + 0.5 * spacing) * inverseSizes[level];
+        columnStep[level] = spacing * inverseSizes[level];
+    }
+    // Tile last read on each level, as neighbouring pixels mostly share it
+    struct Recent {
+        int64_t tileX = 0;
+        int64_t tileY = 0;
+        const Tile* tile = nullptr;
+        bool valid = false;
+    };
+    Recent recent[kLevels];
+
+    const int64_t mask = kTileCells - 1;
+    size_t written = 0;
+    for (int y = 0; y < view.height; y++) {
+        double v = top - (y + 0.5) * spacing;
+        int64_t cellRows[kLevels];
+        for (int level = first; level <= last; level++) {
+            cellRows[level] = static_cast<int64_t>(floor(v * inverseSizes[level]));
+        }
+        float* row = iterations + static_cast<size_t>(y) * view.width;
+        for (int x = 0; x < view.width; x++) {
+            for (int level = first; level <= last; level++) {
+                int64_t cellX = static_cast<int64_t>(floor(columnStart[level] + x * columnStep[level]));
+                int64_t cellY = cellRows[level];
+                Recent& cached = recent[level];
+                if (!cached.valid || cached.tileX != cellX >> kTileShift || cached.tileY != cellY >> kTileShift) {
+                    cached.tileX = cellX >> kTileShift;
+                    cached.tileY = cellY >> kTileShift;
+                    auto found = levels[level].find(tileKey(cached.tileX, cached.tileY));
+                    cached.tile = found == levels[level].end() ? nullptr : &found->second;
+                    cached.valid = true;
+                }
+                if (!cached.tile) continue;
+                float value = (*cached.tile)[(cellY & mask) * kTileCells + (cellX & mask)];
+                if (value == kUnknownIteration) continue;
+                row[x] = value;
+                written++;
+                break;
+            }
+        }
+    }
+    return written;
+}
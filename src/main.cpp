@@ -4,7 +4,9 @@
 
 // Use OpenGL 3.3+ core functions directly
 #ifdef __APPLE__
+#define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED
 #include <OpenGL/gl3.h>
+#include <OpenGL/gl.h>  // legacy calls of the CPU fallback window
 #else
 #include <GL/gl.h>
 #endif
@@ -17,9 +19,22 @@
 #include <map>
 #include <iomanip>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <deque>
+#include <atomic>
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "../include/stb_truetype.h"
+#include "../include/cpu_renderer.h"
+#include "../include/buddhabrot.h"
+#include "../include/area_estimate.h"
+#include "../include/minibrot.h"
+#include "../include/autotune.h"
+#include "../include/formula.h"
+#include "../include/iteration_pyramid.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -28,6 +43,13 @@
 using namespace std;
 using namespace sf;
 
+// Orbit density views drawn instead of the escape-time image
+enum class DensityMode {
+    Off,
+    Buddhabrot,
+    Nebulabrot,
+};
+
 // Mandelbrot set parameters
 struct MandelbrotParams {
     double zoom = 1.0;
@@ -37,6 +59,33 @@ struct MandelbrotParams {
     int colorMode = 0;
     int colorModeBg = 0;
     bool adaptiveIterations = true;
+
+    // Low-order parts (double-double) and full decimal digits of the offset,
+    // only used by CPU renders
+    double offsetXLo = 0.0;
+    double offsetYLo = 0.0;
+    string offsetXDigits;
+    string offsetYDigits;
+
+    // Iterated formula, shared by the shader and the CPU engine
+    Formula formula = Formula::Mandelbrot;
+
+    // Julia mode renders the Julia set of c = (juliaX, juliaY); the Mandelbrot
+    // view is kept to return to
+    bool juliaMode = false;
+    double juliaX = 0.0;
+    double juliaY = 0.0;
+    double mandelbrotZoom = 1.0;
+    double mandelbrotOffsetX = 0.0;
+    double mandelbrotOffsetY = 0.0;
+    double mandelbrotOffsetXLo = 0.0;
+    double mandelbrotOffsetYLo = 0.0;
+    string mandelbrotOffsetXDigits;
+    string mandelbrotOffsetYDigits;
+    bool showJuliaPreview = true;
+
+    DensityMode densityMode = DensityMode::Off;
+    bool hybrid = false;  // share escape-time frames between the GPU and the CPU engine
     
     // Mouse interaction state
     bool isDragging = false;
@@ -66,6 +115,10 @@ struct MandelbrotParams {
         zoom = 2.0;
         offsetX = 0.0;
         offsetY = 0.0;
+        offsetXLo = 0.0;
+        offsetYLo = 0.0;
+        offsetXDigits.clear();
+        offsetYDigits.clear();
         maxIterations = 100;
         colorMode = 0;
         adaptiveIterations = true;
@@ -78,6 +131,32 @@ enum ArgType {
     ARG_VSYNC,
     ARG_USE_DOUBLE,
     ARG_MAX_ITERS,
+    ARG_VIEW,
+    ARG_RENDER_CPU,
+    ARG_THREADS,
+    ARG_TILE_SIZE,
+    ARG_NO_NUMA,
+    ARG_NO_COST_SCHEDULING,
+    ARG_NO_TILE_BUDGETS,
+    ARG_NO_DISTANCE_FILL,
+    ARG_INTERIOR_THRESHOLD,
+    ARG_NO_HUGEPAGES,
+    ARG_KERNEL,
+    ARG_TUNE,
+    ARG_PRECISION,
+    ARG_ITERATIONS,
+    ARG_FORMULA,
+    ARG_NO_SMOOTH,
+    ARG_JULIA,
+    ARG_BUDDHABROT,
+    ARG_NEBULABROT,
+    ARG_SAMPLES,
+    ARG_AREA,
+    ARG_MINIBROT,
+    ARG_MULTI_REFERENCE,
+    ARG_ORBIT_MEMORY,
+    ARG_HYBRID,
+    ARG_CPU_WINDOW,
     ARG_UNKNOWN
 };
 
@@ -87,6 +166,32 @@ ArgType getArgType(const char* arg) {
     if (strcmp(arg, "--vsync") == 0)    return ARG_VSYNC;
     if (strcmp(arg, "--use-double") == 0) return ARG_USE_DOUBLE;
     if (strcmp(arg, "--max-iters") == 0) return ARG_MAX_ITERS;
+    if (strcmp(arg, "--view") == 0)     return ARG_VIEW;
+    if (strcmp(arg, "--render-cpu") == 0) return ARG_RENDER_CPU;
+    if (strcmp(arg, "--threads") == 0)  return ARG_THREADS;
+    if (strcmp(arg, "--tile-size") == 0) return ARG_TILE_SIZE;
+    if (strcmp(arg, "--no-numa") == 0)  return ARG_NO_NUMA;
+    if (strcmp(arg, "--no-cost-scheduling") == 0) return ARG_NO_COST_SCHEDULING;
+    if (strcmp(arg, "--no-tile-budgets") == 0) return ARG_NO_TILE_BUDGETS;
+    if (strcmp(arg, "--no-distance-fill") == 0) return ARG_NO_DISTANCE_FILL;
+    if (strcmp(arg, "--interior-threshold") == 0) return ARG_INTERIOR_THRESHOLD;
+    if (strcmp(arg, "--no-hugepages") == 0) return ARG_NO_HUGEPAGES;
+    if (strcmp(arg, "--kernel") == 0)   return ARG_KERNEL;
+    if (strcmp(arg, "--tune") == 0)     return ARG_TUNE;
+    if (strcmp(arg, "--precision") == 0) return ARG_PRECISION;
+    if (strcmp(arg, "--iterations") == 0) return ARG_ITERATIONS;
+    if (strcmp(arg, "--formula") == 0)  return ARG_FORMULA;
+    if (strcmp(arg, "--no-smooth") == 0) return ARG_NO_SMOOTH;
+    if (strcmp(arg, "--julia") == 0)    return ARG_JULIA;
+    if (strcmp(arg, "--buddhabrot") == 0) return ARG_BUDDHABROT;
+    if (strcmp(arg, "--nebulabrot") == 0) return ARG_NEBULABROT;
+    if (strcmp(arg, "--samples") == 0)  return ARG_SAMPLES;
+    if (strcmp(arg, "--area") == 0)     return ARG_AREA;
+    if (strcmp(arg, "--minibrot") == 0) return ARG_MINIBROT;
+    if (strcmp(arg, "--multi-reference") == 0) return ARG_MULTI_REFERENCE;
+    if (strcmp(arg, "--orbit-memory") == 0) return ARG_ORBIT_MEMORY;
+    if (strcmp(arg, "--hybrid") == 0) return ARG_HYBRID;
+    if (strcmp(arg, "--cpu-window") == 0) return ARG_CPU_WINDOW;
     return ARG_UNKNOWN;
 }
 
@@ -140,9 +245,11 @@ GLuint compileShader(const string& source, GLenum shaderType) {
 }
 
 // Function to create shader program
-GLuint createShaderProgram(const string& vertexPath, const string& fragmentPath, bool useDouble = false) {
+GLuint createShaderProgram(const string& vertexPath, const string& fragmentPath, bool useDouble = false,
+                           Formula formula = Formula::Mandelbrot, bool perturbation = false) {
     string vertexSource = readShaderFile(vertexPath);
     string fragmentSource = readShaderFile(fragmentPath);
+    insertFormulaGlsl(fragmentSource, formula);
     
     // Add double precision define if requested
     if (useDouble) {
@@ -152,6 +259,12 @@ GLuint createShaderProgram(const string& vertexPath, const string& fragmentPath,
             fragmentSource.insert(versionEnd + 1, "#define USE_DOUBLE_PRECISION\n");
         }
     }
+    if (perturbation) {
+        size_t versionEnd = fragmentSource.find('\n');
+        if (versionEnd != string::npos) {
+            fragmentSource.insert(versionEnd + 1, "#define USE_PERTURBATION\n");
+        }
+    }
     
     GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
     GLuint fragmentShader = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
@@ -161,18 +274,20 @@ GLuint createShaderProgram(const string& vertexPath, const string& fragmentPath,
     glAttachShader(program, fragmentShader);
     glLinkProgram(program);
     
-    // Check linking status
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    
+    // Check linking status; a failed compile fails the link too
     GLint success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         GLchar infoLog[512];
         glGetProgramInfoLog(program, 512, nullptr, infoLog);
         cerr << "Shader program linking failed: " << infoLog << endl;
+        glDeleteProgram(program);
+        return 0;
     }
     
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    
     return program;
 }
 
@@ -366,352 +481,1996 @@ public:
     }
 };
 
-int main(int argc, char* argv[]) {
-    // Initialize Mandelbrot parameters
-    MandelbrotParams params;
-    // Create context settings with depth buffer
-    ContextSettings settings;
-    settings.depthBits = 24;
-    settings.stencilBits = 8;
-    settings.majorVersion = 4;  // OpenGL 4.1 required for double precision
-    settings.minorVersion = 1;
-    settings.antiAliasingLevel = 4;
-    settings.attributeFlags = ContextSettings::Core;  // Request core profile
+// Point of the complex plane under a window position (y down), matching
+// the mapping in fragment.glsl
+void screenToComplex(const MandelbrotParams& params, int windowWidth, int windowHeight,
+                     double x, double y, double& re, double& im) {
+    double aspectRatio = static_cast<double>(windowWidth) / static_cast<double>(windowHeight);
+    re = params.offsetX + (x / windowWidth - 0.5) * params.zoom * aspectRatio * 2.0;
+    im = params.offsetY + (y / windowHeight - 0.5) * params.zoom * 2.0;
+}
 
-    bool useDouble = false; bool useVsync = true;
-    if (argc > 1) {
-        for (int i = 1; i < argc; i++) {
-            switch (getArgType(argv[i])) {
-                case ARG_NO_DEPTH:
-                    settings.depthBits = 0;
-                    settings.stencilBits = 0;
-                    break;
-                case ARG_AA: {
-                    if (i + 1 >= argc) {
-                        cerr << "Missing value for --aa" << endl;
-                        return -1;
-                    }
-                    int value = stoi(argv[++i]); // consume number
-                    if (value < 0 || value > 16) {
-                        cerr << "Anti-aliasing level must be between 0 and 16" << endl;
-                        return -1;
-                    }
-                    settings.antiAliasingLevel = value;
-                    break;
-                }
-                case ARG_VSYNC: {
-                    if (i + 1 >= argc) {
-                        cerr << "Missing value for --vsync (true/false)" << endl;
-                        return -1;
-                    }
-                    string val = argv[++i];
-                    if (val == "true") {
-                        useVsync = true;
-                    } else if (val == "false") {
-                        useVsync = false;
-                    } else {
-                        cerr << "Invalid value for --vsync (must be true/false)" << endl;
-                        return -1;
-                    }
-                    break;
-                }
-                case ARG_MAX_ITERS: {
-                    if (i + 1 >= argc) {
-                        cerr << "Missing value for --max-iters" << endl;
-                        return -1;
-                    }
-                    int value = stoi(argv[++i]); // consume number
-                    if (value < 0 || value > 1000) {
-                        cerr << "Max iterations must be between 0 and 1000" << endl;
-                        return -1;
-                    }
-                    params.maxIterations = value;
-                    break;
-                }
-                case ARG_USE_DOUBLE: useDouble = true; break;
-                case ARG_UNKNOWN: cerr << "Unknown argument: " << argv[i] << endl; return -1;
-            }
-        }
-    }
-    
-    // create the window with OpenGL context settings
-    Window window(VideoMode({1200, 800}), "Mandelbrot Set Explorer - C++", State::Windowed, settings);
-    window.setVerticalSyncEnabled(useVsync);
+// Zoom past which panning keeps the view centre in decimal digits as well,
+// before double-double runs out of them
+const double kCentreDigitsZoom = 1e-20;
 
-    // activate the window
-    if (!window.setActive(true)) {
-        cerr << "Warning: Failed to activate OpenGL context" << endl;
+// Deepest zoom the views go to: the zoom and the pixel offsets from a
+// reference are doubles, whose normal range ends at about 1e-308
+const double kDeepestZoom = 1e-290;
+
+// Full-precision view centre: the decimal digits when known, otherwise the
+// double-double offset
+void viewCentre(const MandelbrotParams& params, ReferenceCoordinate& x, ReferenceCoordinate& y) {
+    if (params.offsetXDigits.empty() || !ReferenceCoordinate::parse(params.offsetXDigits, x)) {
+        x = ReferenceCoordinate::fromDouble(params.offsetX) + ReferenceCoordinate::fromDouble(params.offsetXLo);
+    }
+    if (params.offsetYDigits.empty() || !ReferenceCoordinate::parse(params.offsetYDigits, y)) {
+        y = ReferenceCoordinate::fromDouble(params.offsetY) + ReferenceCoordinate::fromDouble(params.offsetYLo);
     }
+}
 
-    // Initialize OpenGL states
-    glDisable(GL_DEPTH_TEST);  // We don't need depth testing for 2D rendering
-    glDisable(GL_CULL_FACE);   // Disable face culling
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Black background
-    checkGLError("OpenGL initialization");
+// Move the view centre by (dx, dy), keeping the digits it carries beyond a
+// double so panning and zooming work at any depth
+void moveViewCentre(MandelbrotParams& params, double dx, double dy) {
+    if (!params.offsetXDigits.empty() || !params.offsetYDigits.empty() || params.zoom < kCentreDigitsZoom) {
+        ReferenceCoordinate x, y;
+        viewCentre(params, x, y);
+        x = x + ReferenceCoordinate::fromDouble(dx);
+        y = y + ReferenceCoordinate::fromDouble(dy);
+        params.offsetXDigits = x.toString();
+        params.offsetYDigits = y.toString();
+    }
+    DoubleDouble x = DoubleDouble(params.offsetX, params.offsetXLo) + DoubleDouble(dx);
+    DoubleDouble y = DoubleDouble(params.offsetY, params.offsetYLo) + DoubleDouble(dy);
+    params.offsetX = x.hi;
+    params.offsetXLo = x.lo;
+    params.offsetY = y.hi;
+    params.offsetYLo = y.lo;
+}
 
-    // Print OpenGL version info
-    cout << "OpenGL Version: " << glGetString(GL_VERSION) << endl;
-    cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
-    
-#ifdef __APPLE__
-    cout << "Note: On macOS, you may see 'FALLBACK' warnings - these are expected and don't affect functionality." << endl;
-#endif
+// Decimal form that reads back as the same double
+string decimalDigits(double value) {
+    stringstream stream;
+    stream << setprecision(17) << value;
+    return stream.str();
+}
 
-    // Create shader program
-    GLuint shaderProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/fragment.glsl", useDouble);
-    if (shaderProgram == 0) {
-        cerr << "Failed to create shader program!" << endl;
-        return -1;
+// Move the view onto the minibrot nearest to a point, searching a disc a
+// quarter of the view's height across, and zoom so the whole copy shows
+bool jumpToMinibrot(MandelbrotParams& params, const string& realDigits, const string& imagDigits) {
+    if (params.formula != Formula::Mandelbrot || params.juliaMode) {
+        cerr << "The minibrot finder needs the Mandelbrot formula outside Julia mode" << endl;
+        return false;
     }
-    cout << "Shader program created successfully!" << endl;
-    
-    // Initialize text renderer
-    TextRenderer textRenderer;
-    if (!textRenderer.initialize("res/OpenSans-Regular.ttf", 24)) {
-        cerr << "Failed to initialize text renderer!" << endl;
-        return -1;
+
+    Minibrot minibrot;
+    auto start = chrono::steady_clock::now();
+    if (!findMinibrot(realDigits, imagDigits, params.zoom * 0.25, MinibrotSearch(), minibrot)) {
+        return false;
     }
-    cout << "Text renderer initialized successfully!" << endl;
-    
-    // Fullscreen quad vertices (position only)
-    float vertices[] = {
-        -1.0f, -1.0f, 0.0f,  // Bottom left
-         1.0f, -1.0f, 0.0f,  // Bottom right
-         1.0f,  1.0f, 0.0f,  // Top right
-        -1.0f,  1.0f, 0.0f   // Top left
-    };
-    
-    // Quad indices
-    unsigned int indices[] = {
-        0, 1, 2,  // First triangle
-        2, 3, 0   // Second triangle
-    };
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-    // Generate and bind VAO, VBO, EBO
-    GLuint VAO, VBO, EBO;
-    
-    // Clear any existing OpenGL errors
-    while(glGetError() != GL_NO_ERROR);
-    
-    glGenVertexArrays(1, &VAO);
-    checkGLError("glGenVertexArrays");
-    
-    glGenBuffers(1, &VBO);
-    checkGLError("glGenBuffers VBO");
-    
-    glGenBuffers(1, &EBO);
-    checkGLError("glGenBuffers EBO");
+    params.offsetX = minibrot.real;
+    params.offsetY = minibrot.imag;
+    params.offsetXLo = minibrot.realLo;
+    params.offsetYLo = minibrot.imagLo;
+    params.offsetXDigits = minibrot.realDigits;
+    params.offsetYDigits = minibrot.imagDigits;
+    params.zoom = max(kMinibrotFraming * minibrot.size, kDeepestZoom);
 
-    glBindVertexArray(VAO);
-    checkGLError("glBindVertexArray");
+    cout << "Minibrot of period " << minibrot.period << ", size " << scientific << setprecision(3)
+         << minibrot.size << defaultfloat << ", rotated " << setprecision(1) << fixed
+         << minibrot.angle * 180.0 / M_PI << " degrees (" << minibrot.newtonSteps << " Newton steps, "
+         << setprecision(3) << seconds * 1000.0 << " ms)" << endl;
+    cout << "  --view " << minibrot.realDigits << " " << minibrot.imagDigits << " " << defaultfloat
+         << setprecision(6) << params.zoom << endl;
+    return true;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    checkGLError("glBindBuffer VBO");
-    
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    checkGLError("glBufferData VBO");
+// Picture-in-picture Julia set for the point under the cursor. While the
+// point moves the preview is redrawn every frame at a quarter of its size with
+// a small iteration budget; once the cursor has rested it is drawn once at
+// full size and budget and reused until the point changes.
+class JuliaPreview {
+public:
+    static const int kSize = 256;          // edge in window pixels
+    static const int kMargin = 10;
+    static const int kMovingDivisor = 4;
+    static const int kMovingIterations = 64;
+    static const int kRestingIterations = 500;
+    static constexpr float kRestSeconds = 0.25f;
+    static constexpr double kZoom = 1.5;   // shows the whole set
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    checkGLError("glBindBuffer EBO");
-    
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    checkGLError("glBufferData EBO");
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    GLuint shaderProgram = 0;
 
-    // Position attribute (location 0) - only position, no color
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    checkGLError("glVertexAttribPointer position");
-    
-    glEnableVertexAttribArray(0);
-    checkGLError("glEnableVertexAttribArray position");
+    JuliaPreview() {}
 
-    // Unbind to prevent accidental modification
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    checkGLError("VAO setup complete");
-    
-    cout << "Rendering setup complete!" << endl;
+    bool initialize() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kSize, kSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
 
-    // Get uniform locations for Mandelbrot parameters
-    GLint resolutionLoc = glGetUniformLocation(shaderProgram, "resolution");
-    GLint zoomLoc, offsetLoc;
-    
-    // Always use single precision uniforms (shader compatibility)
-    // But keep double precision on CPU side for better calculations
-    zoomLoc = glGetUniformLocation(shaderProgram, "zoom");
-    offsetLoc = glGetUniformLocation(shaderProgram, "offset");
-    
-    GLint maxIterationsLoc = glGetUniformLocation(shaderProgram, "maxIterations");
-    GLint colorLoc = glGetUniformLocation(shaderProgram, "color");
-    GLint colorBgLoc = glGetUniformLocation(shaderProgram, "colorBg");
-    GLint adaptiveIterationsLoc = glGetUniformLocation(shaderProgram, "adaptiveIterations");
-    
-    cout << "Uniform locations - resolution: " << resolutionLoc << ", zoom: " << zoomLoc 
-         << ", offset: " << offsetLoc << ", maxIterations: " << maxIterationsLoc 
-         << ", colorMode: " << colorLoc << ", adaptive: " << adaptiveIterationsLoc << endl;
-    
-    if (useDouble) {
-        cout << "Using double precision for CPU calculations with high precision shader" << endl;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete) {
+            cerr << "Julia preview framebuffer is incomplete" << endl;
+            return false;
+        }
+
+        // The default framebuffer may be multisampled, which rules out
+        // glBlitFramebuffer, so the result is drawn as a textured quad
+        shaderProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/preview_fragment.glsl");
+        return shaderProgram != 0;
     }
 
-    Clock clock;
-    
-    // FPS calculation variables
-    int frameCount = 0;
-    float fps = 0.0f;
-    Time fpsUpdateTime = clock.getElapsedTime();
-    
-    // Print controls
-    cout << "\n=== CONTROLS ===" << endl;
-    cout << "Mouse wheel: Zoom in/out" << endl;
-    cout << "Left click + drag: Pan view" << endl;
-    cout << "R: Reset view" << endl;
-    cout << "C: Cycle color modes" << endl;
-    cout << "V: Cycle color modes backwards" << endl;
-    cout << "B: Cycle background color modes" << endl;
-    cout << "N: Cycle background color modes backwards" << endl;
-    cout << "+/-: Increase/decrease iterations" << endl;
-    cout << "A: Toggle adaptive iterations" << endl;
-    cout << "ESC: Exit" << endl;
-    
-    // run the main loop
-    bool running = true;
-    while (running) {
-        // handle events
-        while (const optional event = window.pollEvent()) {
-            if (event->is<Event::Closed>()) {
-                running = false;
-            }
-            else if (const auto* resized = event->getIf<Event::Resized>()) {
-                glViewport(0, 0, resized->size.x, resized->size.y);
-            }
-            else if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
-                switch (keyPressed->code) {
-                    case Keyboard::Key::Escape:
-                        running = false;
-                        break;
-                    case Keyboard::Key::R:
-                        params.reset();
-                        cout << "View reset" << endl;
-                        break;
-                    case Keyboard::Key::C:
-                        params.colorMode = (params.colorMode + 1) % params.colors.size();
-                        break;
-                    case Keyboard::Key::V:
-                        params.colorMode = (params.colorMode - 1 + params.colors.size()) % params.colors.size();
-                        break;
-                    case Keyboard::Key::B:
-                        params.colorModeBg = (params.colorModeBg + 1) % params.colors.size();
-                        break;
-                    case Keyboard::Key::N:
-                        params.colorModeBg = (params.colorModeBg - 1 + params.colors.size()) % params.colors.size();
-                        break;
-                    case Keyboard::Key::Equal:  // + key
-                        params.maxIterations = min(1000, params.maxIterations + 10);
-                        break;
-                    case Keyboard::Key::Hyphen:  // - key
-                        params.maxIterations = max(10, params.maxIterations - 10);
-                        break;
-                    case Keyboard::Key::A:  // Toggle adaptive iterations
-                        params.adaptiveIterations = !params.adaptiveIterations;
-                        break;
-                    default:
-                        break;
-                }
-            }
-            else if (const auto* mouseButtonPressed = event->getIf<Event::MouseButtonPressed>()) {
-                if (mouseButtonPressed->button == Mouse::Button::Left) {
-                    params.isDragging = true;
-                    params.lastMouseX = static_cast<float>(mouseButtonPressed->position.x);
-                    params.lastMouseY = static_cast<float>(mouseButtonPressed->position.y);
-                }
-            }
-            else if (const auto* mouseButtonReleased = event->getIf<Event::MouseButtonReleased>()) {
-                if (mouseButtonReleased->button == Mouse::Button::Left) {
-                    params.isDragging = false;
-                }
-            }
-            else if (const auto* mouseMoved = event->getIf<Event::MouseMoved>()) {
-                if (params.isDragging) {
-                    float deltaX = static_cast<float>(mouseMoved->position.x) - params.lastMouseX;
-                    float deltaY = static_cast<float>(mouseMoved->position.y) - params.lastMouseY;
-                    
-                    // Convert screen coordinates to complex plane coordinates
-                    Vector2u windowSize = window.getSize();
-                    double aspectRatio = static_cast<double>(windowSize.x) / static_cast<double>(windowSize.y);
-                    
-                    params.offsetX -= (static_cast<double>(deltaX) / static_cast<double>(windowSize.x)) * params.zoom * aspectRatio * 2.0;
-                    params.offsetY -= (static_cast<double>(deltaY) / static_cast<double>(windowSize.y)) * params.zoom * 2.0;
-                    
-                    params.lastMouseX = static_cast<float>(mouseMoved->position.x);
-                    params.lastMouseY = static_cast<float>(mouseMoved->position.y);
-                }
-            }
-            else if (const auto* mouseWheelScrolled = event->getIf<Event::MouseWheelScrolled>()) {
-                if (mouseWheelScrolled->wheel == Mouse::Wheel::Vertical) {
-                    // Smaller zoom steps for more precise control
-                    double zoomFactor = mouseWheelScrolled->delta > 0 ? 0.85 : 1.176;
-                    
-                    // Get mouse position relative to center
-                    Vector2i mousePos = Mouse::getPosition(window);
-                    Vector2u windowSize = window.getSize();
-                    
-                    double mouseX = (static_cast<double>(mousePos.x) / static_cast<double>(windowSize.x) - 0.5) * 2.0;
-                    double mouseY = -(static_cast<double>(mousePos.y) / static_cast<double>(windowSize.y) - 0.5) * 2.0;
-                    
-                    double aspectRatio = static_cast<double>(windowSize.x) / static_cast<double>(windowSize.y);
-                    mouseX *= aspectRatio;
-                    
-                    // Convert to complex plane coordinates
-                    double complexX = mouseX * params.zoom + params.offsetX;
-                    double complexY = mouseY * params.zoom + params.offsetY;
-                    
-                    // Zoom
-                    params.zoom *= zoomFactor;
-                    
-                    // Adjust offset to zoom towards mouse position
-                    params.offsetX = complexX - mouseX * params.zoom;
-                    params.offsetY = complexY - mouseY * params.zoom;
-                }
-            }
+    // Refresh the preview for c = (re, im) if needed and draw it in the
+    // bottom-right corner. fractalProgram is the main shader, whose uniforms
+    // are left set for the preview afterwards.
+    void render(GLuint fractalProgram, GLuint quadVAO, const MandelbrotParams& params, double re, double im,
+                float now, int windowWidth, int windowHeight) {
+        if (re != pointX || im != pointY) {
+            pointX = re;
+            pointY = im;
+            lastMoveTime = now;
+            refined = false;
         }
 
-        // clear the buffers
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (!refined) {
+            bool resting = now - lastMoveTime >= kRestSeconds;
+            renderedSize = resting ? kSize : kSize / kMovingDivisor;
+            drawJulia(fractalProgram, quadVAO, params, resting ? kRestingIterations : kMovingIterations);
+            refined = resting;
+        }
 
-        // Use shader program
+        glViewport(windowWidth - kSize - kMargin, kMargin, kSize, kSize);
         glUseProgram(shaderProgram);
+        glUniform1i(glGetUniformLocation(shaderProgram, "image"), 0);
+        float scale = static_cast<float>(renderedSize) / kSize;
+        glUniform2f(glGetUniformLocation(shaderProgram, "textureScale"), scale, scale);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+    }
 
-        // Get current window size for resolution uniform
-        Vector2u windowSize = window.getSize();
-        
-        // Set uniforms for Mandelbrot rendering
+    // Force a redraw, e.g. after the fractal program changed
+    void invalidate() {
+        pointX = NAN;
+        pointY = NAN;
+        refined = false;
+    }
+
+    ~JuliaPreview() {
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (texture) glDeleteTextures(1, &texture);
+        if (shaderProgram) glDeleteProgram(shaderProgram);
+    }
+
+private:
+    double pointX = NAN;
+    double pointY = NAN;
+    float lastMoveTime = 0.0f;
+    bool refined = false;
+    int renderedSize = kSize;
+
+    void drawJulia(GLuint program, GLuint quadVAO, const MandelbrotParams& params, int iterations) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, renderedSize, renderedSize);
+        glUseProgram(program);
+
+        const Vector3f& color = params.colors[params.colorMode];
+        const Vector3f& colorBg = params.colorsBg[params.colorModeBg];
+        glUniform2f(glGetUniformLocation(program, "resolution"), renderedSize, renderedSize);
+        glUniform2f(glGetUniformLocation(program, "origin"), 0.0f, 0.0f);
+        glUniform1f(glGetUniformLocation(program, "zoom"), static_cast<float>(kZoom));
+        glUniform2f(glGetUniformLocation(program, "offset"), 0.0f, 0.0f);
+        glUniform1i(glGetUniformLocation(program, "maxIterations"), iterations);
+        glUniform3f(glGetUniformLocation(program, "color"), color.x, color.y, color.z);
+        glUniform3f(glGetUniformLocation(program, "colorBg"), colorBg.x, colorBg.y, colorBg.z);
+        glUniform1i(glGetUniformLocation(program, "adaptiveIterations"), 0);
+        glUniform1i(glGetUniformLocation(program, "juliaMode"), 1);
+        glUniform2f(glGetUniformLocation(program, "juliaC"), static_cast<float>(pointX), static_cast<float>(pointY));
+
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+// The explorer's view for the CPU engine, with the shader's iteration count
+CpuView cpuViewOf(const MandelbrotParams& params, int width, int height) {
+    CpuView view;
+    view.offsetX = params.offsetX;
+    view.offsetY = params.offsetY;
+    view.offsetXLo = params.offsetXLo;
+    view.offsetYLo = params.offsetYLo;
+    view.offsetXDigits = params.offsetXDigits;
+    view.offsetYDigits = params.offsetYDigits;
+    view.zoom = params.zoom;
+    view.width = width;
+    view.height = height;
+    view.formula = params.formula;
+    view.julia = params.juliaMode;
+    view.juliaX = params.juliaX;
+    view.juliaY = params.juliaY;
+    view.maxIterations = params.adaptiveIterations ? adaptiveIterationCount(params.maxIterations, params.zoom)
+                                                   : params.maxIterations;
+    return view;
+}
+
+// Render the current view on the CPU engine without opening a window
+int renderHeadless(const MandelbrotParams& params, const CpuRenderSettings& cpuSettings,
+                   int width, int height, int iterations, const string& outputPath) {
+    CpuRenderer renderer(cpuSettings);
+
+    CpuView view = cpuViewOf(params, width, height);
+    // Deep views need far more than the shader's adaptive cap, so allow an explicit count
+    if (iterations > 0) view.maxIterations = iterations;
+
+    if (!renderer.render(view)) {
+        cerr << "CPU render failed!" << endl;
+        return -1;
+    }
+
+    const CpuRenderStats& stats = renderer.stats();
+    double megapixels = static_cast<double>(width) * height / 1e6;
+    cout << fixed << setprecision(3);
+    cout << "CPU render " << width << "x" << height << " (" << megapixels << " Mpixel), "
+         << view.maxIterations << " iterations" << endl;
+    cout << "Kernel: " << kernelVariantName(renderer.settings().kernel) << ", "
+         << cpuPrecisionName(stats.precision) << ", tile size " << renderer.settings().tileSize << endl;
+    cout << "Workers: " << stats.workerCount << " on " << stats.nodeCount << " NUMA node(s), "
+         << stats.pinnedWorkers << " pinned" << endl;
+    cout << "Huge pages: " << stats.pageMode << endl;
+    if (stats.precision == CpuPrecision::Perturbation) {
+        cout << "Reference orbits: " << stats.referenceOrbits << " (" << stats.referenceSeconds * 1000.0
+             << " ms, " << (renderer.settings().rebasing ? "rebasing" : "multi-reference") << ", "
+             << stats.referenceStorage << " storage), glitched pixels left: "
+             << stats.glitchedPixels << endl;
+    }
+    cout << "Allocate: " << stats.allocateSeconds * 1000.0 << " ms, first touch: "
+         << stats.firstTouchSeconds * 1000.0 << " ms, render: "
+         << stats.renderSeconds * 1000.0 << " ms ("
+         << megapixels / stats.renderSeconds << " Mpixel/s)" << endl;
+    if (renderer.settings().costScheduling) {
+        cout << "Scheduling: cost estimate " << stats.estimateSeconds * 1000.0 << " ms, " << stats.workItems
+             << " work items, tail " << stats.tailSeconds * 1000.0 << " ms" << endl;
+    } else {
+        cout << "Scheduling: row order, tail " << stats.tailSeconds * 1000.0 << " ms" << endl;
+    }
+    if (renderer.settings().interiorThreshold > 0.0) {
+        cout << "Interior check: " << stats.derivativeInterior << " pixels stopped by |dz| < "
+             << defaultfloat << renderer.settings().interiorThreshold << fixed << endl;
+    }
+    if (renderer.settings().tileBudgets) {
+        cout << "Tile budgets: " << stats.reducedItems << " of " << stats.workItems
+             << " work items stopped below the iteration cap" << endl;
+    }
+    if (renderer.settings().distanceFill) {
+        double share = 100.0 * stats.filledPixels / (static_cast<double>(width) * height);
+        cout << "Distance fill: " << stats.filledPixels << " pixels (" << share << "%) filled from "
+             << stats.distanceEstimates << " estimates" << endl;
+    }
+
+    vector<uint8_t> rgb;
+    const Vector3f& color = params.colors[params.colorMode];
+    const Vector3f& colorBg = params.colorsBg[params.colorModeBg];
+    float colorValues[3] = {color.x, color.y, color.z};
+    float colorBgValues[3] = {colorBg.x, colorBg.y, colorBg.z};
+    colorizeIterations(renderer.iterations(), width, height, iterations > 0 ? iterations : params.maxIterations,
+                       colorValues, colorBgValues, rgb);
+    if (!writePpm(outputPath, rgb, width, height)) {
+        return -1;
+    }
+    cout << "Wrote " << outputPath << endl;
+    return 0;
+}
+
+// Navigation shared by the shader explorer and the CPU fallback window:
+// zooming, panning, palettes, iterations, Julia mode and the minibrot jump
+void handleViewInput(const Event& event, MandelbrotParams& params, const Window& window) {
+    if (const auto* keyPressed = event.getIf<Event::KeyPressed>()) {
+        switch (keyPressed->code) {
+            case Keyboard::Key::R:
+                params.reset();
+                cout << "View reset" << endl;
+                break;
+            case Keyboard::Key::C:
+                params.colorMode = (params.colorMode + 1) % params.colors.size();
+                break;
+            case Keyboard::Key::V:
+                params.colorMode = (params.colorMode - 1 + params.colors.size()) % params.colors.size();
+                break;
+            case Keyboard::Key::B:
+                params.colorModeBg = (params.colorModeBg + 1) % params.colors.size();
+                break;
+            case Keyboard::Key::N:
+                params.colorModeBg = (params.colorModeBg - 1 + params.colors.size()) % params.colors.size();
+                break;
+            case Keyboard::Key::Equal:  // + key
+                params.maxIterations = min(1000, params.maxIterations + 10);
+                break;
+            case Keyboard::Key::Hyphen:  // - key
+                params.maxIterations = max(10, params.maxIterations - 10);
+                break;
+            case Keyboard::Key::A:  // Toggle adaptive iterations
+                params.adaptiveIterations = !params.adaptiveIterations;
+                break;
+            case Keyboard::Key::J: {
+                if (params.juliaMode) {
+                    params.juliaMode = false;
+                    params.zoom = params.mandelbrotZoom;
+                    params.offsetX = params.mandelbrotOffsetX;
+                    params.offsetY = params.mandelbrotOffsetY;
+                    params.offsetXLo = params.mandelbrotOffsetXLo;
+                    params.offsetYLo = params.mandelbrotOffsetYLo;
+                    params.offsetXDigits = params.mandelbrotOffsetXDigits;
+                    params.offsetYDigits = params.mandelbrotOffsetYDigits;
+                } else {
+                    Vector2i mousePos = Mouse::getPosition(window);
+                    Vector2u windowSize = window.getSize();
+                    screenToComplex(params, windowSize.x, windowSize.y, mousePos.x, mousePos.y,
+                                    params.juliaX, params.juliaY);
+                    params.juliaMode = true;
+                    params.mandelbrotZoom = params.zoom;
+                    params.mandelbrotOffsetX = params.offsetX;
+                    params.mandelbrotOffsetY = params.offsetY;
+                    params.mandelbrotOffsetXLo = params.offsetXLo;
+                    params.mandelbrotOffsetYLo = params.offsetYLo;
+                    params.mandelbrotOffsetXDigits = params.offsetXDigits;
+                    params.mandelbrotOffsetYDigits = params.offsetYDigits;
+                    params.zoom = JuliaPreview::kZoom;
+                    params.offsetX = 0.0;
+                    params.offsetY = 0.0;
+                    params.offsetXLo = 0.0;
+                    params.offsetYLo = 0.0;
+                    params.offsetXDigits.clear();
+                    params.offsetYDigits.clear();
+                    cout << "Julia set for c = " << params.juliaX << " + " << params.juliaY << "i" << endl;
+                }
+                break;
+            }
+            case Keyboard::Key::M: {
+                Vector2i mousePos = Mouse::getPosition(window);
+                Vector2u windowSize = window.getSize();
+                double re, im;
+                screenToComplex(params, windowSize.x, windowSize.y, mousePos.x, mousePos.y, re, im);
+                jumpToMinibrot(params, decimalDigits(re), decimalDigits(im));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    else if (const auto* mouseButtonPressed = event.getIf<Event::MouseButtonPressed>()) {
+        if (mouseButtonPressed->button == Mouse::Button::Left) {
+            params.isDragging = true;
+            params.lastMouseX = static_cast<float>(mouseButtonPressed->position.x);
+            params.lastMouseY = static_cast<float>(mouseButtonPressed->position.y);
+        }
+    }
+    else if (const auto* mouseButtonReleased = event.getIf<Event::MouseButtonReleased>()) {
+        if (mouseButtonReleased->button == Mouse::Button::Left) {
+            params.isDragging = false;
+        }
+    }
+    else if (const auto* mouseMoved = event.getIf<Event::MouseMoved>()) {
+        if (params.isDragging) {
+            float deltaX = static_cast<float>(mouseMoved->position.x) - params.lastMouseX;
+            float deltaY = static_cast<float>(mouseMoved->position.y) - params.lastMouseY;
+            
+            // Convert screen coordinates to complex plane coordinates
+            Vector2u windowSize = window.getSize();
+            double aspectRatio = static_cast<double>(windowSize.x) / static_cast<double>(windowSize.y);
+            
+            moveViewCentre(params,
+                           -(static_cast<double>(deltaX) / static_cast<double>(windowSize.x)) * params.zoom * aspectRatio * 2.0,
+                           -(static_cast<double>(deltaY) / static_cast<double>(windowSize.y)) * params.zoom * 2.0);
+            
+            params.lastMouseX = static_cast<float>(mouseMoved->position.x);
+            params.lastMouseY = static_cast<float>(mouseMoved->position.y);
+        }
+    }
+    else if (const auto* mouseWheelScrolled = event.getIf<Event::MouseWheelScrolled>()) {
+        if (mouseWheelScrolled->wheel == Mouse::Wheel::Vertical) {
+            // Smaller zoom steps for more precise control
+            double zoomFactor = mouseWheelScrolled->delta > 0 ? 0.85 : 1.176;
+            
+            // Get mouse position relative to center
+            Vector2i mousePos = Mouse::getPosition(window);
+            Vector2u windowSize = window.getSize();
+            
+            double mouseX = (static_cast<double>(mousePos.x) / static_cast<double>(windowSize.x) - 0.5) * 2.0;
+            double mouseY = -(static_cast<double>(mousePos.y) / static_cast<double>(windowSize.y) - 0.5) * 2.0;
+            
+            double aspectRatio = static_cast<double>(windowSize.x) / static_cast<double>(windowSize.y);
+            mouseX *= aspectRatio;
+            
+            // Zoom
+            double previousZoom = params.zoom;
+            params.zoom = max(params.zoom * zoomFactor, kDeepestZoom);
+            
+            // Adjust offset to zoom towards mouse position
+            moveViewCentre(params, mouseX * (previousZoom - params.zoom), mouseY * (previousZoom - params.zoom));
+        }
+    }
+}
+
+BuddhabrotSettings densitySettings(DensityMode mode) {
+    return mode == DensityMode::Nebulabrot ? BuddhabrotSettings::nebulabrot() : BuddhabrotSettings();
+}
+
+// Render a Buddhabrot or Nebulabrot headless until the sample count is reached
+int renderBuddhabrotHeadless(const MandelbrotParams& params, const CpuRenderSettings& cpuSettings,
+                             int width, int height, uint64_t samples, const string& outputPath) {
+    BuddhabrotSettings settings = densitySettings(params.densityMode);
+    auto prepassStart = chrono::steady_clock::now();
+    BuddhabrotRenderer renderer(cpuSettings, settings);
+    double prepassSeconds = chrono::duration<double>(chrono::steady_clock::now() - prepassStart).count();
+
+    CpuView view;
+    view.offsetX = params.offsetX;
+    view.offsetY = params.offsetY;
+    view.zoom = params.zoom;
+    view.width = width;
+    view.height = height;
+    renderer.start(view);
+    while (renderer.sampleCount() < samples) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    double samplesPerSecond = renderer.samplesPerSecond();
+    renderer.stop();
+
+    vector<float> density;
+    float scale[3];
+    renderer.resolve(density, scale);
+
+    cout << fixed << setprecision(3);
+    cout << (params.densityMode == DensityMode::Nebulabrot ? "Nebulabrot " : "Buddhabrot ") << width << "x"
+         << height << ", iteration limits " << settings.iterationLimits[0] << "/" << settings.iterationLimits[1]
+         << "/" << settings.iterationLimits[2] << endl;
+    cout << "Workers: " << renderer.workerCount() << ", " << renderer.pinnedWorkers() << " pinned" << endl;
+    cout << "Importance map: " << prepassSeconds * 1000.0 << " ms, samples: " << renderer.sampleCount()
+         << " (" << samplesPerSecond / 1e6 << " M/s)" << endl;
+
+    vector<uint8_t> rgb;
+    toneMapBuddhabrot(density, scale, width, height, rgb);
+    if (!writePpm(outputPath, rgb, width, height)) {
+        return -1;
+    }
+    cout << "Wrote " << outputPath << endl;
+    return 0;
+}
+
+// Estimate the area of the Mandelbrot set, printing the running estimate
+int runAreaEstimate(const CpuRenderSettings& cpuSettings, uint64_t samples, int iterations) {
+    AreaEstimateSettings settings;
+    if (samples > 0) settings.samples = samples;
+    if (iterations > 0) settings.maxIterations = iterations;
+    cout << "Estimating the area with " << settings.samples << " samples, " << settings.maxIterations
+         << " iterations, " << kernelVariantName(cpuSettings.kernel) << " kernel" << endl;
+
+    auto report = [](const AreaEstimate& estimate) {
+        cout << fixed << setprecision(1) << estimate.samples / 1e6 << " M samples, "
+             << estimate.samplesPerSecond() / 1e6 << " M samples/s: area " << setprecision(7) << estimate.area;
+        if (estimate.passes >= 2) cout << " +/- " << estimate.confidence95 << " (95%)";
+        cout << endl;
+    };
+    AreaEstimate estimate = estimateMandelbrotArea(cpuSettings, settings, report);
+    report(estimate);
+
+    const MembershipCounts& counts = estimate.counts;
+    double points = static_cast<double>(max<uint64_t>(1, counts.points));
+    cout << setprecision(2) << "Cardioid/bulb: " << 100.0 * counts.cardioid / points << "%, periodic: "
+         << 100.0 * counts.periodic / points << "%, escaped: " << 100.0 * counts.escaped / points
+         << "%, undecided: " << 100.0 * counts.undecided / points << "%" << endl;
+    cout << "Passes: " << estimate.passes << ", time: " << setprecision(3) << estimate.seconds << " s" << endl;
+    cout << "Published pixel-counting estimate: 1.5065918849 +/- 0.0000000028" << endl;
+    return 0;
+}
+
+// Progressive Buddhabrot/Nebulabrot display. The engine samples in the
+// background and restarts whenever the view changes; merged density is
+// uploaded to a float texture at most every kUploadSeconds and tone mapped by
+// buddhabrot_fragment.glsl on the fullscreen quad.
+class BuddhabrotDisplay {
+public:
+    static constexpr float kUploadSeconds = 0.1f;
+
+    GLuint texture = 0;
+    GLuint shaderProgram = 0;
+    unique_ptr<BuddhabrotRenderer> engine;
+
+    BuddhabrotDisplay() {}
+
+    bool initialize() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        shaderProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/buddhabrot_fragment.glsl");
+        return shaderProgram != 0;
+    }
+
+    // Start, restart or drop the engine to match the mode and view
+    void update(const MandelbrotParams& params, const CpuRenderSettings& cpuSettings, int width, int height) {
+        if (params.densityMode != mode) {
+            engine.reset();
+            mode = params.densityMode;
+            if (mode != DensityMode::Off) {
+                cout << "Building Buddhabrot importance map..." << endl;
+                engine = make_unique<BuddhabrotRenderer>(cpuSettings, densitySettings(mode));
+            }
+            view = CpuView();
+        }
+        if (!engine) return;
+
+        if (params.offsetX == view.offsetX && params.offsetY == view.offsetY && params.zoom == view.zoom &&
+            width == view.width && height == view.height) {
+            return;
+        }
+        if (width != view.width || height != view.height) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        view.offsetX = params.offsetX;
+        view.offsetY = params.offsetY;
+        view.zoom = params.zoom;
+        view.width = width;
+        view.height = height;
+        engine->start(view);
+        uploadedMerge = 0;
+    }
+
+    void render(GLuint quadVAO, float now) {
+        if (!engine) return;
+        if (engine->mergeCount() != uploadedMerge && now - lastUpload >= kUploadSeconds) {
+            uploadedMerge = engine->mergeCount();
+            lastUpload = now;
+            engine->resolve(density, scale);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, view.width, view.height, GL_RGB, GL_FLOAT, density.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        glUseProgram(shaderProgram);
+        glUniform1i(glGetUniformLocation(shaderProgram, "density"), 0);
+        glUniform2f(glGetUniformLocation(shaderProgram, "origin"), 0.0f, 0.0f);
+        glUniform3f(glGetUniformLocation(shaderProgram, "scale"), scale[0], scale[1], scale[2]);
+        glUniform1f(glGetUniformLocation(shaderProgram, "exposure"), kBuddhabrotExposure);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ~BuddhabrotDisplay() {
+        if (texture) glDeleteTextures(1, &texture);
+        if (shaderProgram) glDeleteProgram(shaderProgram);
+    }
+
+private:
+    DensityMode mode = DensityMode::Off;
+    CpuView view;
+    vector<float> density;
+    float scale[3] = {1.0f, 1.0f, 1.0f};
+    uint64_t uploadedMerge = 0;
+    float lastUpload = -1.0f;
+};
+
+// Deep zoom on the GPU by perturbation. Past the depth where the plain
+// shader's float coordinates run out, the orbit of the view centre is
+// computed in fixed point on the CPU and uploaded as a float buffer texture;
+// fragment.glsl's USE_PERTURBATION variant then iterates each pixel's
+// offset from it. Z stays within the escape radius, so floats hold it well;
+// the offsets are what need the range. Past kScaledZoom they are passed in
+// units of a power of two, and each pixel carries its delta scaled by its
+// own exponent until it grows into float range, so the GPU goes as deep as
+// the views do: kDeepestZoom, where the wheel and the minibrot jump stop.
+//
+// Rebasing makes any reference valid for any pixel, so panning and zooming
+// keep the orbit and only pass its offset from the new centre to the shader.
+// It is recomputed when it drifts more than kReuseRadius from the centre
+// (pixel deltas would grow and rebase ever more often), when its limbs no
+// longer resolve the zoom, or when the iteration budget outgrows it.
+//
+// A new orbit is computed on a background thread and uploaded chunk by
+// chunk. Frames are drawn into an offscreen texture: until the orbit is
+// complete, the last complete frame is reprojected onto the current view
+// and the shader only overwrites the pixels that escape within the points
+// uploaded so far, so the view keeps moving and fills in while the
+// reference is being computed.
+class GpuPerturbation {
+public:
+    static constexpr double kStartZoom = 1e-4;     // the float shader pixelates below this
+    static constexpr double kScaledZoom = 1e-20;   // pixel offsets are scaled below this
+    static constexpr double kReuseRadius = 1.0;    // in half view heights
+
+    GLuint orbitBuffer = 0;
+    GLuint orbitTexture = 0;
+    GLuint framebuffer = 0;
+    GLuint frameTextures[2] = {0, 0};
+    GLuint shaderProgram = 0;
+    GLuint reprojectProgram = 0;
+    ReferenceOrbit orbit;
+    bool orbitComplete = false;
+    int orbitIterations = 0;  // iteration budget the orbit is computed for
+    uint64_t recomputations = 0;
+    float interiorThreshold = 0.0f;  // as CpuRenderSettings::interiorThreshold
+
+    GpuPerturbation() {}
+
+    bool initialize(bool useDouble) {
+        glGenBuffers(1, &orbitBuffer);
+        glGenTextures(1, &orbitTexture);
+        glGenTextures(2, frameTextures);
+        for (GLuint texture : frameTextures) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &framebuffer);
+
+        shaderProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/fragment.glsl", useDouble,
+                                            Formula::Mandelbrot, true);
+        reprojectProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/reproject_fragment.glsl");
+        return shaderProgram != 0 && reprojectProgram != 0;
+    }
+
+    // Whether the view is deep enough to need perturbation, and of a kind it handles
+    bool applies(const MandelbrotParams& params) const {
+        return shaderProgram != 0 && params.formula == Formula::Mandelbrot && !params.juliaMode &&
+               params.zoom < kStartZoom;
+    }
+
+    void render(GLuint quadVAO, const MandelbrotParams& params, int windowWidth, int windowHeight) {
+        ReferenceCoordinate x, y;
+        viewCentre(params, x, y);
+        updateOrbit(params, x, y, windowWidth, windowHeight);
+
+        if (windowWidth != frameWidth || windowHeight != frameHeight) {
+            for (GLuint texture : frameTextures) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             nullptr);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            frameWidth = windowWidth;
+            frameHeight = windowHeight;
+            haveCompleteFrame = false;
+        }
+
+        // Draw into the texture the last complete frame is not in
+        int target = 1 - completeFrame;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frameTextures[target], 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        if (!orbitComplete) {
+            if (haveCompleteFrame) {
+                double pixelSize = completeZoom * 2.0 / windowHeight;
+                drawFrame(quadVAO, frameTextures[completeFrame], params.zoom / completeZoom,
+                          (x - completeX).toDouble() / pixelSize, -(y - completeY).toDouble() / pixelSize);
+            } else {
+                glClear(GL_COLOR_BUFFER_BIT);
+            }
+        }
+        // The shader needs Z_0 and Z_1 at least to take a step
+        if (orbit.length() >= 2) drawPerturbed(quadVAO, params, windowWidth, windowHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+
+        if (orbitComplete) {
+            completeFrame = target;
+            completeX = x;
+            completeY = y;
+            completeZoom = params.zoom;
+            haveCompleteFrame = true;
+        }
+        drawFrame(quadVAO, frameTextures[target], 1.0, 0.0, 0.0);
+    }
+
+    ~GpuPerturbation() {
+        if (orbitTexture) glDeleteTextures(1, &orbitTexture);
+        if (orbitBuffer) glDeleteBuffers(1, &orbitBuffer);
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (frameTextures[0]) glDeleteTextures(2, frameTextures);
+        if (shaderProgram) glDeleteProgram(shaderProgram);
+        if (reprojectProgram) glDeleteProgram(reprojectProgram);
+    }
+
+private:
+    ReferenceOrbitWorker worker;
+    int orbitLimbs = 0;
+    size_t uploadedPoints = 0;
+    double referenceX = 0.0;  // reference point relative to the view centre
+    double referenceY = 0.0;
+    vector<float> upload;
+
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int completeFrame = 0;  // texture holding the last frame drawn with a complete orbit
+    bool haveCompleteFrame = false;
+    ReferenceCoordinate completeX;  // and its view
+    ReferenceCoordinate completeY;
+    double completeZoom = 1.0;
+
+    void updateOrbit(const MandelbrotParams& params, const ReferenceCoordinate& x, const ReferenceCoordinate& y,
+                     int windowWidth, int windowHeight) {
+        int iterations = params.adaptiveIterations ? adaptiveIterationCount(params.maxIterations, params.zoom)
+                                                   : params.maxIterations;
+        CpuView view;
+        view.offsetX = params.offsetX;
+        view.offsetY = params.offsetY;
+        view.zoom = params.zoom;
+        view.width = windowWidth;
+        view.height = windowHeight;
+        int limbs = referenceLimbs(requiredPrecisionBits(view));
+
+        referenceX = (orbit.cx - x).toDouble();
+        referenceY = (orbit.cy - y).toDouble();
+        // An escaped orbit would not get any longer with more iterations
+        bool escaped = orbitComplete && orbit.length() < orbitIterations;
+        bool reusable = orbitLimbs > 0 && limbs <= orbitLimbs && (iterations <= orbitIterations || escaped) &&
+                        hypot(referenceX, referenceY) <= kReuseRadius * params.zoom;
+        if (!reusable) {
+            worker.start(x, y, limbs, iterations);
+            orbitIterations = iterations;
+            orbitLimbs = limbs;
+            orbitComplete = false;
+            uploadedPoints = 0;
+            referenceX = 0.0;
+            referenceY = 0.0;
+            recomputations++;
+
+            glBindBuffer(GL_TEXTURE_BUFFER, orbitBuffer);
+            glBufferData(GL_TEXTURE_BUFFER, 2 * static_cast<size_t>(iterations) * sizeof(float), nullptr,
+                         GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            // Attach after allocating: some drivers do not follow a buffer's
+            // storage being replaced under a texture
+            glBindTexture(GL_TEXTURE_BUFFER, orbitTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, orbitBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        if (orbitComplete) return;
+
+        orbitComplete = worker.collect(orbit);
+        if (orbit.z.size() > uploadedPoints) {
+            upload.assign(orbit.z.begin() + uploadedPoints, orbit.z.end());
+            glBindBuffer(GL_TEXTURE_BUFFER, orbitBuffer);
+            glBufferSubData(GL_TEXTURE_BUFFER, uploadedPoints * sizeof(float), upload.size() * sizeof(float),
+                            upload.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            uploadedPoints = orbit.z.size();
+        }
+    }
+
+    void drawPerturbed(GLuint quadVAO, const MandelbrotParams& params, int windowWidth, int windowHeight) {
+        const Vector3f& color = params.colors[params.colorMode];
+        const Vector3f& colorBg = params.colorsBg[params.colorModeBg];
+        // Lengths in units of 2^deltaExponent, which keeps them in float range
+        int deltaExponent = params.zoom < kScaledZoom ? ilogb(params.zoom) : 0;
+        glUseProgram(shaderProgram);
+        glUniform2f(glGetUniformLocation(shaderProgram, "resolution"), windowWidth, windowHeight);
+        glUniform2f(glGetUniformLocation(shaderProgram, "origin"), 0.0f, 0.0f);
+        glUniform1f(glGetUniformLocation(shaderProgram, "zoom"),
+                    static_cast<float>(ldexp(params.zoom, -deltaExponent)));
+        glUniform1i(glGetUniformLocation(shaderProgram, "deltaExponent"), deltaExponent);
+        glUniform2f(glGetUniformLocation(shaderProgram, "offset"), static_cast<float>(params.offsetX),
+                    static_cast<float>(params.offsetY));
+        glUniform1i(glGetUniformLocation(shaderProgram, "maxIterations"), params.maxIterations);
+        glUniform3f(glGetUniformLocation(shaderProgram, "color"), color.x, color.y, color.z);
+        glUniform3f(glGetUniformLocation(shaderProgram, "colorBg"), colorBg.x, colorBg.y, colorBg.z);
+        glUniform1i(glGetUniformLocation(shaderProgram, "adaptiveIterations"), params.adaptiveIterations ? 1 : 0);
+        glUniform1f(glGetUniformLocation(shaderProgram, "interiorThreshold"), interiorThreshold);
+        glUniform1i(glGetUniformLocation(shaderProgram, "referenceOrbit"), 0);
+        glUniform1i(glGetUniformLocation(shaderProgram, "referenceLength"), orbit.length());
+        glUniform1i(glGetUniformLocation(shaderProgram, "referenceComplete"), orbitComplete ? 1 : 0);
+        glUniform2f(glGetUniformLocation(shaderProgram, "referenceOffset"),
+                    static_cast<float>(ldexp(referenceX, -deltaExponent)),
+                    static_cast<float>(ldexp(referenceY, -deltaExponent)));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, orbitTexture);
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Draw a frame texture scaled by scale (its pixels per current pixel)
+    // and shifted by (shiftX, shiftY) of its pixels, y up
+    void drawFrame(GLuint quadVAO, GLuint texture, double scale, double shiftX, double shiftY) {
+        glUseProgram(reprojectProgram);
+        glUniform1i(glGetUniformLocation(reprojectProgram, "image"), 0);
+        glUniform2f(glGetUniformLocation(reprojectProgram, "resolution"), frameWidth, frameHeight);
+        glUniform1f(glGetUniformLocation(reprojectProgram, "scale"), static_cast<float>(scale));
+        glUniform2f(glGetUniformLocation(reprojectProgram, "shift"), static_cast<float>(shiftX),
+                    static_cast<float>(shiftY));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+// Split-frame rendering on the GPU and the CPU tile engine together. Each
+// frame the shader draws the upper rows into a window-sized texture and,
+// while the GPU works on them, the CPU engine renders the band of rows
+// below; the band is coloured like the shader and uploaded into the same
+// texture, which is then drawn on the fullscreen quad. The band's share of
+// the rows follows the two sides' throughput in the previous frames (rows
+// per second, from the CPU render time and a GPU timer query), so both
+// finish at about the same time.
+class HybridRenderer {
+public:
+    static constexpr int kMinRows = 16;          // each side keeps enough rows to stay measured
+    static constexpr double kSmoothing = 0.25;   // weight of the latest frame in the split
+    static constexpr double kStartFraction = 0.25;
+
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    GLuint copyProgram = 0;
+    GLuint timerQuery = 0;
+    unique_ptr<CpuRenderer> engine;
+    double fraction = kStartFraction;  // share of the rows rendered on the CPU
+    int cpuRows = 0;                   // in the last frame
+    double cpuSeconds = 0.0;
+    double gpuSeconds = 0.0;
+
+    HybridRenderer() {}
+
+    bool initialize() {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &framebuffer);
+        glGenQueries(1, &timerQuery);
+        copyProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/reproject_fragment.glsl");
+        return copyProgram != 0;
+    }
+
+    // Start or drop the CPU engine to match the mode. The shader's float
+    // coordinates limit the view anyway, so the engine stays in double
+    // precision and counts whole iterations, like the shader.
+    void update(const MandelbrotParams& params, const CpuRenderSettings& cpuSettings) {
+        if (params.hybrid == (engine != nullptr)) return;
+        if (params.hybrid) {
+            CpuRenderSettings settings = cpuSettings;
+            settings.precision = CpuPrecision::Double;
+            settings.smoothColoring = false;
+            engine = make_unique<CpuRenderer>(settings);
+            fraction = kStartFraction;
+        } else {
+            engine.reset();
+        }
+    }
+
+    // Draw the frame; drawShader issues the escape-time shader draw of the
+    // whole window, which is scissored to the GPU's rows
+    void render(GLuint quadVAO, const MandelbrotParams& params, int windowWidth, int windowHeight,
+                const function<void()>& drawShader) {
+        if (windowWidth != frameWidth || windowHeight != frameHeight) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         nullptr);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            frameWidth = windowWidth;
+            frameHeight = windowHeight;
+        }
+        int rows = static_cast<int>(lround(fraction * windowHeight));
+        rows = max(min(rows, windowHeight - kMinRows), min(kMinRows, windowHeight / 2));
+
+        // GPU rows first, so the GPU works on them while the CPU renders its band
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, rows, windowWidth, windowHeight - rows);
+        glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+        drawShader();
+        glEndQuery(GL_TIME_ELAPSED);
+        glDisable(GL_SCISSOR_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glFlush();
+
+        auto start = chrono::steady_clock::now();
+        bool rendered = engine->render(bandView(params, windowWidth, windowHeight, rows));
+        cpuSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (rendered) {
+            colorize(params, windowWidth, rows);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, windowWidth, rows, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        GLuint64 gpuNanoseconds = 0;
+        glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &gpuNanoseconds);
+        gpuSeconds = gpuNanoseconds * 1e-9;
+        cpuRows = rows;
+        if (rendered && cpuSeconds > 0.0 && gpuSeconds > 0.0) {
+            double cpuRate = rows / cpuSeconds;
+            double gpuRate = (windowHeight - rows) / gpuSeconds;
+            fraction += kSmoothing * (cpuRate / (cpuRate + gpuRate) - fraction);
+        }
+
+        glViewport(0, 0, windowWidth, windowHeight);
+        glUseProgram(copyProgram);
+        glUniform1i(glGetUniformLocation(copyProgram, "image"), 0);
+        glUniform2f(glGetUniformLocation(copyProgram, "resolution"), windowWidth, windowHeight);
+        glUniform1f(glGetUniformLocation(copyProgram, "scale"), 1.0f);
+        glUniform2f(glGetUniformLocation(copyProgram, "shift"), 0.0f, 0.0f);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(quadVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ~HybridRenderer() {
+        if (texture) glDeleteTextures(1, &texture);
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (timerQuery) glDeleteQueries(1, &timerQuery);
+        if (copyProgram) glDeleteProgram(copyProgram);
+    }
+
+private:
+    int frameWidth = 0;
+    int frameHeight = 0;
+    vector<uint8_t> rgba;
+
+    // The bottom rows of the window as a view of their own: the same pixel
+    // size, centred on the band
+    static CpuView bandView(const MandelbrotParams& params, int windowWidth, int windowHeight, int rows) {
+        CpuView view = cpuViewOf(params, windowWidth, rows);
+        view.offsetY = params.offsetY + params.zoom * (windowHeight - rows) / windowHeight;
+        view.zoom = params.zoom * rows / windowHeight;
+        return view;
+    }
+
+    // fragment.glsl's palette: it colours by the iteration before the escape
+    // and lets the blend run past the colour for counts beyond maxIterations
+    void colorize(const MandelbrotParams& params, int width, int rows) {
+        const Vector3f& color = params.colors[params.colorMode];
+        const Vector3f& colorBg = params.colorsBg[params.colorModeBg];
+        const float blend[3][2] = {{colorBg.x, color.x}, {colorBg.y, color.y}, {colorBg.z, color.z}};
+        const float* iterations = engine->iterations();
+        size_t count = static_cast<size_t>(width) * rows;
+        rgba.resize(count * 4);
+        for (size_t i = 0; i < count; i++) {
+            float value = iterations[i];
+            float t = max(value - 1.0f, 0.0f) / params.maxIterations;
+            for (int channel = 0; channel < 3; channel++) {
+                float mixed = value == kInteriorIteration
+                    ? 0.0f : blend[channel][0] + (blend[channel][1] - blend[channel][0]) * t;
+                rgba[i * 4 + channel] = static_cast<uint8_t>(clamp(mixed, 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+};
+
+// Whether two views give the same image
+bool sameView(const CpuView& a, const CpuView& b) {
+    return a.offsetX == b.offsetX && a.offsetY == b.offsetY && a.offsetXLo == b.offsetXLo &&
+           a.offsetYLo == b.offsetYLo && a.offsetXDigits == b.offsetXDigits && a.offsetYDigits == b.offsetYDigits &&
+           a.zoom == b.zoom && a.width == b.width && a.height == b.height && a.maxIterations == b.maxIterations &&
+           a.formula == b.formula && a.julia == b.julia && a.juliaX == b.juliaX && a.juliaY == b.juliaY;
+}
+
+// Progressive display of the CPU engine for the fallback window. Renders
+// run on a background thread and the workers push every finished tile onto
+// a TileQueue; each frame drains it, colours the new tiles into the image
+// and uploads them, so the picture fills in as tiles finish instead of
+// appearing once the whole frame is done. A new view cancels the render in
+// flight, and the old picture stays up until the new tiles cover it.
+//
+// With GL 2.1 or later the image is a texture. Each frame's tiles are packed
+// into the next buffer of a ring of pixel buffer objects and copied into the
+// texture from there with glTexSubImage2D, so the driver transfers them
+// without the frame waiting on the copy, nor on uploads still in flight.
+// At most kUploadBytes go up per frame and the rest wait for the next, so a
+// burst of finished tiles never hitches a frame. Older contexts draw the
+// whole image with glDrawPixels.
+//
+// Every finished tile also goes into an IterationPyramid. When the view
+// changes, the pixels the pyramid knows are first drawn from it, so zooming
+// out or panning back shows what was rendered before at once, coarser where
+// only a wider render saw it, until the new tiles replace it. The rest keep
+// the old picture.
+class CpuTileDisplay {
+public:
+    static constexpr size_t kUploadBytes = size_t(2) << 20;  // per frame
+    static constexpr int kPixelBuffers = 3;
+
+    GLuint texture = 0;
+    GLuint pixelBuffers[kPixelBuffers] = {0, 0, 0};
+    bool usePixelBuffers = false;
+
+    explicit CpuTileDisplay(const CpuRenderSettings& settings) : renderer(settings) {}
+
+    void initialize(bool pixelBufferSupport) {
+        usePixelBuffers = pixelBufferSupport;
+        if (!usePixelBuffers) return;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenBuffers(kPixelBuffers, pixelBuffers);
+    }
+
+    // Start rendering the view unless it is already rendered or in flight
+    void update(const CpuView& newView) {
+        if (sameView(newView, view)) return;
+        stop();
+        if (newView.width != view.width || newView.height != view.height) {
+            image.assign(static_cast<size_t>(newView.width) * newView.height * 4, 0);
+            if (usePixelBuffers) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, newView.width, newView.height, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, image.data());
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+        }
+        view = newView;
+        queue.reset(renderer.tileCount(view.width, view.height));
+        pending.clear();
+        finished.clear();
+        previewPending = true;
+        done = false;
+        worker = thread([this] {
+            RenderProgress progress;
+            progress.completedTiles = &queue;
+            progress.cancel = &cancel;
+            succeeded = renderer.render(view, progress);
+            done = true;
+        });
+    }
+
+    // True once for each render that has completed, after which its stats are valid
+    bool completed() {
+        if (!done || !worker.joinable()) return false;
+        worker.join();
+        return succeeded;
+    }
+
+    // Whether frames still have tiles to show
+    bool busy() const { return !done || !pending.empty(); }
+
+    const CpuRenderStats& stats() const { return renderer.stats(); }
+    const IterationPyramid& pyramid() const { return cache; }
+    const CpuView& currentView() const { return view; }
+
+    // Upload what has finished since the last frame, within the budget, and draw the image
+    void draw(const MandelbrotParams& params) {
+        size_t before = finished.size();
+        queue.drain(finished);
+        pending.insert(pending.end(), finished.begin() + before, finished.end());
+        for (size_t i = before; i < finished.size(); i++) cache.insert(view, renderer.iterations(), finished[i]);
+        if (params.colorMode != colorMode || params.colorModeBg != colorModeBg) {
+            // Recolour everything so far; tiles still to come get the new palette anyway
+            colorMode = params.colorMode;
+            colorModeBg = params.colorModeBg;
+            pending.assign(finished.begin(), finished.end());
+            previewPending = true;
+        }
+
+        const Vector3f& color = params.colors[colorMode];
+        const Vector3f& colorBg = params.colorsBg[colorModeBg];
+        const float colorValues[3] = {color.x, color.y, color.z};
+        const float colorBgValues[3] = {colorBg.x, colorBg.y, colorBg.z};
+        if (previewPending) {
+            // Tiles already finished are coloured over the preview below
+            previewPending = false;
+            preview.assign(static_cast<size_t>(view.width) * view.height, kUnknownIteration);
+            if (cache.sample(view, preview.data()) > 0) {
+                // Only pixels the pyramid knows replace the old picture
+                previewImage.resize(image.size());
+                colorizeTile(preview.data(), view.width, {0, 0, view.width, view.height}, params.maxIterations,
+                             colorValues, colorBgValues, previewImage.data());
+                for (size_t i = 0; i < preview.size(); i++) {
+                    if (preview[i] != kUnknownIteration) memcpy(&image[i * 4], &previewImage[i * 4], 4);
+                }
+                if (usePixelBuffers) {
+                    glBindTexture(GL_TEXTURE_2D, texture);
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, view.width, view.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    image.data());
+                    glBindTexture(GL_TEXTURE_2D, 0);
+                }
+            }
+        }
+        batch.clear();
+        size_t bytes = 0;
+        while (!pending.empty()) {
+            const TileRect& rect = pending.front();
+            size_t tileBytes = static_cast<size_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0) * 4;
+            if (!batch.empty() && bytes + tileBytes > kUploadBytes) break;
+            colorizeTile(renderer.iterations(), view.width, rect, params.maxIterations, colorValues, colorBgValues,
+                         image.data());
+            batch.push_back(rect);
+            bytes += tileBytes;
+            pending.pop_front();
+        }
+
+        glClear(GL_COLOR_BUFFER_BIT);
+        if (usePixelBuffers) {
+            if (!batch.empty()) upload(bytes);
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glBegin(GL_QUADS);
+            glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+            glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+            glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+            glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
+            glEnd();
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glDisable(GL_TEXTURE_2D);
+        } else {
+            // Rows are bottom-up, as glDrawPixels reads them from the raster position
+            glRasterPos2f(-1.0f, -1.0f);
+            glDrawPixels(view.width, view.height, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+        }
+    }
+
+    ~CpuTileDisplay() {
+        stop();
+        if (texture) glDeleteTextures(1, &texture);
+        if (pixelBuffers[0]) glDeleteBuffers(kPixelBuffers, pixelBuffers);
+    }
+
+private:
+    CpuRenderer renderer;
+    TileQueue queue;
+    IterationPyramid cache;
+    vector<float> preview;        // the pyramid's values for a new view
+    vector<uint8_t> previewImage; // and their colours
+    bool previewPending = false;
+    thread worker;
+    atomic<bool> cancel{false};
+    atomic<bool> done{true};
+    bool succeeded = false;
+    CpuView view;                 // rendered or in flight
+    vector<TileRect> finished;    // tiles of the current render so far
+    deque<TileRect> pending;      // of those, the ones not uploaded yet
+    vector<TileRect> batch;       // uploaded this frame
+    vector<uint8_t> image;        // RGBA, rows bottom-up
+    int colorMode = 0;
+    int colorModeBg = 0;
+    int nextBuffer = 0;
+
+    void stop() {
+        if (!worker.joinable()) return;
+        cancel = true;
+        worker.join();
+        cancel = false;
+    }
+
+    // Pack this frame's tiles into the next pixel buffer (orphaning its old
+    // storage) and copy them into the texture from there
+    void upload(size_t bytes) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffers[nextBuffer]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, max(bytes, kUploadBytes), nullptr, GL_STREAM_DRAW);
+        uint8_t* packed = static_cast<uint8_t*>(glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY));
+        if (packed) {
+            size_t offset = 0;
+            for (const TileRect& rect : batch) {
+                size_t rowBytes = static_cast<size_t>(rect.x1 - rect.x0) * 4;
+                for (int y = rect.y0; y < rect.y1; y++) {
+                    memcpy(packed + offset, image.data() + (static_cast<size_t>(y) * view.width + rect.x0) * 4,
+                           rowBytes);
+                    offset += rowBytes;
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            offset = 0;
+            for (const TileRect& rect : batch) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x0, rect.y0, rect.x1 - rect.x0, rect.y1 - rect.y0, GL_RGBA,
+                                GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+                offset += static_cast<size_t>(rect.x1 - rect.x0) * (rect.y1 - rect.y0) * 4;
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        nextBuffer = (nextBuffer + 1) % kPixelBuffers;
+    }
+};
+
+// Overview in the top-right corner of the CPU window: the view zoomed out
+// kZoomOut times (no wider than the reset view), drawn from the display's
+// pyramid with the current view outlined. It iterates nothing itself, so
+// parts never rendered at any scale stay blank; zooming in from a wide view
+// keeps it filled.
+class Minimap {
+public:
+    static constexpr int kWidth = 240;
+    static constexpr int kMargin = 10;
+    static constexpr double kZoomOut = 16.0;
+    static constexpr double kWidestZoom = 2.0;  // the reset view's
+
+    bool visible = true;
+
+    void draw(const IterationPyramid& pyramid, const CpuView& view, const MandelbrotParams& params) {
+        if (!visible || view.width < 2 * kWidth || view.height <= 0) return;
+        CpuView frame = view;
+        frame.width = kWidth;
+        frame.height = max(1, kWidth * view.height / view.width);
+        frame.zoom = max(view.zoom, min(view.zoom * kZoomOut, kWidestZoom));
+        if (pyramid.revision() != revision || !sameView(frame, shown) || params.colorMode != colorMode ||
+            params.colorModeBg != colorModeBg) {
+            revision = pyramid.revision();
+            shown = frame;
+            colorMode = params.colorMode;
+            colorModeBg = params.colorModeBg;
+            iterations.assign(static_cast<size_t>(frame.width) * frame.height, kUnknownIteration);
+            pyramid.sample(frame, iterations.data());
+            const Vector3f& color = params.colors[colorMode];
+            const Vector3f& colorBg = params.colorsBg[colorModeBg];
+            const float colorValues[3] = {color.x, color.y, color.z};
+            const float colorBgValues[3] = {colorBg.x, colorBg.y, colorBg.z};
+            image.resize(iterations.size() * 4);
+            colorizeTile(iterations.data(), frame.width, {0, 0, frame.width, frame.height}, params.maxIterations,
+                         colorValues, colorBgValues, image.data());
+            for (size_t i = 0; i < iterations.size(); i++) {
+                if (iterations[i] == kUnknownIteration) {
+                    const uint8_t blank[4] = {0, 0, 0, 255};
+                    memcpy(&image[i * 4], blank, 4);
+                }
+            }
+        }
+
+        // Corners in normalised device coordinates, y up like the buffer rows
+        float right = 1.0f - 2.0f * kMargin / view.width;
+        float top = 1.0f - 2.0f * kMargin / view.height;
+        float left = right - 2.0f * frame.width / view.width;
+        float bottom = top - 2.0f * frame.height / view.height;
+        glRasterPos2f(left, bottom);
+        glDrawPixels(frame.width, frame.height, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+
+        // The frame shares the view's centre, so the view sits in the middle
+        float share = static_cast<float>(view.zoom / frame.zoom);
+        float centreX = 0.5f * (left + right);
+        float centreY = 0.5f * (bottom + top);
+        float halfWidth = 0.5f * (right - left) * share;
+        float halfHeight = 0.5f * (top - bottom) * share;
+        glColor3f(0.5f, 0.5f, 0.5f);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(left, bottom); glVertex2f(right, bottom); glVertex2f(right, top); glVertex2f(left, top);
+        glEnd();
+        glColor3f(1.0f, 1.0f, 1.0f);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(centreX - halfWidth, centreY - halfHeight);
+        glVertex2f(centreX + halfWidth, centreY - halfHeight);
+        glVertex2f(centreX + halfWidth, centreY + halfHeight);
+        glVertex2f(centreX - halfWidth, centreY + halfHeight);
+        glEnd();
+    }
+
+private:
+    uint64_t revision = 0;
+    CpuView shown;
+    int colorMode = -1;
+    int colorModeBg = -1;
+    vector<float> iterations;
+    vector<uint8_t> image;  // RGBA, rows bottom-up
+};
+
+// Explorer for contexts without GL 4.1 core or the shaders (VMs, remote
+// desktops). The window is reopened with a legacy context and the CPU engine
+// renders the view whenever it changes, shown progressively by
+// CpuTileDisplay, which needs no more than GL 1.1. Navigation and
+// formulas work as in the shader explorer; the Julia preview, the
+// Buddhabrot views and the text overlay need shaders, so the render time
+// goes to the window title instead.
+int runCpuWindow(Window& window, MandelbrotParams& params, const CpuRenderSettings& cpuSettings, bool useVsync) {
+    window.create(VideoMode({1200, 800}), "Mandelbrot Set Explorer - C++ (CPU)", State::Windowed, ContextSettings());
+    window.setVerticalSyncEnabled(useVsync);
+    if (!window.setActive(true)) {
+        cerr << "Failed to create any OpenGL context, use --render-cpu for images" << endl;
+        return -1;
+    }
+    cout << "OpenGL Version: " << glGetString(GL_VERSION) << endl;
+    cout << "Rendering on the CPU engine" << endl;
+
+    cout << "\n=== CONTROLS ===" << endl;
+    cout << "Mouse wheel: Zoom in/out" << endl;
+    cout << "Left click + drag: Pan view" << endl;
+    cout << "R: Reset view" << endl;
+    cout << "C/V: Cycle color modes" << endl;
+    cout << "B/N: Cycle background color modes" << endl;
+    cout << "+/-: Increase/decrease iterations" << endl;
+    cout << "A: Toggle adaptive iterations" << endl;
+    cout << "J: Toggle Julia mode for the point under the cursor" << endl;
+    cout << "M: Zoom to the minibrot nearest the cursor" << endl;
+    cout << "F: Cycle formulas" << endl;
+    cout << "O: Toggle the overview map" << endl;
+    cout << "ESC: Exit" << endl;
+
+    const ContextSettings& actual = window.getSettings();
+    CpuTileDisplay display(cpuSettings);
+    Minimap minimap;
+    display.initialize(actual.majorVersion * 10 + actual.minorVersion >= 21);
+    bool running = true;
+    while (running) {
+        while (const optional event = window.pollEvent()) {
+            handleViewInput(*event, params, window);
+            if (event->is<Event::Closed>()) {
+                running = false;
+            } else if (const auto* resized = event->getIf<Event::Resized>()) {
+                glViewport(0, 0, resized->size.x, resized->size.y);
+            } else if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                if (keyPressed->code == Keyboard::Key::Escape) {
+                    running = false;
+                } else if (keyPressed->code == Keyboard::Key::F) {
+                    params.formula = static_cast<Formula>((static_cast<int>(params.formula) + 1) % kFormulaCount);
+                    cout << "Formula: " << formulaName(params.formula) << endl;
+                } else if (keyPressed->code == Keyboard::Key::O) {
+                    minimap.visible = !minimap.visible;
+                }
+            }
+        }
+
+        Vector2u windowSize = window.getSize();
+        display.update(cpuViewOf(params, windowSize.x, windowSize.y));
+        if (display.completed()) {
+            stringstream title;
+            title << fixed << setprecision(0) << "Mandelbrot Set Explorer - C++ (CPU, "
+                  << cpuPrecisionName(display.stats().precision) << ", "
+                  << display.stats().renderSeconds * 1000.0 << " ms)";
+            window.setTitle(title.str());
+        }
+        bool idle = !display.busy();
+        display.draw(params);
+        minimap.draw(display.pyramid(), display.currentView(), params);
+        if (idle) this_thread::sleep_for(chrono::milliseconds(10));
+        window.display();
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Initialize Mandelbrot parameters
+    MandelbrotParams params;
+    // Create context settings with depth buffer
+    ContextSettings settings;
+    settings.depthBits = 24;
+    settings.stencilBits = 8;
+    settings.majorVersion = 4;  // OpenGL 4.1 required for double precision
+    settings.minorVersion = 1;
+    settings.antiAliasingLevel = 4;
+    settings.attributeFlags = ContextSettings::Core;  // Request core profile
+
+    bool useDouble = false; bool useVsync = true;
+    bool cpuWindow = false;  // explore on the CPU engine without shaders
+    CpuRenderSettings cpuSettings;
+    if (loadTunedSettings(cpuSettings)) {
+        cout << "Loaded CPU tuning from " << tunedConfigPath() << endl;
+    }
+    bool renderCpu = false; bool runTune = false; bool viewGiven = false;
+    int cpuIterations = 0;
+    bool estimateArea = false;
+    bool findNearestMinibrot = false;
+    uint64_t sampleCount = 0;  // 0 = the mode's default
+    int renderWidth = 0, renderHeight = 0;
+    string renderPath;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            switch (getArgType(argv[i])) {
+                case ARG_NO_DEPTH:
+                    settings.depthBits = 0;
+                    settings.stencilBits = 0;
+                    break;
+                case ARG_AA: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --aa" << endl;
+                        return -1;
+                    }
+                    int value = stoi(argv[++i]); // consume number
+                    if (value < 0 || value > 16) {
+                        cerr << "Anti-aliasing level must be between 0 and 16" << endl;
+                        return -1;
+                    }
+                    settings.antiAliasingLevel = value;
+                    break;
+                }
+                case ARG_VSYNC: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --vsync (true/false)" << endl;
+                        return -1;
+                    }
+                    string val = argv[++i];
+                    if (val == "true") {
+                        useVsync = true;
+                    } else if (val == "false") {
+                        useVsync = false;
+                    } else {
+                        cerr << "Invalid value for --vsync (must be true/false)" << endl;
+                        return -1;
+                    }
+                    break;
+                }
+                case ARG_MAX_ITERS: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --max-iters" << endl;
+                        return -1;
+                    }
+                    int value = stoi(argv[++i]); // consume number
+                    if (value < 1 || value > 1000) {
+                        cerr << "Max iterations must be between 1 and 1000" << endl;
+                        return -1;
+                    }
+                    params.maxIterations = value;
+                    break;
+                }
+                case ARG_VIEW: {
+                    if (i + 3 >= argc) {
+                        cerr << "Missing values for --view (x y zoom)" << endl;
+                        return -1;
+                    }
+                    // Keep every digit double-double can hold for deep CPU renders
+                    DoubleDouble x, y;
+                    if (!parseDoubleDouble(argv[++i], x) || !parseDoubleDouble(argv[++i], y)) {
+                        cerr << "Invalid coordinates for --view" << endl;
+                        return -1;
+                    }
+                    params.offsetX = x.hi;
+                    params.offsetXLo = x.lo;
+                    params.offsetY = y.hi;
+                    params.offsetYLo = y.lo;
+                    params.offsetXDigits = argv[i - 1];
+                    params.offsetYDigits = argv[i];
+                    params.zoom = strtod(argv[++i], nullptr);
+                    if (!(params.zoom >= kDeepestZoom)) {
+                        cerr << "Zoom must be at least " << kDeepestZoom << endl;
+                        return -1;
+                    }
+                    viewGiven = true;
+                    break;
+                }
+                case ARG_RENDER_CPU: {
+                    if (i + 3 >= argc) {
+                        cerr << "Missing values for --render-cpu (width height output.ppm)" << endl;
+                        return -1;
+                    }
+                    renderWidth = stoi(argv[++i]);
+                    renderHeight = stoi(argv[++i]);
+                    renderPath = argv[++i];
+                    if (renderWidth <= 0 || renderHeight <= 0) {
+                        cerr << "Render size must be positive" << endl;
+                        return -1;
+                    }
+                    renderCpu = true;
+                    break;
+                }
+                case ARG_THREADS: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --threads" << endl;
+                        return -1;
+                    }
+                    int value = stoi(argv[++i]);
+                    if (value < 0 || value > 1024) {
+                        cerr << "Thread count must be between 0 (auto) and 1024" << endl;
+                        return -1;
+                    }
+                    cpuSettings.threadCount = value;
+                    break;
+                }
+                case ARG_TILE_SIZE: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --tile-size" << endl;
+                        return -1;
+                    }
+                    int value = stoi(argv[++i]);
+                    if (value < 8 || value > kMaxTileSize) {
+                        cerr << "Tile size must be between 8 and " << kMaxTileSize << endl;
+                        return -1;
+                    }
+                    cpuSettings.tileSize = value;
+                    break;
+                }
+                case ARG_NO_NUMA: cpuSettings.numaAware = false; break;
+                case ARG_NO_COST_SCHEDULING: cpuSettings.costScheduling = false; break;
+                case ARG_NO_TILE_BUDGETS: cpuSettings.tileBudgets = false; break;
+                case ARG_NO_DISTANCE_FILL: cpuSettings.distanceFill = false; break;
+                case ARG_INTERIOR_THRESHOLD: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --interior-threshold" << endl;
+                        return -1;
+                    }
+                    double value = stod(argv[++i]);
+                    if (value < 0.0 || value >= 1.0) {
+                        cerr << "Interior threshold must be at least 0 and below 1" << endl;
+                        return -1;
+                    }
+                    cpuSettings.interiorThreshold = value;
+                    break;
+                }
+                case ARG_NO_HUGEPAGES: cpuSettings.hugePages = false; break;
+                case ARG_KERNEL: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --kernel (scalar/avx2/avx512)" << endl;
+                        return -1;
+                    }
+                    KernelVariant variant;
+                    if (!parseKernelVariant(argv[++i], variant)) {
+                        cerr << "Invalid value for --kernel (must be scalar/avx2/avx512)" << endl;
+                        return -1;
+                    }
+                    if (!kernelVariantSupported(variant)) {
+                        cerr << "Kernel " << argv[i] << " is not supported by this CPU" << endl;
+                        return -1;
+                    }
+                    cpuSettings.kernel = variant;
+                    break;
+                }
+                case ARG_TUNE: runTune = true; break;
+                case ARG_ITERATIONS: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --iterations" << endl;
+                        return -1;
+                    }
+                    int value = stoi(argv[++i]);
+                    if (value < 1 || value > 1000000000) {
+                        cerr << "Iterations must be between 1 and 1000000000" << endl;
+                        return -1;
+                    }
+                    cpuIterations = value;
+                    break;
+                }
+                case ARG_PRECISION: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --precision (auto/double/dd/fixed128/fixed192/fixed256/perturbation)" << endl;
+                        return -1;
+                    }
+                    if (!parseCpuPrecision(argv[++i], cpuSettings.precision)) {
+                        cerr << "Invalid value for --precision (must be auto/double/dd/fixed128/fixed192/fixed256/perturbation)" << endl;
+                        return -1;
+                    }
+                    break;
+                }
+                case ARG_FORMULA: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --formula (mandelbrot/multibrot3/multibrot4/tricorn/burningship)" << endl;
+                        return -1;
+                    }
+                    if (!parseFormula(argv[++i], params.formula)) {
+                        cerr << "Invalid value for --formula (must be mandelbrot/multibrot3/multibrot4/tricorn/burningship)" << endl;
+                        return -1;
+                    }
+                    break;
+                }
+                case ARG_NO_SMOOTH: cpuSettings.smoothColoring = false; break;
+                case ARG_JULIA: {
+                    if (i + 2 >= argc) {
+                        cerr << "Missing values for --julia (re im)" << endl;
+                        return -1;
+                    }
+                    params.juliaMode = true;
+                    params.juliaX = stod(argv[++i]);
+                    params.juliaY = stod(argv[++i]);
+                    break;
+                }
+                case ARG_AREA: estimateArea = true; break;
+                case ARG_MINIBROT: findNearestMinibrot = true; break;
+                case ARG_MULTI_REFERENCE: cpuSettings.rebasing = false; break;
+                case ARG_ORBIT_MEMORY: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --orbit-memory (MB)" << endl;
+                        return -1;
+                    }
+                    long long value = stoll(argv[++i]);
+                    if (value < 1) {
+                        cerr << "Orbit memory must be at least 1 MB" << endl;
+                        return -1;
+                    }
+                    cpuSettings.orbitMemoryBudget = static_cast<size_t>(value) << 20;
+                    break;
+                }
+                case ARG_HYBRID: params.hybrid = true; break;
+                case ARG_CPU_WINDOW: cpuWindow = true; break;
+                case ARG_BUDDHABROT: params.densityMode = DensityMode::Buddhabrot; break;
+                case ARG_NEBULABROT: params.densityMode = DensityMode::Nebulabrot; break;
+                case ARG_SAMPLES: {
+                    if (i + 1 >= argc) {
+                        cerr << "Missing value for --samples" << endl;
+                        return -1;
+                    }
+                    long long value = stoll(argv[++i]);
+                    if (value <= 0) {
+                        cerr << "Sample count must be positive" << endl;
+                        return -1;
+                    }
+                    sampleCount = static_cast<uint64_t>(value);
+                    break;
+                }
+                case ARG_USE_DOUBLE: useDouble = true; break;
+                case ARG_UNKNOWN: cerr << "Unknown argument: " << argv[i] << endl; return -1;
+            }
+        }
+    }
+
+    // Julia sets live around the origin; frame the whole set unless a view was given
+    if (params.juliaMode && !viewGiven) {
+        params.offsetX = 0.0;
+        params.offsetY = 0.0;
+        params.zoom = 1.5;
+    }
+
+    if (findNearestMinibrot) {
+        string realDigits = params.offsetXDigits.empty() ? decimalDigits(params.offsetX) : params.offsetXDigits;
+        string imagDigits = params.offsetYDigits.empty() ? decimalDigits(params.offsetY) : params.offsetYDigits;
+        if (!jumpToMinibrot(params, realDigits, imagDigits)) {
+            return -1;
+        }
+    }
+
+    if (runTune) {
+        cout << "Tuning CPU engine..." << endl;
+        cpuSettings = autotuneCpuSettings(cpuSettings);
+        if (!saveTunedSettings(cpuSettings)) {
+            return -1;
+        }
+        cout << "Saved tuning to " << tunedConfigPath() << endl;
+        if (!renderCpu) return 0;
+    }
+
+    if (estimateArea) {
+        return runAreaEstimate(cpuSettings, sampleCount, cpuIterations);
+    }
+    if (renderCpu && params.densityMode != DensityMode::Off) {
+        return renderBuddhabrotHeadless(params, cpuSettings, renderWidth, renderHeight,
+                                        sampleCount > 0 ? sampleCount : 20000000, renderPath);
+    }
+    if (renderCpu) {
+        return renderHeadless(params, cpuSettings, renderWidth, renderHeight, cpuIterations, renderPath);
+    }
+    
+    // create the window with OpenGL context settings
+    Window window(VideoMode({1200, 800}), "Mandelbrot Set Explorer - C++", State::Windowed, settings);
+    window.setVerticalSyncEnabled(useVsync);
+
+    // activate the window
+    if (!window.setActive(true)) {
+        cerr << "Warning: Failed to activate OpenGL context" << endl;
+    }
+
+    // Without the 4.1 core context the shaders need, explore on the CPU
+    const ContextSettings& actual = window.getSettings();
+    if (!cpuWindow && ((actual.attributeFlags & ContextSettings::Core) == 0 ||
+                       actual.majorVersion * 10 + actual.minorVersion < 41)) {
+        cerr << "OpenGL 4.1 core context unavailable (got " << actual.majorVersion << "." << actual.minorVersion
+             << "), falling back to the CPU engine" << endl;
+        cpuWindow = true;
+    }
+    if (cpuWindow) {
+        return runCpuWindow(window, params, cpuSettings, useVsync);
+    }
+
+    // Initialize OpenGL states
+    glDisable(GL_DEPTH_TEST);  // We don't need depth testing for 2D rendering
+    glDisable(GL_CULL_FACE);   // Disable face culling
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);  // Black background
+    checkGLError("OpenGL initialization");
+
+    // Print OpenGL version info
+    cout << "OpenGL Version: " << glGetString(GL_VERSION) << endl;
+    cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+    
+#ifdef __APPLE__
+    cout << "Note: On macOS, you may see 'FALLBACK' warnings - these are expected and don't affect functionality." << endl;
+#endif
+
+    // Create shader program
+    GLuint shaderProgram = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/fragment.glsl", useDouble,
+                                               params.formula);
+    if (shaderProgram == 0) {
+        cerr << "Failed to create shader program, falling back to the CPU engine" << endl;
+        return runCpuWindow(window, params, cpuSettings, useVsync);
+    }
+    cout << "Shader program created successfully!" << endl;
+    
+    // Initialize text renderer
+    TextRenderer textRenderer;
+    if (!textRenderer.initialize("res/OpenSans-Regular.ttf", 24)) {
+        cerr << "Failed to initialize text renderer!" << endl;
+        return -1;
+    }
+    cout << "Text renderer initialized successfully!" << endl;
+
+    JuliaPreview juliaPreview;
+    if (!juliaPreview.initialize()) {
+        cerr << "Failed to initialize Julia preview, disabling it" << endl;
+        params.showJuliaPreview = false;
+    }
+
+    BuddhabrotDisplay buddhabrotDisplay;
+    if (!buddhabrotDisplay.initialize()) {
+        cerr << "Failed to initialize Buddhabrot display!" << endl;
+        return -1;
+    }
+
+    GpuPerturbation gpuPerturbation;
+    if (!gpuPerturbation.initialize(useDouble)) {
+        cerr << "Failed to initialize GPU perturbation, deep zooms will pixelate" << endl;
+    }
+    gpuPerturbation.interiorThreshold = static_cast<float>(cpuSettings.interiorThreshold);
+
+    HybridRenderer hybridRenderer;
+    if (!hybridRenderer.initialize()) {
+        cerr << "Failed to initialize hybrid rendering, disabling it" << endl;
+        params.hybrid = false;
+    }
+    
+    // Fullscreen quad vertices (position only)
+    float vertices[] = {
+        -1.0f, -1.0f, 0.0f,  // Bottom left
+         1.0f, -1.0f, 0.0f,  // Bottom right
+         1.0f,  1.0f, 0.0f,  // Top right
+        -1.0f,  1.0f, 0.0f   // Top left
+    };
+    
+    // Quad indices
+    unsigned int indices[] = {
+        0, 1, 2,  // First triangle
+        2, 3, 0   // Second triangle
+    };
+
+    // Generate and bind VAO, VBO, EBO
+    GLuint VAO, VBO, EBO;
+    
+    // Clear any existing OpenGL errors
+    while(glGetError() != GL_NO_ERROR);
+    
+    glGenVertexArrays(1, &VAO);
+    checkGLError("glGenVertexArrays");
+    
+    glGenBuffers(1, &VBO);
+    checkGLError("glGenBuffers VBO");
+    
+    glGenBuffers(1, &EBO);
+    checkGLError("glGenBuffers EBO");
+
+    glBindVertexArray(VAO);
+    checkGLError("glBindVertexArray");
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    checkGLError("glBindBuffer VBO");
+    
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    checkGLError("glBufferData VBO");
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    checkGLError("glBindBuffer EBO");
+    
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    checkGLError("glBufferData EBO");
+
+    // Position attribute (location 0) - only position, no color
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    checkGLError("glVertexAttribPointer position");
+    
+    glEnableVertexAttribArray(0);
+    checkGLError("glEnableVertexAttribArray position");
+
+    // Unbind to prevent accidental modification
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    checkGLError("VAO setup complete");
+    
+    cout << "Rendering setup complete!" << endl;
+
+    // Get uniform locations for Mandelbrot parameters; looked up again
+    // whenever a formula change rebuilds the program
+    GLint resolutionLoc, zoomLoc, offsetLoc, maxIterationsLoc, colorLoc, colorBgLoc;
+    GLint adaptiveIterationsLoc, originLoc, juliaModeLoc, juliaCLoc, interiorThresholdLoc;
+    auto lookUpUniforms = [&]() {
+        resolutionLoc = glGetUniformLocation(shaderProgram, "resolution");
+
+        // Always use single precision uniforms (shader compatibility)
+        // But keep double precision on CPU side for better calculations
+        zoomLoc = glGetUniformLocation(shaderProgram, "zoom");
+        offsetLoc = glGetUniformLocation(shaderProgram, "offset");
+
+        maxIterationsLoc = glGetUniformLocation(shaderProgram, "maxIterations");
+        colorLoc = glGetUniformLocation(shaderProgram, "color");
+        colorBgLoc = glGetUniformLocation(shaderProgram, "colorBg");
+        adaptiveIterationsLoc = glGetUniformLocation(shaderProgram, "adaptiveIterations");
+        originLoc = glGetUniformLocation(shaderProgram, "origin");
+        juliaModeLoc = glGetUniformLocation(shaderProgram, "juliaMode");
+        juliaCLoc = glGetUniformLocation(shaderProgram, "juliaC");
+        interiorThresholdLoc = glGetUniformLocation(shaderProgram, "interiorThreshold");
+    };
+    lookUpUniforms();
+    
+    cout << "Uniform locations - resolution: " << resolutionLoc << ", zoom: " << zoomLoc 
+         << ", offset: " << offsetLoc << ", maxIterations: " << maxIterationsLoc 
+         << ", colorMode: " << colorLoc << ", adaptive: " << adaptiveIterationsLoc << endl;
+    
+    if (useDouble) {
+        cout << "Using double precision for CPU calculations with high precision shader" << endl;
+    }
+
+    // Plain escape-time frame: the formula shader on the fullscreen quad
+    auto drawEscapeTime = [&]() {
+        Vector2u windowSize = window.getSize();
+        // Use shader program
+        glUseProgram(shaderProgram);
+
+        // Set uniforms for Mandelbrot rendering
         Vector3f color = params.colors[params.colorMode];
         Vector3f colorBg = params.colorsBg[params.colorModeBg];
         glUniform2f(resolutionLoc, static_cast<float>(windowSize.x), static_cast<float>(windowSize.y));
-        
+        glUniform2f(originLoc, 0.0f, 0.0f);
+        glUniform1i(juliaModeLoc, params.juliaMode ? 1 : 0);
+        glUniform2f(juliaCLoc, static_cast<float>(params.juliaX), static_cast<float>(params.juliaY));
+
         // Always use float uniforms but convert from double precision CPU values
         glUniform1f(zoomLoc, static_cast<float>(params.zoom));
         glUniform2f(offsetLoc, static_cast<float>(params.offsetX), static_cast<float>(params.offsetY));
-        
+
         glUniform1i(maxIterationsLoc, params.maxIterations);
         glUniform3f(colorLoc, color.x, color.y, color.z);
         glUniform3f(colorBgLoc, colorBg.x, colorBg.y, colorBg.z);
         glUniform1i(adaptiveIterationsLoc, params.adaptiveIterations ? 1 : 0);
+        glUniform1f(interiorThresholdLoc, static_cast<float>(cpuSettings.interiorThreshold));
 
         // Draw fullscreen quad
         glBindVertexArray(VAO);
         checkGLError("bind VAO for drawing");
-        
+
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);  // 6 indices for 2 triangles
         checkGLError("draw elements");
-        
+
         glBindVertexArray(0);  // Unbind VAO after drawing
+    };
+
+    Clock clock;
+    
+    // FPS calculation variables
+    int frameCount = 0;
+    float fps = 0.0f;
+    uint64_t fpsRecomputations = 0;
+    float recomputationRate = 0.0f;  // reference orbits per second
+    Time fpsUpdateTime = clock.getElapsedTime();
+    
+    // Print controls
+    cout << "\n=== CONTROLS ===" << endl;
+    cout << "Mouse wheel: Zoom in/out" << endl;
+    cout << "Left click + drag: Pan view" << endl;
+    cout << "R: Reset view" << endl;
+    cout << "C: Cycle color modes" << endl;
+    cout << "V: Cycle color modes backwards" << endl;
+    cout << "B: Cycle background color modes" << endl;
+    cout << "N: Cycle background color modes backwards" << endl;
+    cout << "+/-: Increase/decrease iterations" << endl;
+    cout << "A: Toggle adaptive iterations" << endl;
+    cout << "J: Toggle Julia mode for the point under the cursor" << endl;
+    cout << "M: Zoom to the minibrot nearest the cursor" << endl;
+    cout << "P: Toggle Julia preview" << endl;
+    cout << "F: Cycle formulas" << endl;
+    cout << "D: Cycle Buddhabrot / Nebulabrot / escape-time views" << endl;
+    cout << "H: Toggle hybrid CPU+GPU rendering" << endl;
+    cout << "ESC: Exit" << endl;
+    
+    // run the main loop
+    bool running = true;
+    while (running) {
+        // handle events
+        while (const optional event = window.pollEvent()) {
+            handleViewInput(*event, params, window);
+            if (event->is<Event::Closed>()) {
+                running = false;
+            }
+            else if (const auto* resized = event->getIf<Event::Resized>()) {
+                glViewport(0, 0, resized->size.x, resized->size.y);
+            }
+            else if (const auto* keyPressed = event->getIf<Event::KeyPressed>()) {
+                switch (keyPressed->code) {
+                    case Keyboard::Key::Escape:
+                        running = false;
+                        break;
+                    case Keyboard::Key::P:
+                        params.showJuliaPreview = !params.showJuliaPreview;
+                        break;
+                    case Keyboard::Key::D:
+                        params.densityMode = static_cast<DensityMode>((static_cast<int>(params.densityMode) + 1) % 3);
+                        break;
+                    case Keyboard::Key::H:
+                        if (hybridRenderer.copyProgram != 0) {
+                            params.hybrid = !params.hybrid;
+                            cout << "Hybrid CPU+GPU rendering " << (params.hybrid ? "on" : "off") << endl;
+                        }
+                        break;
+                    case Keyboard::Key::F: {
+                        Formula next = static_cast<Formula>((static_cast<int>(params.formula) + 1) % kFormulaCount);
+                        GLuint program = createShaderProgram("res/shaders/vertex.glsl", "res/shaders/fragment.glsl",
+                                                             useDouble, next);
+                        if (program == 0) {
+                            cerr << "Failed to build the " << formulaName(next) << " shader" << endl;
+                            break;
+                        }
+                        glDeleteProgram(shaderProgram);
+                        shaderProgram = program;
+                        lookUpUniforms();
+                        params.formula = next;
+                        juliaPreview.invalidate();
+                        cout << "Formula: " << formulaName(next) << endl;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+        }
+
+        // clear the buffers
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Get current window size for resolution uniform
+        Vector2u windowSize = window.getSize();
+
+        buddhabrotDisplay.update(params, cpuSettings, windowSize.x, windowSize.y);
+        bool perturbed = params.densityMode == DensityMode::Off && gpuPerturbation.applies(params);
+        hybridRenderer.update(params, cpuSettings);
+        bool hybrid = params.densityMode == DensityMode::Off && !perturbed && hybridRenderer.engine;
+        if (params.densityMode != DensityMode::Off) {
+            buddhabrotDisplay.render(VAO, clock.getElapsedTime().asSeconds());
+            checkGLError("Buddhabrot display");
+        } else if (perturbed) {
+            gpuPerturbation.render(VAO, params, windowSize.x, windowSize.y);
+            checkGLError("GPU perturbation");
+        } else if (hybrid) {
+            hybridRenderer.render(VAO, params, windowSize.x, windowSize.y, drawEscapeTime);
+            checkGLError("hybrid rendering");
+        } else {
+            drawEscapeTime();
+        }
+
+        // Julia set of the point under the cursor
+        double previewX = 0.0, previewY = 0.0;
+        bool showPreview = params.showJuliaPreview && !params.juliaMode && params.densityMode == DensityMode::Off;
+        if (showPreview) {
+            Vector2i mousePos = Mouse::getPosition(window);
+            screenToComplex(params, windowSize.x, windowSize.y, mousePos.x, mousePos.y, previewX, previewY);
+            juliaPreview.render(shaderProgram, VAO, params, previewX, previewY,
+                                clock.getElapsedTime().asSeconds(), windowSize.x, windowSize.y);
+            checkGLError("Julia preview");
+        }
 
         // Calculate FPS
         frameCount++;
         Time currentTime = clock.getElapsedTime();
         if (currentTime - fpsUpdateTime >= seconds(0.5f)) { // Update FPS every 0.5 seconds
             fps = frameCount / (currentTime - fpsUpdateTime).asSeconds();
+            recomputationRate = (gpuPerturbation.recomputations - fpsRecomputations) /
+                                (currentTime - fpsUpdateTime).asSeconds();
+            fpsRecomputations = gpuPerturbation.recomputations;
             frameCount = 0;
             fpsUpdateTime = currentTime;
         }
@@ -720,6 +2479,50 @@ int main(int argc, char* argv[]) {
         stringstream fpsStream;
         fpsStream << fixed << setprecision(0) << "FPS: " << fps;
         textRenderer.renderText(fpsStream.str(), 10.0f, 30.0f, 1.0f, sf::Vector3f(1.0f, 1.0f, 1.0f), windowSize.x, windowSize.y);
+        if (buddhabrotDisplay.engine) {
+            stringstream samplesStream;
+            samplesStream << fixed << setprecision(1) << "Samples: " << buddhabrotDisplay.engine->sampleCount() / 1e6
+                          << " M (" << buddhabrotDisplay.engine->samplesPerSecond() / 1e6 << " M/s)";
+            textRenderer.renderText(samplesStream.str(), 10.0f, 60.0f, 0.6f, sf::Vector3f(1.0f, 1.0f, 1.0f),
+                                    windowSize.x, windowSize.y);
+        }
+        if (perturbed) {
+            stringstream referenceStream;
+            referenceStream << fixed << setprecision(1) << "Reference: ";
+            if (gpuPerturbation.orbitComplete) {
+                referenceStream << gpuPerturbation.orbit.length() << " iterations ("
+                                << gpuPerturbation.orbit.seconds * 1000.0 << " ms)";
+            } else {
+                referenceStream << "computing " << gpuPerturbation.orbit.length() << " of "
+                                << gpuPerturbation.orbitIterations << " iterations";
+            }
+            referenceStream << ", " << recomputationRate << " recomputed/s";
+            textRenderer.renderText(referenceStream.str(), 10.0f, 60.0f, 0.6f, sf::Vector3f(1.0f, 1.0f, 1.0f),
+                                    windowSize.x, windowSize.y);
+        }
+        if (hybrid) {
+            stringstream hybridStream;
+            hybridStream << fixed << setprecision(1) << "Hybrid: CPU " << hybridRenderer.cpuRows << " rows ("
+                         << hybridRenderer.cpuSeconds * 1000.0 << " ms), GPU " << windowSize.y - hybridRenderer.cpuRows
+                         << " rows (" << hybridRenderer.gpuSeconds * 1000.0 << " ms)";
+            textRenderer.renderText(hybridStream.str(), 10.0f, 60.0f, 0.6f, sf::Vector3f(1.0f, 1.0f, 1.0f),
+                                    windowSize.x, windowSize.y);
+        }
+        if (params.zoom <= kDeepestZoom) {
+            stringstream limitStream;
+            limitStream << "Deepest zoom reached (" << kDeepestZoom << ")";
+            textRenderer.renderText(limitStream.str(), 10.0f, 90.0f, 0.6f, sf::Vector3f(1.0f, 1.0f, 1.0f),
+                                    windowSize.x, windowSize.y);
+        }
+        if (showPreview) {
+            stringstream juliaStream;
+            juliaStream << fixed << setprecision(4) << "c = " << previewX << (previewY < 0.0 ? " - " : " + ")
+                        << fabs(previewY) << "i";
+            float labelX = static_cast<float>(windowSize.x - JuliaPreview::kSize - JuliaPreview::kMargin);
+            float labelY = static_cast<float>(windowSize.y - JuliaPreview::kSize - JuliaPreview::kMargin - 8);
+            textRenderer.renderText(juliaStream.str(), labelX, labelY, 0.6f, sf::Vector3f(1.0f, 1.0f, 1.0f),
+                                    windowSize.x, windowSize.y);
+        }
 
         // end the current frame (internally swaps the front and back buffers)
         window.display();
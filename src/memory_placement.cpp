@@ -0,0 +1,162 @@
+#include "memory_placement.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+// Parse a sysfs cpulist such as "0-15,32-47"
+vector<int> parseCpuList(const string& list) {
+    vector<int> cpus;
+    stringstream stream(list);
+    string range;
+    while (getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+NumaTopology NumaTopology::detect() {
+    NumaTopology topology;
+
+#ifdef __linux__
+    // Nodes are numbered densely on every system we care about; stop at the first gap
+    for (int node = 0; node < 1024; node++) {
+        ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        if (!file.is_open()) break;
+        string list;
+        getline(file, list);
+        vector<int> cpus = parseCpuList(list);
+        if (!cpus.empty()) {
+            topology.nodeCpus.push_back(cpus);
+        }
+    }
+#endif
+
+    if (topology.nodeCpus.empty()) {
+        int cpuCount = max(1u, thread::hardware_concurrency());
+        vector<int> cpus(cpuCount);
+        for (int i = 0; i < cpuCount; i++) cpus[i] = i;
+        topology.nodeCpus.push_back(cpus);
+    }
+    return topology;
+}
+
+vector<pair<int, int>> NumaTopology::interleavedCpus() const {
+    vector<pair<int, int>> slots;
+    size_t longest = 0;
+    for (const auto& cpus : nodeCpus) longest = max(longest, cpus.size());
+    for (size_t i = 0; i < longest; i++) {
+        for (int node = 0; node < nodeCount(); node++) {
+            if (i < nodeCpus[node].size()) {
+                slots.push_back({node, nodeCpus[node][i]});
+            }
+        }
+    }
+    return slots;
+}
+
+bool pinCurrentThreadToCpu(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+LargeBuffer::~LargeBuffer() {
+    release();
+}
+
+bool LargeBuffer::allocate(size_t size, bool useHugePages) {
+    release();
+    if (size == 0) return true;
+
+#ifdef __linux__
+    if (useHugePages && size >= kHugePageSize) {
+        // Explicit huge pages only work when the administrator reserved a pool
+        size_t hugeBytes = roundUp(size, kHugePageSize);
+        void* mapped = mmap(nullptr, hugeBytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapped != MAP_FAILED) {
+            ptr = mappedPtr = mapped;
+            bytes = size;
+            mappedBytes = hugeBytes;
+            mode = "hugetlb";
+            return true;
+        }
+
+        // Fall back to transparent huge pages on a 2 MB aligned region
+        size_t paddedBytes = hugeBytes + kHugePageSize;
+        mapped = mmap(nullptr, paddedBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped != MAP_FAILED) {
+            uintptr_t aligned = roundUp(reinterpret_cast<uintptr_t>(mapped), kHugePageSize);
+            mappedPtr = mapped;
+            mappedBytes = paddedBytes;
+            ptr = reinterpret_cast<void*>(aligned);
+            bytes = size;
+            mode = madvise(ptr, hugeBytes, MADV_HUGEPAGE) == 0 ? "thp" : "none";
+            return true;
+        }
+    }
+
+    // Plain anonymous mapping: untouched pages are placed on first write
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) return false;
+    ptr = mappedPtr = mapped;
+    bytes = mappedBytes = size;
+    mode = "none";
+    return true;
+#else
+    (void)useHugePages;
+    ptr = mappedPtr = malloc(size);
+    if (!ptr) return false;
+    bytes = mappedBytes = size;
+    mode = "none";
+    return true;
+#endif
+}
+
+void LargeBuffer::release() {
+    if (!mappedPtr) return;
+#ifdef __linux__
+    munmap(mappedPtr, mappedBytes);
+#else
+    free(mappedPtr);
+#endif
+    ptr = mappedPtr = nullptr;
+    bytes = mappedBytes = 0;
+    mode = "none";
+}
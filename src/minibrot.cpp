@@ -0,0 +1,175 @@
+#include "minibrot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+
+#include "fixed_point.h"
+#include "reference_orbit.h"
+
+using namespace std;
+
+namespace {
+
+using Complex = complex<double>;
+
+const double kEscapeRadius = 2.0;
+// Past this the next squaring could leave the fixed-point range of [-128, 128)
+const double kFixedPointLimit = 8.0;
+// Newton steps this small (in units of the format's resolution) mean converged
+const double kConvergedUlps = 64.0;
+// Fraction bits resolved beyond the search radius
+const double kGuardBits = 32.0;
+// Copies narrower than this many units of the format's resolution are
+// searched again in the next wider format
+const double kResolvedUlps = 16777216.0;
+// Widest format searched: Newton steps and derivatives are doubles, so
+// nothing deeper than about 1e-300 converges
+const int kMaxMinibrotLimbs = 16;
+
+template <int Limbs>
+inline void step(FixedPoint<Limbs>& x, FixedPoint<Limbs>& y, const FixedPoint<Limbs>& cx,
+                 const FixedPoint<Limbs>& cy) {
+    FixedPoint<Limbs> x2 = square(x);
+    FixedPoint<Limbs> y2 = square(y);
+    FixedPoint<Limbs> xy = x * y;
+    x = x2 - y2 + cx;
+    y = twice(xy) + cy;
+}
+
+template <int Limbs>
+inline Complex toComplex(const FixedPoint<Limbs>& x, const FixedPoint<Limbs>& y) {
+    return Complex(x.toDouble(), y.toDouble());
+}
+
+// Lowest period of a nucleus within radius of c by the ball method, or the
+// atom domain period of c if the test never fires before escape
+template <int Limbs>
+int detectPeriod(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, double radius, int maxPeriod) {
+    FixedPoint<Limbs> x, y;
+    Complex z, dz;
+    double smallest = HUGE_VAL;
+    int atomPeriod = 1;
+    for (int n = 1; n <= maxPeriod; n++) {
+        dz = 2.0 * z * dz + 1.0;
+        step(x, y, cx, cy);
+        z = toComplex(x, y);
+        double magnitude = abs(z);
+        if (magnitude < radius * abs(dz)) return n;
+        if (magnitude > kEscapeRadius) break;
+        if (magnitude < smallest) {
+            smallest = magnitude;
+            atomPeriod = n;
+        }
+    }
+    return atomPeriod;
+}
+
+// Newton step -z_p(c) / z_p'(c). Orbits that leave the fixed-point range
+// only happen far from the nucleus, where double precision is plenty, so
+// they are finished in double.
+template <int Limbs>
+Complex newtonStep(const FixedPoint<Limbs>& cx, const FixedPoint<Limbs>& cy, int period) {
+    FixedPoint<Limbs> x, y;
+    Complex z, dz;
+    int n = 1;
+    for (; n <= period; n++) {
+        dz = 2.0 * z * dz + 1.0;
+        step(x, y, cx, cy);
+        z = toComplex(x, y);
+        if (fabs(z.real()) + fabs(z.imag()) > kFixedPointLimit) break;
+    }
+    Complex c = toComplex(cx, cy);
+    for (n++; n <= period && isfinite(z.real()); n++) {
+        dz = 2.0 * z * dz + 1.0;
+        z = z * z + c;
+    }
+    return -z / dz;
+}
+
+// The search in one fixed-point format
+template <int Limbs>
+bool searchNucleus(const string& realDigits, const string& imagDigits, double radius, const MinibrotSearch& search,
+                   Minibrot& result) {
+    using Real = FixedPoint<Limbs>;
+    const double ulp = ldexp(1.0, -Real::kFractionBits);
+
+    Real cx, cy;
+    if (!Real::parse(realDigits, cx) || !Real::parse(imagDigits, cy)) {
+        cerr << "Invalid minibrot search centre " << realDigits << ", " << imagDigits << endl;
+        return false;
+    }
+
+    int period = detectPeriod(cx, cy, radius, search.maxPeriod);
+
+    bool converged = false;
+    int steps = 0;
+    while (!converged && steps < search.maxNewtonSteps) {
+        Complex delta = newtonStep(cx, cy, period);
+        if (!isfinite(delta.real()) || !isfinite(delta.imag())) break;
+        cx = cx + Real::fromDouble(delta.real());
+        cy = cy + Real::fromDouble(delta.imag());
+        steps++;
+        converged = abs(delta) < kConvergedUlps * ulp;
+    }
+    if (!converged) {
+        cerr << "Newton's method did not converge on the period " << period << " nucleus" << endl;
+        return false;
+    }
+
+    // Size estimate, checking on the way that the nucleus is not a shorter
+    // period's: then z_k already vanishes for a divisor k of the period
+    Real x, y;
+    Complex z, dz;
+    Complex lambda = 1.0;
+    Complex beta = 1.0;
+    for (int k = 1; k < period; k++) {
+        dz = 2.0 * z * dz + 1.0;
+        step(x, y, cx, cy);
+        z = toComplex(x, y);
+        if (period % k == 0 && abs(z) < kConvergedUlps * ulp * abs(dz)) {
+            period = k;
+            break;
+        }
+        lambda = 2.0 * z * lambda;
+        beta += 1.0 / lambda;
+    }
+    Complex scale = 1.0 / (beta * lambda * lambda);
+
+    result.period = period;
+    result.realDigits = cx.toString();
+    result.imagDigits = cy.toString();
+    result.real = cx.toDouble();
+    result.realLo = (cx - Real::fromDouble(result.real)).toDouble();
+    result.imag = cy.toDouble();
+    result.imagLo = (cy - Real::fromDouble(result.imag)).toDouble();
+    result.size = abs(scale);
+    result.angle = arg(scale);
+    result.newtonSteps = steps;
+    return true;
+}
+
+} // namespace
+
+bool findMinibrot(const string& realDigits, const string& imagDigits, double radius,
+                  const MinibrotSearch& search, Minibrot& result) {
+    int limbs = clamp(referenceLimbs(log2(1.0 / radius) + kGuardBits), 4, kMaxMinibrotLimbs);
+    bool found = false;
+    while (true) {
+        Minibrot candidate;
+        bool converged = false;
+        switch (limbs) {
+            case 4: converged = searchNucleus<4>(realDigits, imagDigits, radius, search, candidate); break;
+            case 8: converged = searchNucleus<8>(realDigits, imagDigits, radius, search, candidate); break;
+            default: converged = searchNucleus<16>(realDigits, imagDigits, radius, search, candidate); break;
+        }
+        // A wider retry that fails leaves the narrower result
+        if (!converged) return found;
+        result = candidate;
+        found = true;
+        double resolution = ldexp(1.0, FixedPoint<2>::kIntegerBits - 64 * limbs);
+        if (limbs >= kMaxMinibrotLimbs || result.size > kResolvedUlps * resolution) return true;
+        limbs *= 2;
+    }
+}
@@ -0,0 +1,534 @@
+#include "reference_orbit.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define MANDEL_SPIN_PAUSE() _mm_pause()
+#else
+#define MANDEL_SPIN_PAUSE() ((void)0)
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "cpu_kernels.h"
+
+using namespace std;
+
+namespace {
+
+// Points computed at a time before they are handed to the store
+const int kStoreChunkIterations = 4096;
+
+// Waits shorter than this many pauses spin; longer ones yield the core
+const int kSpinsBeforeYield = 1 << 12;
+// Rows of a square below which splitting it costs more than it saves
+const int kMinRowsPerPart = 8;
+
+template <int Limbs>
+void computeOrbit(const FixedPoint<4>& referenceX, const FixedPoint<4>& referenceY, int maxIterations,
+                  OrbitStore& orbit) {
+    FixedPoint<Limbs> cx = narrowFixedPoint<Limbs>(referenceX);
+    FixedPoint<Limbs> cy = narrowFixedPoint<Limbs>(referenceY);
+    FixedPoint<Limbs> zx, zy;
+    vector<double> chunk;
+    chunk.reserve(2 * kStoreChunkIterations);
+    bool escaped = false;
+    for (int computed = 0; !escaped && computed < maxIterations; computed += kStoreChunkIterations) {
+        chunk.clear();
+        escaped = extendFixedPointOrbit(cx, cy, zx, zy, min(kStoreChunkIterations, maxIterations - computed), chunk);
+        orbit.append(chunk.data(), static_cast<int>(chunk.size() / 2));
+    }
+}
+
+inline void spinWait(int& spins) {
+    if (++spins < kSpinsBeforeYield) {
+        MANDEL_SPIN_PAUSE();
+    } else {
+        this_thread::yield();
+    }
+}
+
+// Rows [first, last) of the square of a non-negative number as a full
+// 2 * Limbs word product: a_i^2 at word 2i and twice a_i a_j (j > i) at
+// word i + j. The parts of a split add up to the whole square.
+template <int Limbs>
+void squareRows(const uint64_t* a, int first, int last, uint64_t* product) {
+    using namespace fixed_point_detail;
+
+    fill(product, product + 2 * Limbs, 0);
+    for (int i = first; i < last; i++) {
+        uint64_t carry = 0;
+        for (int j = i + 1; j < Limbs; j++) {
+            uint64_t low, high;
+            multiplyWide(a[i], a[j], low, high);
+            low += carry;
+            high += low < carry ? 1 : 0;
+            uint64_t sum = product[i + j] + low;
+            high += sum < low ? 1 : 0;
+            product[i + j] = sum;
+            carry = high;
+        }
+        // Earlier rows reach word i + Limbs - 1 at most
+        product[i + Limbs] = carry;
+    }
+    for (int i = 2 * Limbs - 1; i > 0; i--) product[i] = (product[i] << 1) | (product[i - 1] >> 63);
+    product[0] <<= 1;
+    for (int i = first; i < last; i++) {
+        uint64_t low, high;
+        multiplyWide(a[i], a[i], low, high);
+        uint64_t sum = product[2 * i] + low;
+        uint64_t carry = high + (sum < low ? 1 : 0);
+        product[2 * i] = sum;
+        for (int k = 2 * i + 1; carry && k < 2 * Limbs; k++) {
+            product[k] += carry;
+            carry = product[k] < carry ? 1 : 0;
+        }
+    }
+}
+
+// Sum parts of a square and truncate it to the fixed-point format, as
+// FixedPoint's operator* does
+template <int Limbs>
+FixedPoint<Limbs> squareFromParts(uint64_t* const* parts, int count) {
+    uint64_t* product = parts[0];
+    for (int part = 1; part < count; part++) {
+        uint64_t carry = 0;
+        for (int i = 0; i < 2 * Limbs; i++) {
+            uint64_t sum = product[i] + carry;
+            uint64_t carryOut = sum < carry ? 1 : 0;
+            product[i] = sum + parts[part][i];
+            carry = carryOut + (product[i] < sum ? 1 : 0);
+        }
+    }
+    FixedPoint<Limbs> result;
+    const int shift = 64 - FixedPoint<Limbs>::kIntegerBits;
+    for (int i = 0; i < Limbs; i++) {
+        result.limb[i] = (product[Limbs - 1 + i] >> shift) | (product[Limbs + i] << (64 - shift));
+    }
+    return result;
+}
+
+// Orbit of a wide reference point. Each step squares x, y and x + y, giving
+// x^2 - y^2 and 2xy = (x + y)^2 - x^2 - y^2 without a general multiply; the
+// squares are split into tasks that the team's threads share, with thread 0
+// leading: it publishes the operands of each step, does its own tasks,
+// waits for the others' and combines them. Steps are a few microseconds,
+// too short to hand over through a condition variable, so threads spin.
+// The split only changes who computes which words, so every team size
+// gives the same orbit.
+template <int Limbs>
+class WideOrbit {
+public:
+    WideOrbit(const ReferenceCoordinate& referenceX, const ReferenceCoordinate& referenceY, int threadCount)
+        : cx(narrowFixedPoint<Limbs>(referenceX)), cy(narrowFixedPoint<Limbs>(referenceY)) {
+        int partsPerSquare = max(1, min(threadCount / 3, Limbs / kMinRowsPerPart));
+        threads = max(1, min(threadCount, 3 * partsPerSquare));
+        // Row i costs about Limbs - i products, so equal shares of the
+        // triangle end at Limbs (1 - sqrt(1 - k / parts))
+        for (int square = 0; square < 3; square++) {
+            for (int part = 0; part < partsPerSquare; part++) {
+                Task task;
+                task.square = square;
+                task.first = rowBoundary(part, partsPerSquare);
+                task.last = rowBoundary(part + 1, partsPerSquare);
+                tasks.push_back(task);
+            }
+        }
+        products.resize(tasks.size());
+        for (int square = 0; square < 3; square++) {
+            for (int part = 0; part < partsPerSquare; part++) {
+                squareParts[square].push_back(products[square * partsPerSquare + part].data());
+            }
+        }
+    }
+
+    int threadCount() const { return threads; }
+
+    // Thread 0: iterate, storing the points in orbit; the others: help until it is done
+    void run(int index, int maxIterations, OrbitStore& orbit) {
+        if (index >= threads) return;
+        if (index > 0) {
+            help(index);
+            return;
+        }
+        FixedPoint<Limbs> zx, zy;
+        vector<double> chunk;
+        chunk.reserve(2 * kStoreChunkIterations);
+        bool escaped = false;
+        for (int computed = 0; !escaped && computed < maxIterations;) {
+            chunk.clear();
+            int count = min(kStoreChunkIterations, maxIterations - computed);
+            escaped = extend(zx, zy, count, chunk);
+            orbit.append(chunk.data(), static_cast<int>(chunk.size() / 2));
+            computed += count;
+        }
+        if (threads > 1) published.store(kFinished, memory_order_release);
+    }
+
+    // Thread 0: append up to count points from z on to chunk, leaving the
+    // next z in (zx, zy); true once z has escaped
+    bool extend(FixedPoint<Limbs>& zx, FixedPoint<Limbs>& zy, int count, vector<double>& chunk) {
+        for (int i = 0; i < count; i++) {
+            chunk.push_back(zx.toDouble());
+            chunk.push_back(zy.toDouble());
+            if (step(zx, zy)) return true;
+        }
+        return false;
+    }
+
+private:
+    struct Task {
+        int square = 0;
+        int first = 0;
+        int last = 0;
+    };
+
+    static const uint64_t kFinished = ~uint64_t(0);
+
+    static int rowBoundary(int part, int parts) {
+        if (part >= parts) return Limbs;
+        return static_cast<int>(lround(Limbs * (1.0 - sqrt(1.0 - static_cast<double>(part) / parts))));
+    }
+
+    static FixedPoint<Limbs> magnitude(const FixedPoint<Limbs>& value) {
+        return value.isNegative() ? -value : value;
+    }
+
+    void runTasks(int index) {
+        for (size_t task = index; task < tasks.size(); task += threads) {
+            const Task& part = tasks[task];
+            squareRows<Limbs>(operands[part.square].limb, part.first, part.last, products[task].data());
+        }
+    }
+
+    void help(int index) {
+        uint64_t seen = 0;
+        while (true) {
+            int spins = 0;
+            uint64_t current;
+            while ((current = published.load(memory_order_acquire)) == seen) spinWait(spins);
+            if (current == kFinished) return;
+            seen = current;
+            runTasks(index);
+            completed.fetch_add(1, memory_order_release);
+        }
+    }
+
+    // One iteration; true once |z| > 2, leaving z as it was
+    bool step(FixedPoint<Limbs>& zx, FixedPoint<Limbs>& zy) {
+        operands[0] = magnitude(zx);
+        operands[1] = magnitude(zy);
+        operands[2] = magnitude(zx + zy);
+        if (threads > 1) {
+            steps++;
+            published.store(steps, memory_order_release);
+            runTasks(0);
+            // Counted over all steps, so nothing has to be reset between them
+            uint64_t expected = steps * (threads - 1);
+            int spins = 0;
+            while (completed.load(memory_order_acquire) != expected) spinWait(spins);
+        } else {
+            runTasks(0);
+        }
+        int partsPerSquare = static_cast<int>(tasks.size() / 3);
+        FixedPoint<Limbs> zx2 = squareFromParts<Limbs>(squareParts[0].data(), partsPerSquare);
+        FixedPoint<Limbs> zy2 = squareFromParts<Limbs>(squareParts[1].data(), partsPerSquare);
+        FixedPoint<Limbs> sum2 = squareFromParts<Limbs>(squareParts[2].data(), partsPerSquare);
+        FixedPoint<Limbs> r2 = zx2 + zy2;
+        if (r2.integerPart() >= 4 && r2.toDouble() > 4.0) return true;
+        zy = sum2 - r2 + cy;
+        zx = zx2 - zy2 + cx;
+        return false;
+    }
+
+    FixedPoint<Limbs> cx;
+    FixedPoint<Limbs> cy;
+    int threads = 1;
+    vector<Task> tasks;
+    vector<array<uint64_t, 2 * Limbs>> products;  // one per task
+    vector<uint64_t*> squareParts[3];
+    FixedPoint<Limbs> operands[3];  // |x|, |y|, |x + y| of the current step
+    uint64_t steps = 0;
+    // Step counter the helpers wait on, and tasks done by helpers
+    alignas(64) atomic<uint64_t> published{0};
+    alignas(64) atomic<uint64_t> completed{0};
+};
+
+template <int Limbs>
+void computeWideOrbit(const ReferenceCoordinate& cx, const ReferenceCoordinate& cy, int maxIterations,
+                      OrbitStore& orbit, const ReferenceTeam& team) {
+    bool shared = team.minLimbs > 0 && Limbs >= team.minLimbs && team.threads > 1;
+    WideOrbit<Limbs> wide(cx, cy, shared ? team.threads : 1);
+    if (wide.threadCount() == 1) {
+        wide.run(0, maxIterations, orbit);
+    } else if (team.run) {
+        team.run([&](int index) { wide.run(index, maxIterations, orbit); });
+    } else {
+        vector<thread> helpers;
+        for (int index = 1; index < wide.threadCount(); index++) {
+            helpers.emplace_back([&, index] { wide.run(index, maxIterations, orbit); });
+        }
+        wide.run(0, maxIterations, orbit);
+        for (thread& helper : helpers) helper.join();
+    }
+}
+
+// A reference orbit computed a chunk at a time on one thread, with the
+// kernels' fixed-point loop up to 4 limbs and WideOrbit's step past that
+template <int Limbs, bool Wide = (Limbs > 4)>
+class ChunkedOrbit {
+public:
+    ChunkedOrbit(const ReferenceCoordinate& referenceX, const ReferenceCoordinate& referenceY)
+        : cx(narrowFixedPoint<Limbs>(referenceX)), cy(narrowFixedPoint<Limbs>(referenceY)) {}
+
+    // Append up to count points to the empty chunk; true once the orbit has escaped
+    bool extend(int count, vector<double>& chunk) { return extendFixedPointOrbit(cx, cy, zx, zy, count, chunk); }
+
+private:
+    FixedPoint<Limbs> cx, cy;
+    FixedPoint<Limbs> zx, zy;
+};
+
+template <int Limbs>
+class ChunkedOrbit<Limbs, true> {
+public:
+    ChunkedOrbit(const ReferenceCoordinate& referenceX, const ReferenceCoordinate& referenceY)
+        : wide(referenceX, referenceY, 1) {}
+
+    bool extend(int count, vector<double>& chunk) { return wide.extend(zx, zy, count, chunk); }
+
+private:
+    WideOrbit<Limbs> wide;
+    FixedPoint<Limbs> zx, zy;
+};
+
+} // namespace
+
+OrbitStore::OrbitStore(size_t memoryBudget) : budget(memoryBudget) {}
+
+OrbitStore::~OrbitStore() {
+    unmap();
+}
+
+void OrbitStore::reset(int maxPoints) {
+    unmap();
+    capacity = max(maxPoints, 0);
+    count = 0;
+    compact = false;
+    rounded.clear();
+    rounded.shrink_to_fit();
+    full.clear();
+    full.reserve(2 * min<size_t>(capacity, budget / (2 * sizeof(double))));
+}
+
+void OrbitStore::append(const double* points, int added) {
+    added = min(added, capacity - count);
+    size_t end = 2 * static_cast<size_t>(count + added);
+    if (!compact && end * sizeof(double) > budget) compactPoints();
+    if (!compact) {
+        full.insert(full.end(), points, points + 2 * added);
+    } else if (mapping) {
+        float* out = mapping + 2 * static_cast<size_t>(count);
+        for (int i = 0; i < 2 * added; i++) out[i] = static_cast<float>(points[i]);
+    } else {
+        for (int i = 0; i < 2 * added; i++) rounded.push_back(static_cast<float>(points[i]));
+    }
+    count += added;
+}
+
+const char* OrbitStore::storageName() const {
+    if (!compact) return "double";
+    return mapping ? "mapped float" : "float";
+}
+
+// Switch to float pairs, moving the points so far; to a mapped file when
+// even those would exceed the budget
+void OrbitStore::compactPoints() {
+    size_t values = 2 * static_cast<size_t>(capacity);
+    if (values * sizeof(float) > budget && mapFile(values * sizeof(float))) {
+        for (size_t i = 0; i < full.size(); i++) mapping[i] = static_cast<float>(full[i]);
+    } else {
+        rounded.reserve(values);
+        for (double value : full) rounded.push_back(static_cast<float>(value));
+    }
+    full.clear();
+    full.shrink_to_fit();
+    compact = true;
+}
+
+bool OrbitStore::mapFile(size_t bytes) {
+#ifdef __linux__
+    const char* directory = getenv("TMPDIR");
+    string path = string(directory && *directory ? directory : "/tmp") + "/mandelbrot-orbit-XXXXXX";
+    int file = mkstemp(&path[0]);
+    if (file < 0) {
+        cerr << "Cannot create " << path << " for the reference orbit: " << strerror(errno) << endl;
+        return false;
+    }
+    // The mapping keeps the file alive, and nothing is left behind on exit
+    unlink(path.c_str());
+    void* mapped = MAP_FAILED;
+    if (ftruncate(file, static_cast<off_t>(bytes)) == 0) {
+        mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    int error = errno;
+    close(file);
+    if (mapped == MAP_FAILED) {
+        cerr << "Cannot map " << bytes / (1 << 20) << " MB for the reference orbit: " << strerror(error) << endl;
+        return false;
+    }
+    mapping = static_cast<float*>(mapped);
+    mappedBytes = bytes;
+    return true;
+#else
+    (void)bytes;
+    return false;
+#endif
+}
+
+void OrbitStore::unmap() {
+#ifdef __linux__
+    if (mapping) munmap(mapping, mappedBytes);
+#endif
+    mapping = nullptr;
+    mappedBytes = 0;
+}
+
+int referenceLimbs(double requiredBits) {
+    for (int limbs : {2, 3, 4, 8, 16, 32}) {
+        if (requiredBits <= 64 * limbs - FixedPoint<2>::kIntegerBits) return limbs;
+    }
+    return kMaxReferenceLimbs;
+}
+
+double computeReferenceOrbit(const ReferenceCoordinate& cx, const ReferenceCoordinate& cy, int limbs,
+                             int maxIterations, OrbitStore& orbit, const ReferenceTeam& team) {
+    auto start = chrono::steady_clock::now();
+    orbit.reset(maxIterations);
+    FixedPoint<4> narrowX = narrowFixedPoint<4>(cx);
+    FixedPoint<4> narrowY = narrowFixedPoint<4>(cy);
+    switch (limbs) {
+        case 2: computeOrbit<2>(narrowX, narrowY, maxIterations, orbit); break;
+        case 3: computeOrbit<3>(narrowX, narrowY, maxIterations, orbit); break;
+        case 4: computeOrbit<4>(narrowX, narrowY, maxIterations, orbit); break;
+        case 8: computeWideOrbit<8>(cx, cy, maxIterations, orbit, team); break;
+        case 16: computeWideOrbit<16>(cx, cy, maxIterations, orbit, team); break;
+        case 32: computeWideOrbit<32>(cx, cy, maxIterations, orbit, team); break;
+        default: computeWideOrbit<kMaxReferenceLimbs>(cx, cy, maxIterations, orbit, team); break;
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+ReferenceOrbitWorker::ReferenceOrbitWorker() {
+    thread = std::thread(&ReferenceOrbitWorker::workerLoop, this);
+}
+
+ReferenceOrbitWorker::~ReferenceOrbitWorker() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+        generation++;
+    }
+    stateWake.notify_all();
+    thread.join();
+}
+
+void ReferenceOrbitWorker::start(const ReferenceCoordinate& cx, const ReferenceCoordinate& cy, int limbs,
+                                 int maxIterations) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        generation++;
+        jobLimbs = limbs;
+        jobIterations = maxIterations;
+        published.cx = cx;
+        published.cy = cy;
+        published.z.clear();
+        published.z.reserve(2 * static_cast<size_t>(maxIterations));
+        published.seconds = 0.0;
+        complete = maxIterations <= 0;
+    }
+    stateWake.notify_all();
+}
+
+bool ReferenceOrbitWorker::collect(ReferenceOrbit& orbit) {
+    lock_guard<mutex> lock(stateMutex);
+    if (collected != generation) {
+        collected = generation;
+        orbit.cx = published.cx;
+        orbit.cy = published.cy;
+        orbit.z.clear();
+    }
+    orbit.z.insert(orbit.z.end(), published.z.begin() + orbit.z.size(), published.z.end());
+    orbit.seconds = published.seconds;
+    return complete;
+}
+
+void ReferenceOrbitWorker::workerLoop() {
+    uint64_t done = 0;
+    while (true) {
+        int limbs;
+        {
+            unique_lock<mutex> lock(stateMutex);
+            stateWake.wait(lock, [&] { return stopping || generation != done; });
+            if (stopping) return;
+            done = generation;
+            limbs = jobLimbs;
+        }
+        switch (limbs) {
+            case 2: compute<2>(done); break;
+            case 3: compute<3>(done); break;
+            case 4: compute<4>(done); break;
+            case 8: compute<8>(done); break;
+            case 16: compute<16>(done); break;
+            case 32: compute<32>(done); break;
+            default: compute<kMaxReferenceLimbs>(done); break;
+        }
+    }
+}
+
+template <int Limbs>
+void ReferenceOrbitWorker::compute(uint64_t job) {
+    auto start = chrono::steady_clock::now();
+    ReferenceCoordinate cx, cy;
+    int maxIterations;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        if (generation != job) return;
+        cx = published.cx;
+        cy = published.cy;
+        maxIterations = jobIterations;
+    }
+
+    ChunkedOrbit<Limbs> steps(cx, cy);
+    vector<double> chunk;
+    int computed = 0;
+    bool escaped = false;
+    while (!escaped && computed < maxIterations) {
+        // The chunk holds this round's points only
+        chunk.clear();
+        int count = min(kChunkIterations, maxIterations - computed);
+        escaped = steps.extend(count, chunk);
+        computed += count;
+
+        lock_guard<mutex> lock(stateMutex);
+        if (generation != job) return;
+        published.z.insert(published.z.end(), chunk.begin(), chunk.end());
+        if (escaped || computed >= maxIterations) {
+            published.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            complete = true;
+        }
+    }
+}